@@ -53,6 +53,16 @@ int main( )
 	u2["foo"] >> foo;
 	cout << "foo  = " << foo << endl;
 	u2["yyz"] >> yyz;
-	cout << "yyz  = " << yyz << endl;
+	cout << "yyz  = " << yyz << endl << endl;
+	
+	// or read fields in place, without copying keys or values out of the buffer
+	cout << "*** Reading the same fields through map_view ***" << endl;
+	unpacker viewd( str );
+	map_view v1( viewd );
+	map_view v2( v1["msg"] );
+	v1["bar"] >> bar;
+	cout << "bar  = " << bar << endl;
+	v2["foo"] >> foo;
+	cout << "foo  = " << foo << endl;
 	return 0;
 }
@@ -10,6 +10,27 @@ msgpackalt.c : function implementations
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#ifdef _WIN32
+	#include <io.h>
+	#define SINK_WRITE	_write
+#else
+	#include <unistd.h>
+	#define SINK_WRITE	write
+#endif
+#if __LITTLE_ENDIAN__ && !defined( MSGPACK_NO_SIMD ) && ( defined( __SSSE3__ ) || defined( __AVX2__ ))
+	#define MSGPACK_SIMD		/* vector byteswaps for the bulk array functions */
+	#ifdef __AVX2__
+		#include <immintrin.h>
+	#else
+		#include <tmmintrin.h>
+	#endif
+#endif
+#if !defined( MSGPACK_NO_SIMD ) && defined( __SSE4_2__ )
+	#define MSGPACK_CRC32C_HW	/* crc32 instruction for msgpack_crc32c */
+	#include <nmmintrin.h>
+#endif
 
 #if __LITTLE_ENDIAN__           /* have to swap for network-endian */
 	#ifdef _MSC_VER
@@ -47,29 +68,283 @@ msgpackalt.c : function implementations
 
 #define PTR_CHK(m)	if ( !m || !m->p ) return MSGPACK_ARGERR;
 
+/* **************************************** ERRORS **************************************** */
+MSGPACKF const char* msgpack_strerror( int code )
+{
+	switch ( code ) {
+		case MSGPACK_SUCCESS:	return "success";
+		case MSGPACK_TYPEERR:	return "unexpected type code";
+		case MSGPACK_MEMERR:	return "memory allocation/access error";
+		case MSGPACK_ARGERR:	return "invalid argument";
+		case MSGPACK_OVERFLOW:	return "fixed buffer overflow";
+		case MSGPACK_IOERR:		return "sink write error";
+		case MSGPACK_NEEDMORE:	return "incomplete object";
+		case MSGPACK_DEPTHERR:	return "nesting too deep";
+		default:				return code > 0 ? "success" : "unknown error code";
+	}
+}
+
 /* **************************************** MEMORY FUNCTIONS **************************************** */
 
-MSGPACKF msgpack_p* msgpack_pack_init( )
+MSGPACKF void* msgpack_malloc( const msgpack_alloc *a, uint32_t n )
+{
+	return a ? a->alloc_fn( a->ctx, n ) : malloc( n );
+}
+
+MSGPACKF void* msgpack_realloc( const msgpack_alloc *a, void *ptr, uint32_t old, uint32_t n )
+{
+	return a ? a->realloc_fn( a->ctx, ptr, old, n ) : realloc( ptr, n );
+}
+
+MSGPACKF void msgpack_free( const msgpack_alloc *a, void *ptr, uint32_t n )
+{
+	if ( !ptr ) return;
+	if ( !a ) free( ptr );
+	else if ( a->free_fn ) a->free_fn( a->ctx, ptr, n );
+}
+
+/* ---------------------------------------- arena allocator ---------------------------------------- */
+#define ARENA_ALIGN( n )	((( n ) + 7u ) & ~7u )	/* 8 byte alignment covers all the basic types */
+
+struct msgpack_arena_block {
+	struct msgpack_arena_block *next;	/* previously filled block */
+	uint32_t size;						/* bytes available after the header */
+	uint32_t used;						/* bytes handed out so far */
+	double align;						/* data starts after this, suitably aligned */
+};
+#define ARENA_DATA( b )		(( byte* )&( b )->align )
+
+static void* msgpack_arena_alloc_hook( void *ctx, uint32_t n )
+{
+	return msgpack_arena_alloc(( msgpack_arena* )ctx, n );
+}
+
+static void* msgpack_arena_realloc_hook( void *ctx, void *ptr, uint32_t old, uint32_t n )
+{
+	msgpack_arena *a = ( msgpack_arena* )ctx;
+	struct msgpack_arena_block *b = a->head;
+	void *p;
+	if ( ptr && ptr == a->last )		/* most recent allocation: grow/shrink in place if it fits */
+	{
+		const uint32_t off = ( byte* )ptr - ARENA_DATA( b );
+		if ( off + n <= b->size ) { b->used = ARENA_ALIGN( off + n ); return ptr; }
+	}
+	p = msgpack_arena_alloc( a, n );
+	if ( p && ptr ) memcpy( p, ptr, old < n ? old : n );
+	return p;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_arena_init( msgpack_arena *a, uint32_t block )
+{
+	if ( !a ) return MSGPACK_ARGERR;
+	a->hooks.alloc_fn = msgpack_arena_alloc_hook;
+	a->hooks.realloc_fn = msgpack_arena_realloc_hook;
+	a->hooks.free_fn = NULL;		/* released with the arena */
+	a->hooks.ctx = a;
+	a->head = NULL;
+	a->block = block ? ARENA_ALIGN( block ) : 4096;
+	a->last = NULL;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF void* msgpack_arena_alloc( msgpack_arena *a, uint32_t n )
+{
+	struct msgpack_arena_block *b;
+	if ( !a ) return NULL;
+	n = ARENA_ALIGN( n ? n : 1 );
+	b = a->head;
+	if ( !b || b->used + n > b->size )	/* start a new block, big enough for oversized requests */
+	{
+		const uint32_t size = n > a->block ? n : a->block;
+		b = ( struct msgpack_arena_block* )malloc( sizeof( struct msgpack_arena_block ) - sizeof( double ) + size );
+		if ( !b ) return NULL;
+		b->size = size;
+		b->used = 0;
+		b->next = a->head;
+		a->head = b;
+	}
+	a->last = ARENA_DATA( b ) + b->used;
+	b->used += n;
+	return a->last;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_arena_reset( msgpack_arena *a )
+{
+	struct msgpack_arena_block *b;
+	if ( !a ) return MSGPACK_ARGERR;
+	if ( !a->head ) return MSGPACK_SUCCESS;
+	while (( b = a->head->next )) { a->head->next = b->next; free( b ); }	/* keep only the newest block */
+	a->head->used = 0;
+	a->last = NULL;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_arena_free( msgpack_arena *a )
+{
+	if ( !a ) return MSGPACK_ARGERR;
+	msgpack_arena_reset( a );
+	free( a->head );
+	a->head = NULL;
+	return MSGPACK_SUCCESS;
+}
+#undef ARENA_DATA
+#undef ARENA_ALIGN
+
+/* ---------------------------------------- packer memory ---------------------------------------- */
+MSGPACKF msgpack_p* msgpack_pack_init_alloc( const msgpack_alloc *a )
 {
-	msgpack_p *m = ( msgpack_p* )malloc( sizeof( msgpack_p ));
+	msgpack_p *m = ( msgpack_p* )msgpack_malloc( a, sizeof( msgpack_p ));
+	if ( !m ) return NULL;
 	m->max = 256;
-	m->p = m->buffer = ( byte* )malloc( m->max );
-	return m->p ? m : NULL;
+	m->p = m->buffer = ( byte* )msgpack_malloc( a, m->max );
+	m->flags = MSGPACK_FLAG_OWNED;
+	m->alloc = a;
+	m->sg = NULL;
+	m->sink = NULL; m->sink_ctx = NULL;
+	m->watermark = 0; m->flushed = 0;
+	if ( !m->p ) { msgpack_free( a, m, sizeof( msgpack_p )); return NULL; }
+	return m;
+}
+
+MSGPACKF msgpack_p* msgpack_pack_init( )
+{
+	return msgpack_pack_init_alloc( NULL );
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_init_fixed( msgpack_p *m, void *buffer, uint32_t max )
+{
+	if ( !m || !buffer || !max ) return MSGPACK_ARGERR;
+	m->max = max;
+	m->p = m->buffer = ( byte* )buffer;
+	m->flags = MSGPACK_FLAG_FIXED | MSGPACK_FLAG_STATIC;	/* never expand, never free */
+	m->alloc = NULL;
+	m->sg = NULL;
+	m->sink = NULL; m->sink_ctx = NULL;
+	m->watermark = 0; m->flushed = 0;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_init_buffer( msgpack_p *m, void *buffer, uint32_t max, const msgpack_alloc *a )
+{
+	MSGPACK_ERR ret = msgpack_pack_init_fixed( m, buffer, max );
+	if ( ret ) return ret;
+	m->flags = MSGPACK_FLAG_STATIC;	/* may expand, but the initial buffer is never freed */
+	m->alloc = a;
+	return MSGPACK_SUCCESS;
+}
+
+/* ---------------------------------------- streaming ---------------------------------------- */
+static INLINE MSGPACK_ERR msgpack_sink_write( msgpack_p *m, const void *data, uint32_t n )
+{
+	if ( !n ) return MSGPACK_SUCCESS;
+	if ( m->sink( m->sink_ctx, ( const byte* )data, n ) < 0 ) return MSGPACK_IOERR;
+	m->flushed += n;
+	return MSGPACK_SUCCESS;
+}
+
+/* pass a payload that would overrun the watermark straight to the sink. returns 1 if the payload
+	was not handled (it fits in the buffer after flushing), otherwise an error code */
+static INLINE int msgpack_sink_direct( msgpack_p *m, const void *data, uint32_t n )
+{
+	MSGPACK_ERR ret;
+	if ( m->p + n <= m->buffer + m->watermark ) return 1;
+	if (( ret = msgpack_pack_flush( m ))) return ret;	/* keep the stream in order */
+	if ( n <= m->watermark ) return 1;
+	return msgpack_sink_write( m, data, n );
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_set_sink( msgpack_p *m, msgpack_sink_fn fn, void *ctx, uint32_t watermark )
+{
+	PTR_CHK( m );
+	if ( m->sink && ( m->p > m->buffer )) { MSGPACK_ERR ret = msgpack_pack_flush( m ); if ( ret ) return ret; }
+	m->sink = fn;
+	m->sink_ctx = ctx;
+	m->watermark = watermark ? watermark : m->max;
+	if (( m->flags & MSGPACK_FLAG_FIXED ) && m->watermark > m->max ) m->watermark = m->max;
+	return MSGPACK_SUCCESS;
+}
+
+/* forget the first "off" buffered bytes and "k" references, which reached the sink before it failed */
+static void msgpack_sink_drop( msgpack_p *m, uint32_t off, uint32_t k )
+{
+	uint32_t i;
+	memmove( m->buffer, m->buffer + off, ( m->p - m->buffer ) - off );
+	m->p -= off;
+	if ( !m->sg ) return;
+	for ( i = 0; i < k; ++i ) m->sg->bytes -= m->sg->refs[i].n;
+	m->sg->n -= k;
+	memmove( m->sg->refs, m->sg->refs + k, m->sg->n * sizeof( msgpack_ref ));
+	for ( i = 0; i < m->sg->n; ++i ) m->sg->refs[i].offset -= off;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_flush( msgpack_p *m )
+{
+	uint32_t i = 0, off = 0;
+	MSGPACK_ERR ret = MSGPACK_SUCCESS;
+	PTR_CHK( m );
+	if ( !m->sink ) return MSGPACK_ARGERR;
+	if ( m->sg ) for ( ; i < m->sg->n; ++i )	/* payloads packed by reference go out in place */
+	{
+		const msgpack_ref *r = m->sg->refs + i;
+		if (( ret = msgpack_sink_write( m, m->buffer + off, r->offset - off ))) break;
+		off = r->offset;
+		if (( ret = msgpack_sink_write( m, r->data, r->n ))) break;
+	}
+	if ( !ret ) ret = msgpack_sink_write( m, m->buffer + off, ( m->p - m->buffer ) - off );
+	if ( ret ) { msgpack_sink_drop( m, off, i ); return ret; }	/* keep only what is still to be written */
+	m->p = m->buffer;
+	if ( m->sg ) m->sg->n = m->sg->bytes = 0;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF uint64_t msgpack_pack_total( const msgpack_p *m )
+{
+	if ( !m || !m->p ) return 0;
+	return m->flushed + msgpack_get_len( m );
+}
+
+MSGPACKF int msgpack_sink_file( void *ctx, const byte *data, uint32_t n )
+{
+	return fwrite( data, 1, n, ( FILE* )ctx ) == n ? MSGPACK_SUCCESS : MSGPACK_IOERR;
+}
+
+MSGPACKF int msgpack_sink_fd( void *ctx, const byte *data, uint32_t n )
+{
+	const int fd = ( int )( intptr_t )ctx;
+	while ( n )
+	{
+		const int k = ( int )SINK_WRITE( fd, data, n );
+		if (( k < 0 ) && ( errno == EINTR )) continue;
+		if ( k <= 0 ) return MSGPACK_IOERR;		/* nothing written would otherwise be retried forever */
+		data += k; n -= k;
+	}
+	return MSGPACK_SUCCESS;
 }
+#undef SINK_WRITE
 
-INLINE MSGPACK_ERR msgpack_expand( msgpack_p *m, uint32_t num )
+static INLINE MSGPACK_ERR msgpack_expand( msgpack_p *m, uint32_t num )
 {
 	PTR_CHK( m );
+	if ( m->sink && ( m->p + num > m->buffer + m->watermark ) && ( m->p > m->buffer ))
+	{	/* streaming: hand over what is buffered rather than growing */
+		MSGPACK_ERR ret = msgpack_pack_flush( m );
+		if ( ret ) return ret;
+	}
 	if ( m->p + num > m->buffer + m->max )	/* too much for allocated buffer? */
 	{
 		byte *p;							/* pointer for new buffer */
 		uint32_t l = m->p - m->buffer;		/* current buffer length */
 		uint32_t m2 = 2*m->max;				/* guess at next length */
+		if ( m->flags & MSGPACK_FLAG_FIXED ) return MSGPACK_OVERFLOW;	/* caller's buffer is full */
 		if ( l + num > m2 ) m2 = l + num;	/* is it enough? otherwise expand to fit */
-		p = ( byte* )malloc( m2 );			/* attempt to allocate new space */
+		if ( m->flags & MSGPACK_FLAG_OWNED )
+			p = ( byte* )msgpack_realloc( m->alloc, m->buffer, m->max, m2 );	/* attempt to resize */
+		else if (( p = ( byte* )msgpack_malloc( m->alloc, m2 )))
+		{	/* outgrew the caller's initial buffer: move to our own */
+			memcpy( p, m->buffer, l );
+			m->flags |= MSGPACK_FLAG_OWNED;
+		}
 		if ( !p ) return MSGPACK_MEMERR;	/* failed, but buffer still intact */
-		memcpy( p, m->buffer, l );			/* copy the previous buffer across */
-		free( m->buffer );					/* free the old buffer */
 		m->buffer = p;						/* updated stored values */
 		m->p = p + l;
 		m->max = m2;
@@ -79,8 +354,10 @@ INLINE MSGPACK_ERR msgpack_expand( msgpack_p *m, uint32_t num )
 
 MSGPACKF MSGPACK_ERR msgpack_pack_append( msgpack_p *m, const void* data, uint32_t n )
 {
-	MSGPACK_ERR ret = msgpack_expand( m, n );
-	if ( ret ) return ret;
+	MSGPACK_ERR ret;
+	int direct;
+	if ( data && m && m->sink && ( direct = msgpack_sink_direct( m, data, n )) <= 0 ) return ( MSGPACK_ERR )direct;
+	if (( ret = msgpack_expand( m, n ))) return ret;
 	if ( data )
 		memcpy( m->p, data, n );
 	else
@@ -91,23 +368,99 @@ MSGPACKF MSGPACK_ERR msgpack_pack_append( msgpack_p *m, const void* data, uint32
 
 MSGPACKF MSGPACK_ERR msgpack_pack_free( msgpack_p *m )
 {
+	byte flags;
+	const msgpack_alloc *a;
 	PTR_CHK( m );
-	if ( m->buffer ) free( m->buffer ); //m->p = NULL; m->buffer = NULL; }
+	flags = m->flags; a = m->alloc;
+	if ( m->buffer && ( flags & MSGPACK_FLAG_OWNED )) msgpack_free( a, m->buffer, m->max );
+	if ( m->sg ) {
+		msgpack_free( a, m->sg->refs, m->sg->max * sizeof( msgpack_ref ));
+		msgpack_free( a, m->sg, sizeof( msgpack_sg ));
+	}
 	memset( m, 0, sizeof( msgpack_p ));	// for sanity
-	free( m );
+	if ( !( flags & MSGPACK_FLAG_STATIC )) msgpack_free( a, m, sizeof( msgpack_p ));
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_reset( msgpack_p *m )
+{
+	PTR_CHK( m );
+	m->p = m->buffer;
+	if ( m->sg ) m->sg->n = m->sg->bytes = 0;
+	m->flushed = 0;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_reserve( msgpack_p *m, uint32_t n )
+{
+	return msgpack_expand( m, n );
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_shrink( msgpack_p *m, uint32_t max )
+{
+	byte *p;
+	uint32_t l;
+	PTR_CHK( m );
+	if ( !( m->flags & MSGPACK_FLAG_OWNED ) || ( m->flags & MSGPACK_FLAG_FIXED )) return MSGPACK_ARGERR;
+	l = m->p - m->buffer;
+	if ( max < l ) max = l;				/* never discard packed data */
+	if ( max == 0 ) max = 1;
+	if ( max >= m->max ) return MSGPACK_SUCCESS;
+	p = ( byte* )msgpack_realloc( m->alloc, m->buffer, m->max, max );
+	if ( !p ) return MSGPACK_MEMERR;	/* failed, but buffer still intact */
+	m->buffer = p;
+	m->p = p + l;
+	m->max = max;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_release( msgpack_p *m, msgpack_buffer *b )
+{
+	MSGPACK_ERR ret;
+	const byte *data;
+	byte *p;
+	uint32_t l;
+	PTR_CHK( m );
+	if ( !b || m->sink ) return MSGPACK_ARGERR;	/* a sink has already taken part of the message */
+	b->data = NULL; b->n = b->size = 0; b->alloc = m->alloc;
+	if (( ret = msgpack_get_buffer( m, &data, &l ))) return ret;	/* one contiguous block */
+	if ( !l ) return MSGPACK_SUCCESS;
+	if ( m->flags & MSGPACK_FLAG_OWNED )
+	{	/* hand over our buffer and start again in a new one */
+		if ( !( p = ( byte* )msgpack_malloc( m->alloc, 256 ))) return MSGPACK_MEMERR;
+		b->data = m->buffer; b->size = m->max;
+		m->p = m->buffer = p;
+		m->max = 256;
+	} else {
+		/* the buffer is the caller's, so the best we can do is a copy */
+		if ( !( b->data = ( byte* )msgpack_malloc( m->alloc, l ))) return MSGPACK_MEMERR;
+		memcpy( b->data, data, l );
+		b->size = l;
+		m->p = m->buffer;
+	}
+	b->n = l;
 	return MSGPACK_SUCCESS;
 }
 
+MSGPACKF void msgpack_buffer_free( msgpack_buffer *b )
+{
+	if ( !b ) return;
+	if ( b->data ) msgpack_free( b->alloc, b->data, b->size );
+	b->data = NULL; b->n = b->size = 0;
+}
+
 MSGPACKF uint32_t msgpack_get_len( const msgpack_p *m )
 {
 	if ( !m || !m->p ) return 0;
-	return m->p - m->buffer;
+	return m->p - m->buffer + ( m->sg ? m->sg->bytes : 0 );
 }
 
 MSGPACKF MSGPACK_ERR msgpack_get_buffer( msgpack_p *m, const byte ** data, uint32_t *n )
 {
+	MSGPACK_ERR ret;
 	*n = 0; *data = NULL;
 	PTR_CHK( m );
+	if ( m->sg && m->sg->n && ( ret = msgpack_pack_flatten( m ))) return ret;	/* need one contiguous block */
 	*n = m->p - m->buffer;
 	if ( *n ) *data = m->buffer;
 	return MSGPACK_SUCCESS;
@@ -115,15 +468,105 @@ MSGPACKF MSGPACK_ERR msgpack_get_buffer( msgpack_p *m, const byte ** data, uint3
 
 MSGPACKF uint32_t msgpack_copy_to( const msgpack_p *m, void *data, uint32_t max )
 {
-	uint32_t l;
+	uint32_t l, i, off = 0;
+	byte *dest = ( byte* )data;
 	if ( !m || !m->p || !data || !max ) return 0;
-	l = m->p - m->buffer;
+	l = msgpack_get_len( m );
 	if ( l > max ) return 0;
-	memcpy( data, m->buffer, l );
+	if ( m->sg ) for ( i = 0; i < m->sg->n; ++i )	/* gather: buffer segment, then referenced payload */
+	{
+		const msgpack_ref *r = m->sg->refs + i;
+		memcpy( dest, m->buffer + off, r->offset - off ); dest += r->offset - off;
+		memcpy( dest, r->data, r->n ); dest += r->n;
+		off = r->offset;
+	}
+	memcpy( dest, m->buffer + off, ( m->p - m->buffer ) - off );
 	return l;
 }
 
-INLINE MSGPACK_ERR msgpack_copy_bits( const void *src, void* dest, byte n )
+/* ---------------------------------------- scatter-gather ---------------------------------------- */
+MSGPACKF MSGPACK_ERR msgpack_pack_set_zerocopy( msgpack_p *m, uint32_t threshold )
+{
+	PTR_CHK( m );
+	if ( !m->sg )
+	{
+		m->sg = ( msgpack_sg* )msgpack_malloc( m->alloc, sizeof( msgpack_sg ));
+		if ( !m->sg ) return MSGPACK_MEMERR;
+		memset( m->sg, 0, sizeof( msgpack_sg ));
+	}
+	m->sg->threshold = threshold;
+	return MSGPACK_SUCCESS;
+}
+
+static INLINE MSGPACK_ERR msgpack_add_ref( msgpack_p *m, const void *data, uint32_t n )
+{
+	msgpack_sg *sg = m->sg;
+	msgpack_ref *r;
+	if ( sg->n == sg->max )		/* grow the reference table */
+	{
+		const uint32_t max = sg->max ? 2*sg->max : 8;
+		r = ( msgpack_ref* )msgpack_realloc( m->alloc, sg->refs, sg->max * sizeof( msgpack_ref ), max * sizeof( msgpack_ref ));
+		if ( !r ) return MSGPACK_MEMERR;
+		sg->refs = r;
+		sg->max = max;
+	}
+	r = sg->refs + sg->n++;
+	r->offset = m->p - m->buffer;
+	r->n = n;
+	r->data = data;
+	sg->bytes += n;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF int msgpack_get_iovcnt( const msgpack_p *m )
+{
+	if ( !m || !m->p ) return 0;
+	return 1 + ( m->sg ? 2*m->sg->n : 0 );	/* worst case, before dropping empty segments */
+}
+
+MSGPACKF int msgpack_get_iovec( const msgpack_p *m, msgpack_iovec *iov, int max )
+{
+	uint32_t i, off = 0;
+	int k = 0;
+	if ( !m || !m->p || !iov ) return MSGPACK_ARGERR;
+#define ADD_IOV( ptr, len ) if ( len ) { if ( k == max ) return MSGPACK_OVERFLOW; iov[k].iov_base = ( void* )( ptr ); iov[k].iov_len = ( len ); ++k; }
+	if ( m->sg ) for ( i = 0; i < m->sg->n; ++i )
+	{
+		const msgpack_ref *r = m->sg->refs + i;
+		ADD_IOV( m->buffer + off, r->offset - off );
+		ADD_IOV( r->data, r->n );
+		off = r->offset;
+	}
+	ADD_IOV( m->buffer + off, ( uint32_t )( m->p - m->buffer ) - off );
+#undef ADD_IOV
+	return k;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_flatten( msgpack_p *m )
+{
+	msgpack_sg *sg;
+	uint32_t end, i;
+	MSGPACK_ERR ret;
+	PTR_CHK( m );
+	sg = m->sg;
+	if ( !sg || !sg->n ) return MSGPACK_SUCCESS;
+	if (( ret = msgpack_expand( m, sg->bytes ))) return ret;
+	/* work backwards, opening a gap for each payload after shifting the bytes that follow it */
+	end = m->p - m->buffer;
+	m->p += sg->bytes;
+	for ( i = sg->n; i > 0; --i )
+	{
+		const msgpack_ref *r = sg->refs + i - 1;
+		sg->bytes -= r->n;			/* now the total of the payloads before this one */
+		memmove( m->buffer + r->offset + sg->bytes + r->n, m->buffer + r->offset, end - r->offset );
+		memcpy( m->buffer + r->offset + sg->bytes, r->data, r->n );
+		end = r->offset;
+	}
+	sg->n = 0;
+	return MSGPACK_SUCCESS;
+}
+
+static INLINE MSGPACK_ERR msgpack_copy_bits( const void *src, void* dest, byte n )
 {
 	if ( src && dest )
 		switch ( n ) {
@@ -139,20 +582,29 @@ INLINE MSGPACK_ERR msgpack_copy_bits( const void *src, void* dest, byte n )
 
 
 /* **************************************** PACKING FUNCTIONS **************************************** */
-INLINE MSGPACK_ERR msgpack_pack_internal( msgpack_p *m, byte code, const void* p, byte n )
+/* write a lead byte and "n" value bytes, the room for them having been ensured already */
+static INLINE MSGPACK_ERR msgpack_put( msgpack_p *m, byte code, const void* p, byte n )
 {
-	if ( !m || !m->p ) return MSGPACK_ARGERR;
-	if ( msgpack_expand( m, n + 1 )) return MSGPACK_MEMERR;
 	*m->p = code; ++m->p;
 	if ( msgpack_copy_bits( p, m->p, n )) return MSGPACK_ARGERR; else m->p += n;
 	return MSGPACK_SUCCESS;
 }
+static INLINE MSGPACK_ERR msgpack_pack_internal( msgpack_p *m, byte code, const void* p, byte n )
+{
+	MSGPACK_ERR ret;
+	if ( !m || !m->p ) return MSGPACK_ARGERR;
+	if (( ret = msgpack_expand( m, n + 1 ))) return ret;
+	return msgpack_put( m, code, p, n );
+}
 
 
 #define fix_t int8_t
+static INLINE void msgpack_unchecked_pack_fix( msgpack_p *m, int8_t x )	{ msgpack_put( m, ( x<0 )?( x|0xe0 ):x, NULL, 0 ); }
 #define DEFINE_INT_PACK( T, MT, chk, P ) \
 	MSGPACKF MSGPACK_ERR msgpack_pack_##T( msgpack_p *m, T##_t x ) \
-		{ if ( chk ) return msgpack_pack_##P( m, ( P##_t )x ); return msgpack_pack_internal( m, MSGPACK_##MT, &x, sizeof( x )); }
+		{ if ( chk ) return msgpack_pack_##P( m, ( P##_t )x ); return msgpack_pack_internal( m, MSGPACK_##MT, &x, sizeof( x )); } \
+	MSGPACKF void msgpack_unchecked_pack_##T( msgpack_p *m, T##_t x ) \
+		{ if ( chk ) msgpack_unchecked_pack_##P( m, ( P##_t )x ); else msgpack_put( m, MSGPACK_##MT, &x, sizeof( x )); }
 DEFINE_INT_PACK( uint8,  UINT8,  x<128, fix )
 DEFINE_INT_PACK( uint16, UINT16, x<(1u<<8), uint8 )
 DEFINE_INT_PACK( uint32, UINT32, x<(1ul<<16), uint16 )
@@ -172,23 +624,154 @@ MSGPACKF MSGPACK_ERR msgpack_pack_null( msgpack_p* m )                { return m
 MSGPACKF MSGPACK_ERR msgpack_pack_bool( msgpack_p* m, bool x )        { return msgpack_pack_internal( m, x?MSGPACK_TRUE:MSGPACK_FALSE, NULL, 0 ); }
 MSGPACKF MSGPACK_ERR msgpack_pack_fix( msgpack_p* m, int8_t x )       { return ( x>-32 )?msgpack_pack_internal( m,( x<0 )?( x|0xe0 ):x, NULL, 0 ):MSGPACK_TYPEERR; }
 
-INLINE MSGPACK_ERR msgpack_pack_arr_head( msgpack_p *m, byte c1, byte c2, uint32_t n )
+#define HEAD_PUT( code, p, w )	( checked ? msgpack_pack_internal( m, code, p, w ) : msgpack_put( m, code, p, w ))
+static INLINE MSGPACK_ERR msgpack_head( msgpack_p *m, byte c1, byte c2, uint32_t n, const int checked )
 {
-	if ( n < ( 1u<<( c1 >= 0xa0 ? 5 : 4 )))
-		return msgpack_pack_internal( m, c1|( byte )n, NULL, 0 );
+	const byte n8 = ( byte )n;
+	if ( c1 && ( n < ( 1u<<( c1 >= 0xa0 ? 5 : 4 ))))
+		return HEAD_PUT( c1|( byte )n, NULL, 0 );
+	else if (( n < ( 1u<<8 )) && (( c2 == MSGPACK_BIN ) || (( c2 == MSGPACK_RAW ) && !( m->flags & MSGPACK_FLAG_COMPAT ))))
+		return HEAD_PUT(( c2 == MSGPACK_RAW ) ? ( byte )MSGPACK_STR8 : c2, &n8, 1 );	/* str8 / bin8 */
+	else if ( c2 == MSGPACK_BIN )
+		return HEAD_PUT( c2 + ( n < ( 1u<<16 ) ? 1 : 2 ), &n, n < ( 1u<<16 ) ? 2 : 4 );
 	else if ( n < ( 1u<<16 ))
-		return msgpack_pack_internal( m, c2, &n, 2 );
+		return HEAD_PUT( c2, &n, 2 );
 	else
-		return msgpack_pack_internal( m, c2+1, &n, 4 );
+		return HEAD_PUT( c2+1, &n, 4 );
 }
-MSGPACKF MSGPACK_ERR msgpack_pack_raw( msgpack_p* m, const void *data, uint32_t n )
+#undef HEAD_PUT
+static INLINE MSGPACK_ERR msgpack_pack_arr_head( msgpack_p *m, byte c1, byte c2, uint32_t n )
+{
+	return msgpack_head( m, c1, c2, n, 1 );
+}
+/* header for raw, bin or ext data is written, so copy the payload (or reference it) */
+static MSGPACK_ERR msgpack_pack_payload( msgpack_p* m, const void *data, uint32_t n )
 {
-	if ( msgpack_pack_arr_head( m, 0xa0, MSGPACK_RAW, n )) return MSGPACK_TYPEERR;
-	if ( msgpack_expand( m, n )) return MSGPACK_MEMERR;
-	memcpy( m->p, data, n );
+	MSGPACK_ERR ret;
+	int direct;
+	if ( m->sink && ( direct = msgpack_sink_direct( m, data, n )) <= 0 ) return ( MSGPACK_ERR )direct;
+	if ( m->sg && m->sg->threshold && n >= m->sg->threshold ) return msgpack_add_ref( m, data, n );
+	if (( ret = msgpack_expand( m, n ))) return ret;
+	if ( n ) memcpy( m->p, data, n );	/* "data" may be NULL when empty */
 	m->p += n;
 	return MSGPACK_SUCCESS;
 }
+MSGPACKF MSGPACK_ERR msgpack_pack_raw( msgpack_p* m, const void *data, uint32_t n )
+{
+	msgpack_mark c;
+	MSGPACK_ERR ret;
+	if (( ret = msgpack_pack_checkpoint( m, &c ))) return ret;
+	if (( ret = msgpack_pack_arr_head( m, 0xa0, MSGPACK_RAW, n )) || ( ret = msgpack_pack_payload( m, data, n )))
+		msgpack_pack_rollback( m, &c );		/* no header without its payload */
+	return ret;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_bin( msgpack_p* m, const void *data, uint32_t n )
+{
+	msgpack_mark c;
+	MSGPACK_ERR ret;
+	PTR_CHK( m );
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return msgpack_pack_raw( m, data, n );
+	msgpack_pack_checkpoint( m, &c );
+	if (( ret = msgpack_pack_arr_head( m, 0, MSGPACK_BIN, n )) || ( ret = msgpack_pack_payload( m, data, n )))
+		msgpack_pack_rollback( m, &c );
+	return ret;
+}
+/* write the header of an ext of "n" bytes into "h" (6 bytes at most), returning its length */
+static INLINE uint32_t msgpack_ext_head( byte *h, int8_t type, uint32_t n )
+{
+	uint32_t nh = 2;
+	switch ( n ) {	/* fixext for the common sizes, otherwise ext8/16/32 with a length field */
+		case 1:     h[0] = MSGPACK_FIXEXT; break;
+		case 2:     h[0] = MSGPACK_FIXEXT+1; break;
+		case 4:     h[0] = MSGPACK_FIXEXT+2; break;
+		case 8:     h[0] = MSGPACK_FIXEXT+3; break;
+		case 16:    h[0] = MSGPACK_FIXEXT+4; break;
+		default:
+			if ( n < ( 1u<<8 ))         { h[0] = MSGPACK_EXT; h[1] = ( byte )n; nh = 3; }
+			else if ( n < ( 1u<<16 ))   { h[0] = MSGPACK_EXT+1; msgpack_copy_bits( &n, h + 1, 2 ); nh = 4; }
+			else                        { h[0] = MSGPACK_EXT+2; msgpack_copy_bits( &n, h + 1, 4 ); nh = 6; }
+	}
+	h[nh-1] = ( byte )type;
+	return nh;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_ext( msgpack_p* m, int8_t type, const void *data, uint32_t n )
+{
+	byte h[6];
+	msgpack_mark c;
+	MSGPACK_ERR ret;
+	PTR_CHK( m );
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return MSGPACK_TYPEERR;
+	if ( !data && n ) return MSGPACK_ARGERR;
+	msgpack_pack_checkpoint( m, &c );
+	if (( ret = msgpack_pack_append( m, h, msgpack_ext_head( h, type, n ))) || ( ret = msgpack_pack_payload( m, data, n )))
+		msgpack_pack_rollback( m, &c );
+	return ret;
+}
+/* as msgpack_pack_ext, but always copying the payload, for data that does not outlive the call */
+static MSGPACK_ERR msgpack_pack_ext_copy( msgpack_p* m, int8_t type, const void *data, uint32_t n )
+{
+	byte h[6];
+	msgpack_mark c;
+	MSGPACK_ERR ret;
+	PTR_CHK( m );
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return MSGPACK_TYPEERR;
+	msgpack_pack_checkpoint( m, &c );
+	if (( ret = msgpack_pack_append( m, h, msgpack_ext_head( h, type, n ))) || ( n && ( ret = msgpack_pack_append( m, data, n ))))
+		msgpack_pack_rollback( m, &c );
+	return ret;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_timestamp( msgpack_p* m, int64_t sec, uint32_t nsec )
+{
+	MSGPACK_ERR ret;
+	uint32_t s32;
+	uint64_t s64;
+	PTR_CHK( m );
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return MSGPACK_TYPEERR;
+	if ( nsec >= 1000000000ul ) return MSGPACK_ARGERR;
+	if (( sec >> 34 ) == 0 )
+	{
+		if (( nsec == 0 ) && (( sec >> 32 ) == 0 ))
+		{	/* timestamp 32: unsigned seconds */
+			if (( ret = msgpack_expand( m, 6 ))) return ret;
+			m->p[0] = MSGPACK_FIXEXT+2; m->p[1] = ( byte )MSGPACK_EXT_TIMESTAMP;
+			s32 = BYTESWAP32(( uint32_t )sec ); memcpy( m->p + 2, &s32, 4 );
+			m->p += 6;
+		}
+		else
+		{	/* timestamp 64: 30-bit nanoseconds above 34-bit seconds */
+			if (( ret = msgpack_expand( m, 10 ))) return ret;
+			m->p[0] = MSGPACK_FIXEXT+3; m->p[1] = ( byte )MSGPACK_EXT_TIMESTAMP;
+			s64 = BYTESWAP64((( uint64_t )nsec << 34 ) | ( uint64_t )sec ); memcpy( m->p + 2, &s64, 8 );
+			m->p += 10;
+		}
+	}
+	else
+	{	/* timestamp 96: nanoseconds then signed 64-bit seconds */
+		if (( ret = msgpack_expand( m, 15 ))) return ret;
+		m->p[0] = MSGPACK_EXT; m->p[1] = 12; m->p[2] = ( byte )MSGPACK_EXT_TIMESTAMP;
+		s32 = BYTESWAP32( nsec ); memcpy( m->p + 3, &s32, 4 );
+		s64 = BYTESWAP64(( uint64_t )sec ); memcpy( m->p + 7, &s64, 8 );
+		m->p += 15;
+	}
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_set_compat( msgpack_p *m, int legacy )
+{
+	PTR_CHK( m );
+	if ( legacy ) m->flags |= MSGPACK_FLAG_COMPAT; else m->flags &= ~MSGPACK_FLAG_COMPAT;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_raw_ref( msgpack_p* m, const void *data, uint32_t n )
+{
+	msgpack_mark c;
+	MSGPACK_ERR ret;
+	if ( !data && n ) return MSGPACK_ARGERR;
+	if ( m && m->p && !m->sg && ( ret = msgpack_pack_set_zerocopy( m, 0 ))) return ret;
+	if (( ret = msgpack_pack_checkpoint( m, &c ))) return ret;
+	if (( ret = msgpack_pack_arr_head( m, 0xa0, MSGPACK_RAW, n )) || ( n && ( ret = msgpack_add_ref( m, data, n ))))
+		msgpack_pack_rollback( m, &c );
+	return ret;
+}
 MSGPACKF MSGPACK_ERR msgpack_pack_str( msgpack_p* m, const char *str )
 {
 	if ( !str ) return MSGPACK_ARGERR;
@@ -203,25 +786,87 @@ MSGPACKF MSGPACK_ERR msgpack_pack_map( msgpack_p* m, uint32_t n )
 	return msgpack_pack_arr_head( m, 0x80, MSGPACK_MAP, n );
 }
 
+/* ---------------------------------------- deferred ---------------------------------------- */
+MSGPACKF MSGPACK_ERR msgpack_pack_checkpoint( msgpack_p *m, msgpack_mark *c )
+{
+	PTR_CHK( m ); if ( !c ) return MSGPACK_ARGERR;
+	c->offset = ( uint32_t )( m->p - m->buffer );
+	c->nref = m->sg ? m->sg->n : 0;
+	c->refbytes = m->sg ? m->sg->bytes : 0;
+	c->flushed = m->flushed;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_rollback( msgpack_p *m, const msgpack_mark *c )
+{
+	PTR_CHK( m ); if ( !c ) return MSGPACK_ARGERR;
+	if ( c->flushed != m->flushed || c->offset > ( uint32_t )( m->p - m->buffer )) return MSGPACK_ARGERR;
+	if ( m->sg ) { if ( c->nref > m->sg->n ) return MSGPACK_ARGERR; m->sg->n = c->nref; m->sg->bytes = c->refbytes; }
+	m->p = m->buffer + c->offset;
+	return MSGPACK_SUCCESS;
+}
+static MSGPACK_ERR msgpack_pack_begin( msgpack_p *m, msgpack_mark *c, byte code )
+{
+	MSGPACK_ERR ret;
+	PTR_CHK( m ); if ( !c ) return MSGPACK_ARGERR;
+	if (( ret = msgpack_expand( m, 5 ))) return ret;	/* may flush, so mark afterwards */
+	msgpack_pack_checkpoint( m, c );
+	m->p[0] = code; memset( m->p + 1, 0, 4 );
+	m->p += 5;
+	return MSGPACK_SUCCESS;
+}
+static MSGPACK_ERR msgpack_pack_end( msgpack_p *m, const msgpack_mark *c, byte code, uint32_t n )
+{
+	PTR_CHK( m ); if ( !c ) return MSGPACK_ARGERR;
+	/* the header must still be in the buffer, where begin put it */
+	if ( c->flushed != m->flushed || c->offset + 5 > ( uint32_t )( m->p - m->buffer ) || m->buffer[c->offset] != code )
+		return MSGPACK_ARGERR;
+	n = BYTESWAP32( n );
+	memcpy( m->buffer + c->offset + 1, &n, 4 );
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_pack_begin_array( msgpack_p* m, msgpack_mark *c )				{ return msgpack_pack_begin( m, c, 0xdd ); }
+MSGPACKF MSGPACK_ERR msgpack_pack_end_array( msgpack_p* m, const msgpack_mark *c, uint32_t n )	{ return msgpack_pack_end( m, c, 0xdd, n ); }
+MSGPACKF MSGPACK_ERR msgpack_pack_begin_map( msgpack_p* m, msgpack_mark *c )				{ return msgpack_pack_begin( m, c, 0xdf ); }
+MSGPACKF MSGPACK_ERR msgpack_pack_end_map( msgpack_p* m, const msgpack_mark *c, uint32_t n )	{ return msgpack_pack_end( m, c, 0xdf, n ); }
+
+/* ---------------------------------------- unchecked ---------------------------------------- */
+MSGPACKF void msgpack_unchecked_pack_null( msgpack_p* m )				{ msgpack_put( m, MSGPACK_NULL, NULL, 0 ); }
+MSGPACKF void msgpack_unchecked_pack_bool( msgpack_p* m, bool x )		{ msgpack_put( m, x?MSGPACK_TRUE:MSGPACK_FALSE, NULL, 0 ); }
+MSGPACKF void msgpack_unchecked_pack_float( msgpack_p *m, float x )	{ msgpack_put( m, MSGPACK_FLOAT, &x, 4 ); }
+MSGPACKF void msgpack_unchecked_pack_double( msgpack_p *m, double x )	{ msgpack_put( m, MSGPACK_DOUBLE, &x, 8 ); }
+MSGPACKF void msgpack_unchecked_pack_raw( msgpack_p* m, const void *data, uint32_t n )
+{
+	msgpack_head( m, 0xa0, MSGPACK_RAW, n, 0 );
+	if ( n ) memcpy( m->p, data, n );
+	m->p += n;
+}
+MSGPACKF void msgpack_unchecked_pack_array( msgpack_p* m, uint32_t n )	{ msgpack_head( m, 0x90, MSGPACK_ARRAY, n, 0 ); }
+MSGPACKF void msgpack_unchecked_pack_map( msgpack_p* m, uint32_t n )		{ msgpack_head( m, 0x80, MSGPACK_MAP, n, 0 ); }
+
 MSGPACKF MSGPACK_ERR msgpack_prepend_header( msgpack_p *m )
 {
-	const uint32_t l = msgpack_get_len( m );
+	const uint32_t l = msgpack_get_len( m );	/* includes payloads packed by reference */
+	uint32_t lb, i;
+	MSGPACK_ERR ret;
 	/* smallest pack size */
 	byte n = 5;
 	if ( l + 1 < 128 )          n = 1;
 	else if ( l + 3 < 65536 )   n = 3;
 	if ( l == 0 ) return MSGPACK_MEMERR;
+	if ( m->flushed ) return MSGPACK_ARGERR;	/* the start of the message has already been streamed */
 	/* expand buffer */
-	if ( msgpack_expand( m,n )) return MSGPACK_MEMERR;
+	if (( ret = msgpack_expand( m,n ))) return ret;
 	/* shift buffer for prepend */
-	memmove( m->buffer + n, m->buffer, l ); /* overlap is ok */
+	lb = m->p - m->buffer;
+	memmove( m->buffer + n, m->buffer, lb ); /* overlap is ok */
+	if ( m->sg ) for ( i = 0; i < m->sg->n; ++i ) m->sg->refs[i].offset += n;
 	/* pack length at front */
 	m->p = m->buffer;
 	if ( n == 1 )       msgpack_pack_fix( m, ( int8_t )( l+n ));
 	else if ( n == 3 )  msgpack_pack_uint16( m, ( uint16_t )( l+n ));
 	else                msgpack_pack_uint32( m, ( uint32_t )( l+n ));
 	/* reset pointer */
-	m->p += l;
+	m->p += lb;
 	return MSGPACK_SUCCESS;
 }
 
@@ -245,132 +890,271 @@ MSGPACKF int msgpack_check_header( msgpack_u *m )
 	return MSGPACK_TYPEERR;
 }
 
+/* **************************************** TYPE TABLE **************************************** */
+/* everything the unpacker needs to know about a lead byte, so that peek, skip and the header
+decoders are a single lookup rather than a chain of comparisons */
+typedef struct {
+	byte code;		/* type class, as returned by msgpack_unpack_peek_code */
+	byte size;		/* bytes before any variable-length payload (all of a fixext), or 0 for a reserved code */
+	byte width;		/* width of the big-endian length field, or 0 if the length is in the lead byte */
+	byte mask;		/* mask extracting the length from the lead byte */
+} msgpack_lead_t;
+
+#define LEAD(c,s,w,k)	{ c, s, w, k }
+#define LEAD4(c,s,w,k)	LEAD(c,s,w,k), LEAD(c,s,w,k), LEAD(c,s,w,k), LEAD(c,s,w,k)
+#define LEAD16(c,s,w,k)	LEAD4(c,s,w,k), LEAD4(c,s,w,k), LEAD4(c,s,w,k), LEAD4(c,s,w,k)
+#define RESERVED(b)		LEAD(b,0,0,0)
+static const msgpack_lead_t msgpack_lead_table[256] = {
+	LEAD16( MSGPACK_FIX, 1, 0, 0 ), LEAD16( MSGPACK_FIX, 1, 0, 0 ),			/* 0x00 - 0x7f positive fixnum */
+	LEAD16( MSGPACK_FIX, 1, 0, 0 ), LEAD16( MSGPACK_FIX, 1, 0, 0 ),
+	LEAD16( MSGPACK_FIX, 1, 0, 0 ), LEAD16( MSGPACK_FIX, 1, 0, 0 ),
+	LEAD16( MSGPACK_FIX, 1, 0, 0 ), LEAD16( MSGPACK_FIX, 1, 0, 0 ),
+	LEAD16( MSGPACK_MAP, 1, 0, 0x0f ),										/* 0x80 - 0x8f fixmap */
+	LEAD16( MSGPACK_ARRAY, 1, 0, 0x0f ),										/* 0x90 - 0x9f fixarray */
+	LEAD16( MSGPACK_RAW, 1, 0, 0x1f ), LEAD16( MSGPACK_RAW, 1, 0, 0x1f ),		/* 0xa0 - 0xbf fixraw */
+	LEAD( MSGPACK_NULL, 1, 0, 0 ), RESERVED( 0xc1 ),							/* 0xc0 */
+	LEAD( MSGPACK_BOOL, 1, 0, 0 ), LEAD( MSGPACK_BOOL, 1, 0, 0 ),
+	LEAD( MSGPACK_BIN, 2, 1, 0 ), LEAD( MSGPACK_BIN, 3, 2, 0 ), LEAD( MSGPACK_BIN, 5, 4, 0 ), LEAD( MSGPACK_EXT, 3, 1, 0 ),
+	LEAD( MSGPACK_EXT, 4, 2, 0 ), LEAD( MSGPACK_EXT, 6, 4, 0 ), LEAD( MSGPACK_FLOAT, 5, 0, 0 ), LEAD( MSGPACK_DOUBLE, 9, 0, 0 ),
+	LEAD( MSGPACK_UINT8, 2, 0, 0 ), LEAD( MSGPACK_UINT16, 3, 0, 0 ), LEAD( MSGPACK_UINT32, 5, 0, 0 ), LEAD( MSGPACK_UINT64, 9, 0, 0 ),
+	LEAD( MSGPACK_INT8, 2, 0, 0 ), LEAD( MSGPACK_INT16, 3, 0, 0 ), LEAD( MSGPACK_INT32, 5, 0, 0 ), LEAD( MSGPACK_INT64, 9, 0, 0 ),	/* 0xd0 */
+	LEAD( MSGPACK_EXT, 3, 0, 0 ), LEAD( MSGPACK_EXT, 4, 0, 0 ), LEAD( MSGPACK_EXT, 6, 0, 0 ), LEAD( MSGPACK_EXT, 10, 0, 0 ),	/* fixext */
+	LEAD( MSGPACK_EXT, 18, 0, 0 ), LEAD( MSGPACK_RAW, 2, 1, 0 ), LEAD( MSGPACK_RAW, 3, 2, 0 ), LEAD( MSGPACK_RAW, 5, 4, 0 ),
+	LEAD( MSGPACK_ARRAY, 3, 2, 0 ), LEAD( MSGPACK_ARRAY, 5, 4, 0 ), LEAD( MSGPACK_MAP, 3, 2, 0 ), LEAD( MSGPACK_MAP, 5, 4, 0 ),
+	LEAD16( MSGPACK_FIX, 1, 0, 0 ), LEAD16( MSGPACK_FIX, 1, 0, 0 )				/* 0xe0 - 0xff negative fixnum */
+};
+#undef RESERVED
+#undef LEAD16
+#undef LEAD4
+#undef LEAD
+
+/* the length (raw) or count (array/map) held in a header; scalars have mask 0 so return 0 */
+static INLINE uint32_t msgpack_lead_len( const byte *p, const msgpack_lead_t *l )
+{
+	switch ( l->width ) {
+		case 1:     return p[1];
+		case 2:     return BYTESWAP16( *( uint16_t* )( p + 1 ));
+		case 4:     return BYTESWAP32( *( uint32_t* )( p + 1 ));
+		default:    return *p & l->mask;
+	}
+}
+
+/* walk up to "nobj" complete objects from *pp without recursion, keeping a stack of the elements still
+pending in each open container. *pp is advanced past the objects completed (and "nval", if given, set to
+the number of values they contain), and the number walked is returned, or MSGPACK_NEEDMORE if the buffer
+ends inside a container */
+static int msgpack_walk( const byte **pp, const byte *end, uint32_t max_depth, int nobj, uint32_t *nval )
+{
+	uint32_t stack[MSGPACK_MAX_DEPTH];
+	uint32_t depth = 0, len, count, left, seen = 0;
+	const byte *p = *pp;
+	const msgpack_lead_t *l;
+	int done = 0;
+	if ( max_depth == 0 || max_depth > MSGPACK_MAX_DEPTH ) max_depth = MSGPACK_MAX_DEPTH;
+	while (( p < end ) && ( done < nobj ))
+	{
+		l = msgpack_lead_table + *p;
+		if ( depth && l->size && !( l->width | l->mask ) && (( uint32_t )( end - p ) >= l->size ))
+		{	/* fast-forward a run of fixed-size scalars inside a container */
+			left = stack[depth-1];
+			do {
+				p += l->size;
+				if ( !--left || ( p == end )) break;
+				l = msgpack_lead_table + *p;
+			} while ( l->size && !( l->width | l->mask ) && (( uint32_t )( end - p ) >= l->size ));
+			seen += stack[depth-1] - left;
+			stack[depth-1] = left;
+			if ( left ) continue;
+			--depth;		/* that run finished the container */
+		}
+		else
+		{
+			if ( !l->size ) return MSGPACK_TYPEERR;
+			if (( uint32_t )( end - p ) < l->size ) return MSGPACK_NEEDMORE;
+			++seen;
+			len = msgpack_lead_len( p, l ); count = 0;
+			if (( l->code == MSGPACK_ARRAY ) || ( l->code == MSGPACK_MAP )) { count = len; len = 0; }
+			if (( uint32_t )( end - p ) - l->size < len ) return MSGPACK_NEEDMORE;
+			p += l->size + len;
+			if ( count )	/* open a container: its elements need at least a byte each */
+			{
+				if ( l->code == MSGPACK_MAP ) {
+					if ( count > ( uint32_t )( end - p ) / 2 ) return MSGPACK_NEEDMORE;
+					count *= 2;
+				} else if ( count > ( uint32_t )( end - p )) return MSGPACK_NEEDMORE;
+				if ( depth == max_depth ) return MSGPACK_DEPTHERR;
+				stack[depth++] = count;
+				continue;
+			}
+		}
+		/* an object is complete: close every container it completes */
+		for ( ;; )
+		{
+			if ( !depth ) { ++done; *pp = p; if ( nval ) *nval = seen; break; }
+			if ( --stack[depth-1] ) break;
+			--depth;
+		}
+	}
+	return depth ? MSGPACK_NEEDMORE : done;
+}
+
+
 /* **************************************** UNPACKING FUNCTIONS **************************************** */
-MSGPACKF msgpack_u* msgpack_unpack_init( const void* data, uint32_t n, const int flags )
+MSGPACKF msgpack_u* msgpack_unpack_init_alloc( const void* data, uint32_t n, const int flags, const msgpack_alloc *a )
 {
-	msgpack_u *m = ( msgpack_u* )malloc( sizeof( msgpack_u ));
+	msgpack_u *m = ( msgpack_u* )msgpack_malloc( a, sizeof( msgpack_u ));
+	if ( !m ) return NULL;
+	m->alloc = a;
 	if ( flags || !data ) {
-		if ( n < 16 ) n = 16;
-		m->p = ( byte* )malloc( n );			/* allocate a block of memory */
+		m->size = n < 16 ? 16 : n;
+		m->p = ( byte* )msgpack_malloc( a, m->size );	/* allocate a block of memory */
+		if ( !m->p ) { msgpack_free( a, m, sizeof( msgpack_u )); return NULL; }
 		if ( data ) memcpy(( byte* )m->p, data, n );	/* a non-const operation, but that's fine since it's our memory */
-		m->flags = 1;							/* indicate the memory should be free'd */
+		else n = 0;								/* nothing to unpack yet */
+		m->flags = MSGPACK_FLAG_OWNED;			/* indicate the memory should be free'd */
 	} else {
 		m->p = ( byte* )data;	/* use the pointer directly */
 		m->flags = 0;			/* DON'T free it */
+		m->size = 0;
 	}
 	m->end = m->p + n;
 	m->max = n;
 	return m;
 }
 
+MSGPACKF msgpack_u* msgpack_unpack_adopt( msgpack_buffer *b )
+{
+	msgpack_u *m;
+	if ( !b || ( !b->data && b->n )) return NULL;
+	if ( !b->data ) return msgpack_unpack_init_alloc( NULL, 0, 1, b->alloc );
+	if ( !( m = ( msgpack_u* )msgpack_malloc( b->alloc, sizeof( msgpack_u )))) return NULL;
+	m->p = b->data;
+	m->end = m->p + b->n;
+	m->max = b->n;
+	m->size = b->size;
+	m->flags = MSGPACK_FLAG_OWNED;		/* the buffer is ours now */
+	m->alloc = b->alloc;
+	b->data = NULL; b->n = b->size = 0;
+	return m;
+}
+
+MSGPACKF msgpack_u* msgpack_unpack_init( const void* data, uint32_t n, const int flags )
+{
+	return msgpack_unpack_init_alloc( data, n, flags, NULL );
+}
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_init_fixed( msgpack_u *m, const void* data, uint32_t n )
+{
+	if ( !m || ( !data && n )) return MSGPACK_ARGERR;
+	m->p = ( const byte* )data;	/* use the pointer directly */
+	m->end = m->p + n;
+	m->max = n;
+	m->flags = MSGPACK_FLAG_STATIC;	/* DON'T free the buffer or the struct */
+	m->alloc = NULL;
+	m->size = 0;
+	return MSGPACK_SUCCESS;
+}
+
 MSGPACKF MSGPACK_ERR msgpack_unpack_free( msgpack_u *m )
 {
 	if ( m )
 	{
+		const byte flags = m->flags;
+		const msgpack_alloc *a = m->alloc;
 		/* is there an associated buffer, and do we need to free it? */
-		if ( m->p && ( m->flags & 1 )) free(( void* )( m->end - m->max ));
+		if ( m->p && ( flags & MSGPACK_FLAG_OWNED )) msgpack_free( a, ( void* )( m->end - m->max ), m->size );
 		memset( m, 0, sizeof( msgpack_u ));	// for sanity
-		/* free the struct itself */
-		free( m );
+		/* free the struct itself, unless it belongs to the caller */
+		if ( !( flags & MSGPACK_FLAG_STATIC )) msgpack_free( a, m, sizeof( msgpack_u ));
 	}
 	return MSGPACK_SUCCESS;
 }
 
+MSGPACKF int msgpack_unpack_skip_depth( msgpack_u *m, uint32_t max_depth )
+{
+	const byte *p;
+	int ret;
+	if ( !m || !m->p || ( m->p >= m->end )) return MSGPACK_MEMERR;
+	p = m->p;		/* only advanced once the whole object is present */
+	if (( ret = msgpack_walk( &p, m->end, max_depth, 1, NULL )) < 0 ) return ret;
+	ret = p - m->p;
+	m->p = p;
+	return ret;
+}
 MSGPACKF int msgpack_unpack_skip( msgpack_u *m )
 {
-	uint32_t i, n, r;
-	int code = msgpack_unpack_peek( m );
-	const byte *ptr = m->p;
-	if ( code < 0 ) return code;
-	switch ( code ) {
-		case MSGPACK_FIX:
-		case MSGPACK_NULL:
-		case MSGPACK_FALSE:
-		case MSGPACK_TRUE:
-			++m->p;
-			break;
-		case MSGPACK_UINT8:
-		case MSGPACK_INT8:
-			m->p += 2;
-			break;
-		case MSGPACK_UINT16:
-		case MSGPACK_INT16:
-			m->p += 3;
-			break;
-		case MSGPACK_FLOAT:
-		case MSGPACK_UINT32:
-		case MSGPACK_INT32:
-			m->p += 5;
-			break;
-		case MSGPACK_DOUBLE:
-		case MSGPACK_UINT64:
-		case MSGPACK_INT64:
-			m->p += 9;
-			break;
-		case MSGPACK_RAW:
-			r = msgpack_unpack_raw( m, NULL, &n );
-			if ( r < 0 ) return -1;
-			break;
-		case MSGPACK_ARRAY:
-			r = msgpack_unpack_array( m, &n );
-			if ( r < 0 ) return -1;
-			for ( i = n; i > 0; --i )
+	return msgpack_unpack_skip_depth( m, MSGPACK_MAX_DEPTH );
+}
+
+MSGPACKF int msgpack_unpack_complete( const msgpack_u *m )
+{
+	msgpack_u tmp;
+	if ( !m || !m->p ) return MSGPACK_ARGERR;
+	if ( m->p >= m->end ) return MSGPACK_NEEDMORE;
+	tmp = *m;		/* skip on a copy, leaving the caller's unpacker where it is */
+	return msgpack_unpack_skip( &tmp );
+}
+
+/* make room for "n" more bytes at the end of the buffer */
+static MSGPACK_ERR msgpack_unpack_room( msgpack_u *m, const uint32_t n )
+{
+	byte *buffer;
+	uint32_t n0;
+	buffer = ( byte* )( m->end - m->max );	/* start of the current buffer */
+	n0 = m->end - m->p;						/* bytes still to be unpacked */
+	if ( m->flags & MSGPACK_FLAG_OWNED )
+	{
+		if ( n > m->size - m->max )			/* no room at the end of our buffer */
+		{
+			if ( m->p > buffer )				/* drop the bytes already unpacked */
 			{
-				r = msgpack_unpack_skip( m );
-				if ( r < 0 ) return -1;
+				memmove( buffer, m->p, n0 );
+				m->p = buffer;
+				m->end = buffer + n0;
+				m->max = n0;
 			}
-			break;
-		case MSGPACK_MAP:
-			r = msgpack_unpack_map( m, &n );
-			if ( r < 0 ) return -1;
-			for ( i = 2*n; i > 0; --i )
+			if ( n0 + n > m->size )			/* still not enough, so grow geometrically */
 			{
-				r = msgpack_unpack_skip( m );
-				if ( r < 0 ) return -1;
+				uint32_t size = 2*m->size;
+				if ( size < n0 + n ) size = n0 + n;
+				buffer = ( byte* )msgpack_realloc( m->alloc, buffer, m->size, size );
+				if ( !buffer ) return MSGPACK_MEMERR;
+				m->size = size;
+				m->p = buffer;
+				m->end = buffer + n0;
 			}
-			break;
-		default:
-			return MSGPACK_TYPEERR;
+		}
+	} else {
+		/* first append to a caller's buffer: take a copy of the remaining bytes */
+		uint32_t size = n0 + n < 64 ? 64 : n0 + n;
+		buffer = ( byte* )msgpack_malloc( m->alloc, size );
+		if ( !buffer ) return MSGPACK_MEMERR;
+		if ( n0 ) memcpy( buffer, m->p, n0 );
+		m->p = buffer;
+		m->end = buffer + n0;
+		m->max = n0;
+		m->size = size;
+		m->flags |= MSGPACK_FLAG_OWNED;		/* indicate the buffer needs to be free'd */
 	}
-	return m->p - ptr;
+	return MSGPACK_SUCCESS;
 }
 
 MSGPACKF MSGPACK_ERR msgpack_unpack_append( msgpack_u *m, const void* data, const uint32_t n )
 {
-	byte *buffer;
-	uint32_t n0;
+	MSGPACK_ERR ret;
 	if ( !m || !data || !n ) return MSGPACK_ARGERR;
-	if ( m->p + n < m->end ) return MSGPACK_SUCCESS; /* don't need to do anything */
-	/* allocate a new buffer to contain appended message */
-	n0 = m->end - m->p;
-	/* create new buffer */
-	buffer = ( byte* )malloc( n0 + n );
-	if ( !buffer ) return MSGPACK_MEMERR;
-	/* copy the old buffer into the new one */
-	if ( n0 ) memcpy( buffer, m->p, n0 );
-	/* deallocate the old buffer if necesary */
-	if ( m->flags & 1 ) free(( void* )( m->end - m->max ));
-	/* copy the new segment into the new buffer */
-	memcpy( buffer + n0, data, n );
-	/* update the pointers */
-	m->p = buffer;
-	m->max = n0 + n;
-	m->end = buffer + m->max;
-	/* indicate the buffer needs to be free'd */
-	m->flags |= 1;
+	if (( ret = msgpack_unpack_room( m, n ))) return ret;
+	/* copy the new segment onto the end */
+	memcpy(( byte* )m->end, data, n );
+	m->end += n;
+	m->max += n;
 	return MSGPACK_SUCCESS;
 }
 
 MSGPACKF int msgpack_unpack_peek_code( byte b )
 {
-	/* check the FIXNUM codes */
-	if (( b >> 7 == 0 )||( b >> 5 == 7 )) return MSGPACK_FIX;
-	if (( b >> 5 == 5 )||( b == MSGPACK_RAW )||( b == MSGPACK_RAW+1 )) return MSGPACK_RAW;
-	if (( b >> 4 == 8 )||( b == MSGPACK_MAP )||( b == MSGPACK_MAP+1 )) return MSGPACK_MAP;
-	if (( b >> 4 == 9 )||( b == MSGPACK_ARRAY )||( b == MSGPACK_ARRAY+1 )) return MSGPACK_ARRAY;
-	if (( b == MSGPACK_FALSE ) || ( b == MSGPACK_TRUE )) return MSGPACK_BOOL;
-	/* must be one of the enumeration */
-	return b;
+	/* reserved codes map to themselves */
+	return msgpack_lead_table[b].code;
 }
 
 MSGPACKF int msgpack_unpack_peek( const msgpack_u *m )
@@ -382,6 +1166,7 @@ MSGPACKF int msgpack_unpack_peek( const msgpack_u *m )
 }
 
 #define UNPACK_CHK(m) if (( !m ) || ( m->p >= m->end )) return MSGPACK_MEMERR;
+#define UNPACK_NEED(m,n) if (( uint32_t )( m->end - m->p ) < ( n )) return MSGPACK_NEEDMORE;	/* whole object present? */
 
 MSGPACKF uint32_t msgpack_unpack_getpos( msgpack_u *m )
 {
@@ -432,16 +1217,30 @@ int8_t   msgpack_get_FIX( msgpack_u *m ) 		{ return ( *m->p > 128 ) ? *( int8_t*
 #define FIX_INT 1
 #define FIX_UINT 0
 
+/* the S##8 ... S##64 codes are consecutive, so the code offset gives log2 of the width */
+#define INT_READ( T, S, l ) \
+	if ( l->code == MSGPACK_FIX ) { \
+		if ( !FIX_##S && *m->p >> 7 ) return MSGPACK_TYPEERR; \
+		*x = msgpack_get_FIX( m ); return MSGPACK_SUCCESS; \
+	} \
+	if (( l->code < MSGPACK_##S##8 ) || ( l->code > MSGPACK_##S##64 ) || \
+		(( 1u << ( l->code - MSGPACK_##S##8 )) > sizeof( T##_t ))) return MSGPACK_TYPEERR;
+#define INT_GET( T, S, l ) \
+	switch ( l->size ) { \
+		case 2:     *x = ( T##_t )msgpack_get_##S##8( m ); break; \
+		case 3:     *x = ( T##_t )msgpack_get_##S##16( m ); break; \
+		case 5:     *x = ( T##_t )msgpack_get_##S##32( m ); break; \
+		default:    *x = ( T##_t )msgpack_get_##S##64( m ); break; \
+	} \
+	return MSGPACK_SUCCESS;
 #define DEFINE_INT_UNPACK( T, S ) \
 	MSGPACKF MSGPACK_ERR msgpack_unpack_##T( msgpack_u *m, T##_t *x ) { \
-		const int t = msgpack_unpack_peek( m ); \
-		if      (( t == MSGPACK_##S##64 ) && ( sizeof( T##_t ) >= 8 )) *x = ( T##_t )msgpack_get_##S##64( m ); \
-		else if (( t == MSGPACK_##S##32 ) && ( sizeof( T##_t ) >= 4 )) *x = ( T##_t )msgpack_get_##S##32( m ); \
-		else if (( t == MSGPACK_##S##16 ) && ( sizeof( T##_t ) >= 2 )) *x = ( T##_t )msgpack_get_##S##16( m ); \
-		else if ( t == MSGPACK_##S##8 ) *x = msgpack_get_##S##8( m ); \
-		else if (( t == MSGPACK_FIX ) && ( FIX_##S || *m->p >> 7 == 0 ))  *x = msgpack_get_FIX( m );\
-		else return MSGPACK_TYPEERR; \
-		return MSGPACK_SUCCESS; \
+		const msgpack_lead_t *l; \
+		UNPACK_CHK( m ); \
+		l = msgpack_lead_table + *m->p; \
+		INT_READ( T, S, l ) \
+		UNPACK_NEED( m, l->size ); \
+		INT_GET( T, S, l ) \
 	}
 DEFINE_INT_UNPACK( int64, INT )
 DEFINE_INT_UNPACK( int32, INT )
@@ -466,6 +1265,7 @@ MSGPACKF MSGPACK_ERR msgpack_unpack_float( msgpack_u *m, float *x )
 {
 	UNPACK_CHK( m );
 	if ( *m->p != MSGPACK_FLOAT )  return MSGPACK_TYPEERR;
+	UNPACK_NEED( m, 5 );
 	*( uint32_t* )x = BYTESWAP32( *( uint32_t* )++m->p ); m->p += sizeof( float );
 	return MSGPACK_SUCCESS;
 }
@@ -473,42 +1273,76 @@ MSGPACKF MSGPACK_ERR msgpack_unpack_double( msgpack_u *m, double *x )
 {
 	UNPACK_CHK( m );
 	if ( *m->p == MSGPACK_DOUBLE ) {
+		UNPACK_NEED( m, 9 );
 		*( uint64_t* )x = BYTESWAP64( *( uint64_t* )++m->p );
 		m->p += sizeof( double );
 		return MSGPACK_SUCCESS;
 	} else if ( *m->p == MSGPACK_FLOAT ) {
-		float y; msgpack_unpack_float( m, &y ); *x = y;
+		float y; MSGPACK_ERR ret = msgpack_unpack_float( m, &y );
+		if ( ret ) return ret;
+		*x = y;
 		return MSGPACK_SUCCESS;
 	}
 	return MSGPACK_TYPEERR;
 }
 
-INLINE MSGPACK_ERR msgpack_unpack_arr_head( msgpack_u *m, byte c1, byte nb, byte c2, uint32_t *n )
+static INLINE MSGPACK_ERR msgpack_unpack_arr_head( msgpack_u *m, byte code, uint32_t *n )
 {
-	byte b;
+	const msgpack_lead_t *l;
 	UNPACK_CHK( m );
-	b = *m->p; ++m->p; *n = 0;
-	if (( b>>nb )==( c1>>nb ))  { *n = b & ~c1; }
-	else if ( b == c2 )         { msgpack_copy_bits( m->p, n, 2 ); m->p += 2; }
-	else if ( b == c2+1 )       { msgpack_copy_bits( m->p, n, 4 ); m->p += 4; }
-	else                        { --m->p; return MSGPACK_TYPEERR; }
+	l = msgpack_lead_table + *m->p;
+	if ( l->code != code ) return MSGPACK_TYPEERR;
+	UNPACK_NEED( m, l->size );
+	*n = msgpack_lead_len( m->p, l );
+	m->p += l->size;
 	return MSGPACK_SUCCESS;
 }
 MSGPACKF MSGPACK_ERR msgpack_unpack_raw( msgpack_u* m, const byte **data, uint32_t *nout )
 {
 	uint32_t n;
+	const byte *ptr;
+	MSGPACK_ERR ret;
 	UNPACK_CHK( m );
-	if ( msgpack_unpack_arr_head( m, 0xa0, 5, MSGPACK_RAW, &n )) return MSGPACK_TYPEERR;
+	ptr = m->p;
+	/* str and bin are both raw bytes here; legacy peers only ever sent the one kind */
+	if (( ret = msgpack_unpack_arr_head( m, msgpack_lead_table[*ptr].code == MSGPACK_BIN ? MSGPACK_BIN : MSGPACK_RAW, &n ))) return ret;
+	if (( uint32_t )( m->end - m->p ) < n ) { m->p = ptr; return MSGPACK_NEEDMORE; }	/* payload truncated */
 	if ( data ) *data = m->p;
 	if ( nout ) *nout = n;
 	m->p += n;
 	return MSGPACK_SUCCESS;
 }
+MSGPACKF MSGPACK_ERR msgpack_unpack_bin( msgpack_u* m, const byte **data, uint32_t *n )
+{
+	UNPACK_CHK( m );
+	if ( msgpack_lead_table[*m->p].code != MSGPACK_BIN ) return MSGPACK_TYPEERR;
+	return msgpack_unpack_raw( m, data, n );
+}
+/* ext8/16/32 carry a length then the type; fixext is the type alone, its length implied by the code */
+#define EXT_HEAD( l )	(( l )->width ? ( l )->size : 2u )
+#define EXT_LEN( p, l )	(( l )->width ? msgpack_lead_len( p, l ) : ( l )->size - 2u )
+MSGPACKF MSGPACK_ERR msgpack_unpack_ext( msgpack_u* m, int8_t *type, const byte **data, uint32_t *n )
+{
+	const msgpack_lead_t *l;
+	uint32_t h, k;
+	UNPACK_CHK( m );
+	l = msgpack_lead_table + *m->p;
+	if ( l->code != MSGPACK_EXT ) return MSGPACK_TYPEERR;
+	UNPACK_NEED( m, l->size );
+	h = EXT_HEAD( l ); k = EXT_LEN( m->p, l );
+	if (( uint32_t )( m->end - m->p ) - h < k ) return MSGPACK_NEEDMORE;
+	if ( type ) *type = ( int8_t )m->p[h-1];
+	if ( data ) *data = m->p + h;
+	if ( n ) *n = k;
+	m->p += h + k;
+	return MSGPACK_SUCCESS;
+}
 MSGPACKF MSGPACK_ERR msgpack_unpack_str( msgpack_u* m, char *dest, uint32_t max )
 {
 	const byte *ptr; uint32_t n;
+	MSGPACK_ERR ret;
 	UNPACK_CHK( m );
-	if ( msgpack_unpack_raw( m, &ptr, &n )) return MSGPACK_TYPEERR;
+	if (( ret = msgpack_unpack_raw( m, &ptr, &n ))) return ret;
 	if ( n >= max ) return MSGPACK_MEMERR;
 	memcpy( dest, ptr, n );
 	dest[n] = 0;
@@ -517,13 +1351,1303 @@ MSGPACKF MSGPACK_ERR msgpack_unpack_str( msgpack_u* m, char *dest, uint32_t max
 MSGPACKF MSGPACK_ERR msgpack_unpack_array( msgpack_u* m, uint32_t *n )
 {
 	UNPACK_CHK( m );
-	return msgpack_unpack_arr_head( m, 0x90, 4, MSGPACK_ARRAY, n );
+	return msgpack_unpack_arr_head( m, MSGPACK_ARRAY, n );
 }
 MSGPACKF MSGPACK_ERR msgpack_unpack_map( msgpack_u* m, uint32_t *n )
 {
 	UNPACK_CHK( m );
-	return msgpack_unpack_arr_head( m, 0x80, 4, MSGPACK_MAP, n );
+	return msgpack_unpack_arr_head( m, MSGPACK_MAP, n );
+}
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_any( msgpack_u* m, msgpack_value *v )
+{
+	const msgpack_lead_t *l;
+	const byte *p;
+	uint32_t h, k = 0;	/* header and payload length */
+	int64_t i;
+	UNPACK_CHK( m );
+	if ( !v ) return MSGPACK_ARGERR;
+	p = m->p;
+	l = msgpack_lead_table + *p;
+	if ( !l->size ) return MSGPACK_TYPEERR;		/* reserved */
+	UNPACK_NEED( m, l->size );
+	v->type = ( MSGPACK_TYPE_CODES )l->code;
+	/* each case advances by a constant where it can, rather than by l->size, so the position of the
+	next object does not wait on the table lookup. integers are typed by sign, not width */
+	switch ( l->code ) {
+		case MSGPACK_FIX:		i = ( int8_t )*p; h = 1; goto sign;
+		case MSGPACK_INT8:		i = ( int8_t )p[1]; h = 2; goto sign;
+		case MSGPACK_INT16:		i = ( int16_t )BYTESWAP16( *( uint16_t* )( p + 1 )); h = 3; goto sign;
+		case MSGPACK_INT32:		i = ( int32_t )BYTESWAP32( *( uint32_t* )( p + 1 )); h = 5; goto sign;
+		case MSGPACK_INT64:		i = ( int64_t )BYTESWAP64( *( uint64_t* )( p + 1 )); h = 9; goto sign;
+		case MSGPACK_UINT8:		v->v.u = p[1]; h = 2; v->type = MSGPACK_UINT64; break;
+		case MSGPACK_UINT16:	v->v.u = BYTESWAP16( *( uint16_t* )( p + 1 )); h = 3; v->type = MSGPACK_UINT64; break;
+		case MSGPACK_UINT32:	v->v.u = BYTESWAP32( *( uint32_t* )( p + 1 )); h = 5; v->type = MSGPACK_UINT64; break;
+		case MSGPACK_UINT64:	v->v.u = BYTESWAP64( *( uint64_t* )( p + 1 )); h = 9; break;
+		case MSGPACK_FLOAT:		{ union { uint32_t u; float f; } x; x.u = BYTESWAP32( *( uint32_t* )( p + 1 )); v->v.d = x.f; h = 5; break; }
+		case MSGPACK_DOUBLE:	v->v.u = BYTESWAP64( *( uint64_t* )( p + 1 )); h = 9; break;
+		case MSGPACK_BOOL:		v->v.u = 0; v->v.b = *p == MSGPACK_TRUE; h = 1; break;
+		case MSGPACK_RAW:
+		case MSGPACK_BIN:
+		case MSGPACK_ARRAY:
+		case MSGPACK_MAP:
+			switch ( l->width ) {
+				case 0:		h = 1; k = *p & l->mask; break;
+				case 1:		h = 2; k = p[1]; break;
+				case 2:		h = 3; k = BYTESWAP16( *( uint16_t* )( p + 1 )); break;
+				default:	h = 5; k = BYTESWAP32( *( uint32_t* )( p + 1 )); break;
+			}
+			if (( l->code == MSGPACK_ARRAY ) || ( l->code == MSGPACK_MAP )) {
+				v->v.u = 0; v->n = k;		/* elements follow */
+				m->p = p + h;
+				return MSGPACK_SUCCESS;
+			}
+			goto payload;
+		case MSGPACK_EXT:		h = EXT_HEAD( l ); k = EXT_LEN( p, l ); v->ext = ( int8_t )p[h-1]; goto payload;
+		default:				v->v.u = 0; h = 1; break;		/* nil */
+	}
+	v->n = 0;
+	m->p = p + h;
+	return MSGPACK_SUCCESS;
+sign:
+	v->v.i = i;
+	v->type = i < 0 ? MSGPACK_INT64 : MSGPACK_UINT64;
+	v->n = 0;
+	m->p = p + h;
+	return MSGPACK_SUCCESS;
+payload:
+	if (( uint32_t )( m->end - p ) - h < k ) return MSGPACK_NEEDMORE;
+	v->v.p = p + h;
+	v->n = k;
+	m->p = p + h + k;
+	return MSGPACK_SUCCESS;
+}
+
+/* **************************************** VALIDATION **************************************** */
+MSGPACKF int msgpack_validate( const void *data, uint32_t n, uint32_t max_depth )
+{
+	const byte *p = ( const byte* )data;
+	if ( !data && n ) return MSGPACK_ARGERR;
+	return msgpack_walk( &p, p + n, max_depth, INT_MAX, NULL );
+}
+
+#define DEFINE_INT_UNCHECKED( T, S ) \
+	MSGPACKF MSGPACK_ERR msgpack_unchecked_##T( msgpack_u *m, T##_t *x ) { \
+		const msgpack_lead_t *l = msgpack_lead_table + *m->p; \
+		INT_READ( T, S, l ) \
+		INT_GET( T, S, l ) \
+	}
+#define FIX_INT 1
+#define FIX_UINT 0
+DEFINE_INT_UNCHECKED( int64, INT )
+DEFINE_INT_UNCHECKED( int32, INT )
+DEFINE_INT_UNCHECKED( int16, INT )
+DEFINE_INT_UNCHECKED( int8, INT )
+DEFINE_INT_UNCHECKED( uint64, UINT )
+DEFINE_INT_UNCHECKED( uint32, UINT )
+DEFINE_INT_UNCHECKED( uint16, UINT )
+DEFINE_INT_UNCHECKED( uint8, UINT )
+#undef FIX_UINT
+#undef FIX_INT
+#undef DEFINE_INT_UNCHECKED
+#undef INT_GET
+#undef INT_READ
+
+MSGPACKF MSGPACK_ERR msgpack_unchecked_float( msgpack_u *m, float *x )
+{
+	if ( *m->p != MSGPACK_FLOAT ) return MSGPACK_TYPEERR;
+	*( uint32_t* )x = msgpack_get_UINT32( m );
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_unchecked_double( msgpack_u *m, double *x )
+{
+	if ( *m->p == MSGPACK_DOUBLE ) { *( uint64_t* )x = msgpack_get_UINT64( m ); return MSGPACK_SUCCESS; }
+	if ( *m->p == MSGPACK_FLOAT ) { float y; msgpack_unchecked_float( m, &y ); *x = y; return MSGPACK_SUCCESS; }
+	return MSGPACK_TYPEERR;
+}
+MSGPACKF int msgpack_unchecked_bool( msgpack_u *m )
+{
+	switch ( *m->p ) {
+		case MSGPACK_TRUE:  ++m->p; return 1;
+		case MSGPACK_FALSE: ++m->p; return 0;
+		default:            return MSGPACK_TYPEERR;
+	}
+}
+static INLINE MSGPACK_ERR msgpack_unchecked_head( msgpack_u *m, byte code, uint32_t *n )
+{
+	const msgpack_lead_t *l = msgpack_lead_table + *m->p;
+	if ( l->code != code ) return MSGPACK_TYPEERR;
+	*n = msgpack_lead_len( m->p, l );
+	m->p += l->size;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_unchecked_raw( msgpack_u* m, const byte **data, uint32_t *n )
+{
+	if ( msgpack_unchecked_head( m, msgpack_lead_table[*m->p].code == MSGPACK_BIN ? MSGPACK_BIN : MSGPACK_RAW, n )) return MSGPACK_TYPEERR;
+	if ( data ) *data = m->p;
+	m->p += *n;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_unchecked_ext( msgpack_u* m, int8_t *type, const byte **data, uint32_t *n )
+{
+	const msgpack_lead_t *l = msgpack_lead_table + *m->p;
+	uint32_t h;
+	if ( l->code != MSGPACK_EXT ) return MSGPACK_TYPEERR;
+	h = EXT_HEAD( l ); *n = EXT_LEN( m->p, l );
+	if ( type ) *type = ( int8_t )m->p[h-1];
+	if ( data ) *data = m->p + h;
+	m->p += h + *n;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_unpack_timestamp( msgpack_u* m, int64_t *sec, uint32_t *nsec )
+{
+	const byte *p;
+	uint32_t s32;
+	uint64_t s64;
+	UNPACK_CHK( m );
+	p = m->p;
+	switch ( *p ) {	/* only three encodings are valid, so match them directly */
+		case MSGPACK_FIXEXT+2:
+			if (( m->end - p >= 2 ) && ( p[1] != ( byte )MSGPACK_EXT_TIMESTAMP )) return MSGPACK_TYPEERR;
+			UNPACK_NEED( m, 6 );
+			memcpy( &s32, p + 2, 4 );
+			*sec = BYTESWAP32( s32 ); *nsec = 0;
+			m->p += 6;
+			return MSGPACK_SUCCESS;
+		case MSGPACK_FIXEXT+3:
+			if (( m->end - p >= 2 ) && ( p[1] != ( byte )MSGPACK_EXT_TIMESTAMP )) return MSGPACK_TYPEERR;
+			UNPACK_NEED( m, 10 );
+			memcpy( &s64, p + 2, 8 ); s64 = BYTESWAP64( s64 );
+			if (( s64 >> 34 ) >= 1000000000ul ) return MSGPACK_TYPEERR;
+			*sec = ( int64_t )( s64 & 0x3ffffffffull ); *nsec = ( uint32_t )( s64 >> 34 );
+			m->p += 10;
+			return MSGPACK_SUCCESS;
+		case MSGPACK_EXT:
+			if (( m->end - p >= 3 ) && (( p[1] != 12 ) || ( p[2] != ( byte )MSGPACK_EXT_TIMESTAMP ))) return MSGPACK_TYPEERR;
+			UNPACK_NEED( m, 15 );
+			memcpy( &s32, p + 3, 4 ); s32 = BYTESWAP32( s32 );
+			if ( s32 >= 1000000000ul ) return MSGPACK_TYPEERR;
+			memcpy( &s64, p + 7, 8 );
+			*sec = ( int64_t )BYTESWAP64( s64 ); *nsec = s32;
+			m->p += 15;
+			return MSGPACK_SUCCESS;
+		default:
+			return MSGPACK_TYPEERR;
+	}
+}
+#undef EXT_LEN
+#undef EXT_HEAD
+MSGPACKF MSGPACK_ERR msgpack_unchecked_array( msgpack_u* m, uint32_t *n )
+{
+	return msgpack_unchecked_head( m, MSGPACK_ARRAY, n );
+}
+MSGPACKF MSGPACK_ERR msgpack_unchecked_map( msgpack_u* m, uint32_t *n )
+{
+	return msgpack_unchecked_head( m, MSGPACK_MAP, n );
+}
+
+/* **************************************** TAPE **************************************** */
+MSGPACKF MSGPACK_ERR msgpack_tape_parse( msgpack_tape *t, msgpack_u *m, uint32_t max_depth, const msgpack_alloc *a )
+{
+	uint32_t open[MSGPACK_MAX_DEPTH], left[MSGPACK_MAX_DEPTH];	/* entry and pending elements of each open container */
+	uint32_t depth = 0, nval = 0, i, len;
+	const byte *p;
+	const msgpack_lead_t *l;
+	msgpack_tape_entry *e;
+	int ret;
+	if ( !t ) return MSGPACK_ARGERR;
+	t->e = NULL; t->n = t->size = 0; t->data = NULL; t->alloc = a;
+	if ( !m || !m->p || ( m->p >= m->end )) return MSGPACK_MEMERR;
+	/* first pass checks the object and counts its values, so the tape is allocated once */
+	p = m->p;
+	if (( ret = msgpack_walk( &p, m->end, max_depth, 1, &nval )) < 0 ) return ( MSGPACK_ERR )ret;
+	if ( !( e = ( msgpack_tape_entry* )msgpack_malloc( a, nval * sizeof( msgpack_tape_entry )))) return MSGPACK_MEMERR;
+	t->e = e; t->n = nval; t->data = m->p; t->size = p - m->p;
+	/* second pass fills it in; every bound has already been checked */
+	p = m->p;
+	for ( i = 0; i < nval; ++i )
+	{
+		l = msgpack_lead_table + *p;
+		len = msgpack_lead_len( p, l );
+		e[i].type = l->code; e[i].head = l->size; e[i].len = len;
+		e[i].offset = p - t->data; e[i].next = i + 1;
+		if (( l->code == MSGPACK_EXT ) && !l->width ) { e[i].head = 2; e[i].len = l->size - 2; }	/* fixext */
+		if (( l->code == MSGPACK_ARRAY ) || ( l->code == MSGPACK_MAP ))
+		{
+			p += l->size;
+			if ( len ) { open[depth] = i; left[depth++] = ( l->code == MSGPACK_MAP ) ? 2*len : len; continue; }
+		}
+		else p += e[i].head + e[i].len;
+		while ( depth && !--left[depth-1] ) e[open[--depth]].next = i + 1;	/* close what this completes */
+	}
+	m->p += t->size;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF void msgpack_tape_free( msgpack_tape *t )
+{
+	if ( !t ) return;
+	if ( t->e ) msgpack_free( t->alloc, t->e, t->n * sizeof( msgpack_tape_entry ));
+	t->e = NULL; t->n = 0;
+}
+MSGPACKF MSGPACK_ERR msgpack_tape_unpacker( const msgpack_tape *t, uint32_t i, msgpack_u *u )
+{
+	if ( !t || ( i >= t->n )) return MSGPACK_ARGERR;
+	return msgpack_unpack_init_fixed( u, t->data + t->e[i].offset, t->size - t->e[i].offset );
+}
+MSGPACKF MSGPACK_ERR msgpack_tape_raw( const msgpack_tape *t, uint32_t i, const byte **data, uint32_t *n )
+{
+	const msgpack_tape_entry *e;
+	if ( !t || ( i >= t->n )) return MSGPACK_ARGERR;
+	e = t->e + i;
+	if (( e->type != MSGPACK_RAW ) && ( e->type != MSGPACK_BIN ) && ( e->type != MSGPACK_EXT )) return MSGPACK_TYPEERR;
+	if ( data ) *data = t->data + e->offset + e->head;
+	if ( n ) *n = e->len;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF uint32_t msgpack_tape_find( const msgpack_tape *t, uint32_t i, const void *key, uint32_t n )
+{
+	uint32_t j, k;
+	const msgpack_tape_entry *e;
+	if ( !t || ( i >= t->n ) || ( t->e[i].type != MSGPACK_MAP )) return 0;
+	for ( j = t->e[i].len, k = i + 1; j > 0; --j, k = t->e[e->next].next )
+	{
+		e = t->e + k;		/* the key; its value is the entry after it */
+		if (( e->type == MSGPACK_RAW ) && ( e->len == n ) && ( memcmp( t->data + e->offset + e->head, key, n ) == 0 ))
+			return e->next;
+	}
+	return 0;
+}
+
+
+/* **************************************** BULK ARRAYS **************************************** */
+#define BULK_BLOCK 256		/* elements converted per pass, bounding the stack buffers below */
+
+/* byteswap "n" contiguous words from "src" to "dest" (which may be the same) */
+static INLINE void msgpack_bswap32_block( uint32_t *dest, const uint32_t *src, uint32_t n )
+{
+	uint32_t i = 0;
+#ifdef MSGPACK_SIMD
+	const __m128i s4 = _mm_set_epi8( 12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3 );
+	#ifdef __AVX2__
+	const __m256i s8 = _mm256_broadcastsi128_si256( s4 );
+	for ( ; i + 8 <= n; i += 8 )
+		_mm256_storeu_si256(( __m256i* )( dest + i ), _mm256_shuffle_epi8( _mm256_loadu_si256(( const __m256i* )( src + i )), s8 ));
+	#endif
+	for ( ; i + 4 <= n; i += 4 )
+		_mm_storeu_si128(( __m128i* )( dest + i ), _mm_shuffle_epi8( _mm_loadu_si128(( const __m128i* )( src + i )), s4 ));
+#endif
+	for ( ; i < n; ++i ) dest[i] = BYTESWAP32( src[i] );
+}
+static INLINE void msgpack_bswap64_block( uint64_t *dest, const uint64_t *src, uint32_t n )
+{
+	uint32_t i = 0;
+#ifdef MSGPACK_SIMD
+	const __m128i s2 = _mm_set_epi8( 8,9,10,11,12,13,14,15, 0,1,2,3,4,5,6,7 );
+	#ifdef __AVX2__
+	const __m256i s4 = _mm256_broadcastsi128_si256( s2 );
+	for ( ; i + 4 <= n; i += 4 )
+		_mm256_storeu_si256(( __m256i* )( dest + i ), _mm256_shuffle_epi8( _mm256_loadu_si256(( const __m256i* )( src + i )), s4 ));
+	#endif
+	for ( ; i + 2 <= n; i += 2 )
+		_mm_storeu_si128(( __m128i* )( dest + i ), _mm_shuffle_epi8( _mm_loadu_si128(( const __m128i* )( src + i )), s2 ));
+#endif
+	for ( ; i < n; ++i ) dest[i] = BYTESWAP64( src[i] );
+}
+
+/* make room for "bytes" of output. a streaming packer on a small fixed buffer cannot take a whole block,
+so "k" elements are halved (and "bytes" recounted from the sizes in "s" if given) until it fits */
+static MSGPACK_ERR msgpack_bulk_expand( msgpack_p *m, uint32_t *k, uint32_t *bytes, const byte *s, uint32_t w )
+{
+	MSGPACK_ERR ret;
+	uint32_t j;
+	while ((( ret = msgpack_expand( m, *bytes )) == MSGPACK_OVERFLOW ) && m->sink && ( *k > 1 ))
+	{
+		*k /= 2;
+		if ( s ) for ( *bytes = 0, j = 0; j < *k; ++j ) *bytes += s[j];
+		else *bytes = *k * w;
+	}
+	return ret;
+}
+
+/* encoded size of an integer, following the same choices as msgpack_pack_int64/uint64 and capped at the
+width of its own type. free of branches so that compilers vectorise the classification pass */
+#define BULK_INT_SIZE( x )	( 1 + !(( x ) > -32 && ( x ) < 128 ) + !(( x ) > -128 && ( x ) < 128 ) \
+							+ 2*!(( x ) > -32768 && ( x ) < 32768 ) + 4*!(( x ) > -2147483648LL && ( x ) < 2147483648LL ))
+#define BULK_UINT_SIZE( x )	( 1 + (( x ) >= 128 ) + (( x ) >= 256 ) + 2*(( x ) >= 65536 ) + 4*(( x ) >= 4294967296ULL ))
+#define BULK_INT_WIDE		int64_t
+#define BULK_UINT_WIDE		uint64_t
+
+/* the elements alone are written by msgpack_pack_T_items, which record batches also call */
+#define DEFINE_INT_ARRAY_PACK( T, S ) \
+	static MSGPACK_ERR msgpack_pack_##T##_items( msgpack_p *m, const T##_t *x, uint32_t n ) { \
+		byte s[BULK_BLOCK]; \
+		uint32_t i, j, k, bytes; \
+		uint16_t v16; uint32_t v32; uint64_t v64; \
+		MSGPACK_ERR ret; \
+		for ( i = 0; i < n; i += k ) { \
+			k = ( n - i < BULK_BLOCK ) ? n - i : BULK_BLOCK; \
+			for ( bytes = 0, j = 0; j < k; ++j ) {	/* classify the block */ \
+				const BULK_##S##_WIDE y = x[i+j]; \
+				const byte c = ( byte )BULK_##S##_SIZE( y ); \
+				s[j] = ( c < sizeof( T##_t ) + 1 ) ? c : sizeof( T##_t ) + 1; \
+				bytes += s[j]; \
+			} \
+			if (( ret = msgpack_bulk_expand( m, &k, &bytes, s, 0 ))) return ret; \
+			for ( j = 0; j < k; ++j ) {				/* then write it */ \
+				const BULK_##S##_WIDE y = x[i+j]; \
+				byte *p = m->p; \
+				switch ( s[j] ) { \
+					case 1: *p = ( byte )y; break; \
+					case 2: p[0] = MSGPACK_##S##8; p[1] = ( byte )y; break; \
+					case 3: p[0] = MSGPACK_##S##16; v16 = BYTESWAP16(( uint16_t )y ); memcpy( p + 1, &v16, 2 ); break; \
+					case 5: p[0] = MSGPACK_##S##32; v32 = BYTESWAP32(( uint32_t )y ); memcpy( p + 1, &v32, 4 ); break; \
+					default: p[0] = MSGPACK_##S##64; v64 = BYTESWAP64(( uint64_t )y ); memcpy( p + 1, &v64, 8 ); break; \
+				} \
+				m->p += s[j]; \
+			} \
+		} \
+		return MSGPACK_SUCCESS; \
+	} \
+	MSGPACKF MSGPACK_ERR msgpack_pack_##T##_array( msgpack_p *m, const T##_t *x, uint32_t n ) { \
+		msgpack_mark c; \
+		MSGPACK_ERR ret; \
+		if ( !x && n ) return MSGPACK_ARGERR; \
+		if (( ret = msgpack_pack_checkpoint( m, &c ))) return ret; \
+		if (( ret = msgpack_pack_array( m, n )) || ( ret = msgpack_pack_##T##_items( m, x, n ))) \
+			msgpack_pack_rollback( m, &c );	/* no partial array is left behind */ \
+		return ret; \
+	}
+DEFINE_INT_ARRAY_PACK( int8, INT )
+DEFINE_INT_ARRAY_PACK( int16, INT )
+DEFINE_INT_ARRAY_PACK( int32, INT )
+DEFINE_INT_ARRAY_PACK( int64, INT )
+DEFINE_INT_ARRAY_PACK( uint8, UINT )
+DEFINE_INT_ARRAY_PACK( uint16, UINT )
+DEFINE_INT_ARRAY_PACK( uint32, UINT )
+DEFINE_INT_ARRAY_PACK( uint64, UINT )
+#undef DEFINE_INT_ARRAY_PACK
+#undef BULK_UINT_WIDE
+#undef BULK_INT_WIDE
+#undef BULK_UINT_SIZE
+#undef BULK_INT_SIZE
+
+/* floating point values all take the same space, so the whole array is sized at once (unless streaming)
+and each block is byteswapped together before the type codes are interleaved */
+#define DEFINE_REAL_ARRAY_PACK( T, W, CODE ) \
+	MSGPACKF MSGPACK_ERR msgpack_pack_##T##_array( msgpack_p *m, const T *x, uint32_t n ) { \
+		uint##W##_t tmp[BULK_BLOCK]; \
+		uint32_t i, j, k, bytes; \
+		msgpack_mark c; \
+		MSGPACK_ERR ret; \
+		if ( !x && n ) return MSGPACK_ARGERR; \
+		if ( n > 0xffffffffu / ( W/8 + 1 )) return MSGPACK_MEMERR; \
+		if (( ret = msgpack_pack_checkpoint( m, &c ))) return ret; \
+		if (( ret = msgpack_pack_array( m, n )) || ( !m->sink && ( ret = msgpack_expand( m, n * ( W/8 + 1 ))))) \
+			{ msgpack_pack_rollback( m, &c ); return ret; } \
+		for ( i = 0; i < n; i += k ) { \
+			k = ( n - i < BULK_BLOCK ) ? n - i : BULK_BLOCK; \
+			bytes = k * ( W/8 + 1 ); \
+			if (( ret = msgpack_bulk_expand( m, &k, &bytes, NULL, W/8 + 1 ))) { msgpack_pack_rollback( m, &c ); return ret; } \
+			msgpack_bswap##W##_block( tmp, ( const uint##W##_t* )( x + i ), k ); \
+			for ( j = 0; j < k; ++j, m->p += W/8 + 1 ) { *m->p = CODE; memcpy( m->p + 1, tmp + j, W/8 ); } \
+		} \
+		return MSGPACK_SUCCESS; \
+	}
+DEFINE_REAL_ARRAY_PACK( float, 32, MSGPACK_FLOAT )
+DEFINE_REAL_ARRAY_PACK( double, 64, MSGPACK_DOUBLE )
+#undef DEFINE_REAL_ARRAY_PACK
+
+/* read the array header, leaving the unpacker untouched if the output is too small */
+static MSGPACK_ERR msgpack_bulk_head( msgpack_u *m, uint32_t max, uint32_t *n )
+{
+	uint32_t k;
+	const byte *ptr = m ? m->p : NULL;
+	MSGPACK_ERR ret = msgpack_unpack_array( m, &k );
+	if ( ret ) return ret;
+	if ( n ) *n = k;
+	if ( k > max ) { m->p = ptr; return MSGPACK_MEMERR; }
+	return MSGPACK_SUCCESS;
+}
+
+#define DEFINE_INT_ARRAY_UNPACK( T ) \
+	MSGPACKF MSGPACK_ERR msgpack_unpack_##T##_array( msgpack_u *m, T##_t *x, uint32_t max, uint32_t *n ) { \
+		uint32_t i, k = 0; \
+		const byte *ptr = m ? m->p : NULL; \
+		MSGPACK_ERR ret = msgpack_bulk_head( m, max, &k ); \
+		if ( n ) *n = k; \
+		if ( ret ) return ret; \
+		for ( i = 0; i < k; ++i ) \
+			if (( ret = msgpack_unpack_##T( m, x + i ))) { \
+				m->p = ptr;		/* roll back the whole array */ \
+				return ( ret == MSGPACK_MEMERR ) ? MSGPACK_NEEDMORE : ret; \
+			} \
+		return MSGPACK_SUCCESS; \
+	}
+DEFINE_INT_ARRAY_UNPACK( int8 )
+DEFINE_INT_ARRAY_UNPACK( int16 )
+DEFINE_INT_ARRAY_UNPACK( int32 )
+DEFINE_INT_ARRAY_UNPACK( int64 )
+DEFINE_INT_ARRAY_UNPACK( uint8 )
+DEFINE_INT_ARRAY_UNPACK( uint16 )
+DEFINE_INT_ARRAY_UNPACK( uint32 )
+DEFINE_INT_ARRAY_UNPACK( uint64 )
+#undef DEFINE_INT_ARRAY_UNPACK
+
+/* runs of values with the expected type code are gathered still big-endian and then swapped in place
+together; anything else (e.g. a float in a double array) goes through the scalar function */
+#define DEFINE_REAL_ARRAY_UNPACK( T, W, CODE ) \
+	MSGPACKF MSGPACK_ERR msgpack_unpack_##T##_array( msgpack_u *m, T *x, uint32_t max, uint32_t *n ) { \
+		uint32_t i, j, k = 0; \
+		const byte *ptr = m ? m->p : NULL; \
+		MSGPACK_ERR ret = msgpack_bulk_head( m, max, &k ); \
+		if ( n ) *n = k; \
+		if ( ret ) return ret; \
+		for ( i = 0; i < k; i = j + 1 ) { \
+			for ( j = i; ( j < k ) && (( uint32_t )( m->end - m->p ) >= W/8 + 1 ) && ( *m->p == CODE ); ++j, m->p += W/8 + 1 ) \
+				memcpy( x + j, m->p + 1, W/8 ); \
+			msgpack_bswap##W##_block(( uint##W##_t* )( x + i ), ( const uint##W##_t* )( x + i ), j - i ); \
+			if ( j == k ) break; \
+			if (( ret = msgpack_unpack_##T( m, x + j ))) { \
+				m->p = ptr;		/* roll back the whole array */ \
+				return ( ret == MSGPACK_MEMERR ) ? MSGPACK_NEEDMORE : ret; \
+			} \
+		} \
+		return MSGPACK_SUCCESS; \
+	}
+DEFINE_REAL_ARRAY_UNPACK( float, 32, MSGPACK_FLOAT )
+DEFINE_REAL_ARRAY_UNPACK( double, 64, MSGPACK_DOUBLE )
+#undef DEFINE_REAL_ARRAY_UNPACK
+
+/* **************************************** KEY INTERNING **************************************** */
+#define INTERN_NO_ID	0xffffffffu
+
+static INLINE uint32_t msgpack_hash( const byte *p, uint32_t n )
+{
+	uint32_t h = 2166136261u;		/* FNV-1a */
+	while ( n-- ) h = ( h ^ *p++ )*16777619u;
+	return h;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_intern_init( msgpack_intern *t, uint32_t max, const msgpack_alloc *a )
+{
+	if ( !t ) return MSGPACK_ARGERR;
+	memset( t, 0, sizeof( *t ));
+	t->max = max ? max : MSGPACK_INTERN_MAX;
+	t->alloc = a;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_intern_reset( msgpack_intern *t )
+{
+	uint32_t i;
+	if ( !t ) return MSGPACK_ARGERR;
+	for ( i = 0; i < t->n; ++i ) msgpack_free( t->alloc, t->keys[i].key, t->keys[i].n + 1 );
+	if ( t->slot ) memset( t->slot, 0, ( t->mask + 1 )*sizeof( uint32_t ));
+	t->n = t->ndict = 0;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_intern_free( msgpack_intern *t )
+{
+	if ( !t ) return MSGPACK_ARGERR;
+	msgpack_intern_reset( t );
+	msgpack_free( t->alloc, t->keys, t->size*sizeof( msgpack_intern_key ));
+	msgpack_free( t->alloc, t->slot, t->slot ? ( t->mask + 1 )*sizeof( uint32_t ) : 0 );
+	msgpack_free( t->alloc, t->dict, t->dsize*sizeof( uint32_t ));
+	return msgpack_intern_init( t, t->max, t->alloc );
+}
+
+/* grow "*p" (of "*size" items of "item" bytes) if "used" of them leave no room for one more */
+static MSGPACK_ERR msgpack_grow( const msgpack_alloc *a, void **p, uint32_t *size, uint32_t used, uint32_t item )
+{
+	uint32_t k = *size ? 2*( *size ) : 16;
+	void *q;
+	if ( used < *size ) return MSGPACK_SUCCESS;
+	if ( !( q = msgpack_realloc( a, *p, ( *size )*item, k*item ))) return MSGPACK_MEMERR;
+	*p = q; *size = k;
+	return MSGPACK_SUCCESS;
+}
+
+/* find "key", adding a copy if "add" is set and it is new; NULL if absent or out of memory */
+static msgpack_intern_key* msgpack_intern_lookup( msgpack_intern *t, const byte *key, uint32_t n, int add )
+{
+	const uint32_t h = msgpack_hash( key, n );
+	uint32_t i, k, *s;
+	msgpack_intern_key *e;
+	if ( t->slot ) for ( i = h & t->mask; ( k = t->slot[i] ); i = ( i + 1 ) & t->mask ) {
+		e = t->keys + k - 1;
+		if (( e->hash == h ) && ( e->n == n ) && !memcmp( e->key, key, n )) return e;
+	}
+	if ( !add ) return NULL;
+	if ( !t->slot || ( 2*( t->n + 1 ) > t->mask + 1 )) {		/* keep the slots at most half full */
+		k = t->slot ? 2*( t->mask + 1 ) : 32;
+		if ( !( s = ( uint32_t* )msgpack_malloc( t->alloc, k*sizeof( uint32_t )))) return NULL;
+		memset( s, 0, k*sizeof( uint32_t ));
+		for ( i = 0; i < t->n; ++i ) {
+			uint32_t j = t->keys[i].hash & ( k - 1 );
+			while ( s[j] ) j = ( j + 1 ) & ( k - 1 );
+			s[j] = i + 1;
+		}
+		msgpack_free( t->alloc, t->slot, t->slot ? ( t->mask + 1 )*sizeof( uint32_t ) : 0 );
+		t->slot = s; t->mask = k - 1;
+	}
+	if ( msgpack_grow( t->alloc, ( void** )&t->keys, &t->size, t->n, sizeof( msgpack_intern_key ))) return NULL;
+	e = t->keys + t->n;
+	if ( !( e->key = ( char* )msgpack_malloc( t->alloc, n + 1 ))) return NULL;
+	memcpy( e->key, key, n );
+	e->key[n] = 0;
+	e->n = n; e->hash = h; e->id = INTERN_NO_ID;
+	for ( i = h & t->mask; t->slot[i]; i = ( i + 1 ) & t->mask );
+	t->slot[i] = ++t->n;
+	return e;
+}
+
+/* give "e" the next dictionary id */
+static INLINE MSGPACK_ERR msgpack_intern_define( msgpack_intern *t, msgpack_intern_key *e )
+{
+	if ( msgpack_grow( t->alloc, ( void** )&t->dict, &t->dsize, t->ndict, sizeof( uint32_t ))) return MSGPACK_MEMERR;
+	t->dict[t->ndict] = ( uint32_t )( e - t->keys );
+	e->id = t->ndict++;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF const char* msgpack_intern_str( msgpack_intern *t, const void *key, uint32_t n )
+{
+	msgpack_intern_key *e;
+	if ( !t || ( !key && n )) return NULL;
+	e = msgpack_intern_lookup( t, ( const byte* )key, n, 1 );
+	return e ? e->key : NULL;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_key( msgpack_p *m, msgpack_intern *t, const void *key, uint32_t n )
+{
+	msgpack_intern_key *e;
+	byte id[4];
+	uint32_t k;
+	MSGPACK_ERR ret;
+	PTR_CHK( m );
+	if ( !t || ( n < 3 ) || ( m->flags & MSGPACK_FLAG_COMPAT )) return msgpack_pack_raw( m, key, n );
+	e = msgpack_intern_lookup( t, ( const byte* )key, n, t->ndict < t->max );
+	if ( !e ) return ( t->ndict < t->max ) ? MSGPACK_MEMERR : msgpack_pack_raw( m, key, n );
+	if ( e->id == INTERN_NO_ID ) {
+		if ( t->ndict >= t->max ) return msgpack_pack_raw( m, key, n );
+		if (( ret = msgpack_pack_ext( m, MSGPACK_EXT_KEYDEF, key, n ))) return ret;
+		return msgpack_intern_define( t, e );		/* only once the definition is in the stream */
+	}
+	k = e->id < 256 ? 1 : e->id < 65536 ? 2 : 4;
+	id[0] = ( byte )( e->id >> 24 ); id[1] = ( byte )( e->id >> 16 ); id[2] = ( byte )( e->id >> 8 ); id[3] = ( byte )e->id;
+	return msgpack_pack_ext_copy( m, MSGPACK_EXT_KEYREF, id + 4 - k, k );	/* "id" is on the stack */
+}
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_key( msgpack_u *m, msgpack_intern *t, const char **key, uint32_t *n )
+{
+	const byte *p0, *data;
+	msgpack_intern_key *e;
+	uint32_t k, i, id = 0;
+	int8_t type;
+	MSGPACK_ERR ret;
+	UNPACK_CHK( m );
+	p0 = m->p;
+	if ( msgpack_lead_table[*m->p].code != MSGPACK_EXT ) {
+		if (( ret = msgpack_unpack_raw( m, &data, &k ))) return ret;
+		e = t ? msgpack_intern_lookup( t, data, k, t->n < t->max ) : NULL;
+		if ( key ) *key = e ? e->key : ( const char* )data;
+		if ( n ) *n = k;
+		return MSGPACK_SUCCESS;
+	}
+	if (( ret = msgpack_unpack_ext( m, &type, &data, &k ))) return ret;
+	ret = MSGPACK_TYPEERR;
+	if ( !t ) e = NULL;
+	else if ( type == MSGPACK_EXT_KEYDEF ) {
+		if ( t->ndict >= t->max ) ret = MSGPACK_MEMERR;
+		else if ((( e = msgpack_intern_lookup( t, data, k, 1 )) == NULL ) || ( e->id != INTERN_NO_ID ))
+			ret = e ? MSGPACK_TYPEERR : MSGPACK_MEMERR;		/* defined twice, or no room */
+		else ret = msgpack_intern_define( t, e );
+	} else if (( type == MSGPACK_EXT_KEYREF ) && ( k == 1 || k == 2 || k == 4 )) {
+		for ( i = 0; i < k; ++i ) id = ( id << 8 ) | data[i];
+		if ( id < t->ndict ) { e = t->keys + t->dict[id]; ret = MSGPACK_SUCCESS; }
+	}
+	if ( ret ) { m->p = p0; return ret; }
+	if ( key ) *key = e->key;
+	if ( n ) *n = e->n;
+	return MSGPACK_SUCCESS;
+}
+#undef INTERN_NO_ID
+
+/* **************************************** RECORD BATCHES **************************************** */
+/* bytes per value of a column type, string columns holding uint32_t indices; 0 if not a column type */
+static uint32_t msgpack_column_width( int type )
+{
+	switch ( type ) {
+		case MSGPACK_INT8:	case MSGPACK_UINT8:		return 1;
+		case MSGPACK_INT16:	case MSGPACK_UINT16:	return 2;
+		case MSGPACK_INT32:	case MSGPACK_UINT32:	case MSGPACK_FLOAT:		case MSGPACK_RAW:	return 4;
+		case MSGPACK_INT64:	case MSGPACK_UINT64:	case MSGPACK_DOUBLE:	return 8;
+		default:	return 0;
+	}
+}
+
+MSGPACKF MSGPACK_ERR msgpack_batch_begin( msgpack_batch_writer *w, msgpack_p *m, uint32_t nrows )
+{
+	MSGPACK_ERR ret;
+	if ( !w ) return MSGPACK_ARGERR;
+	memset( w, 0, sizeof( *w ));
+	PTR_CHK( m );
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return MSGPACK_TYPEERR;
+	if (( ret = msgpack_expand( m, 6 ))) return ret;	/* may flush, so mark afterwards */
+	msgpack_pack_checkpoint( m, &w->mark );
+	memset( m->p, 0, 6 );
+	m->p[0] = MSGPACK_EXT+2; m->p[5] = ( byte )MSGPACK_EXT_BATCH;		/* always ext32, so it can be patched */
+	m->p += 6;
+	if (( ret = msgpack_pack_uint32( m, nrows ))) { msgpack_pack_rollback( m, &w->mark ); return ret; }
+	msgpack_intern_init( &w->dict, 0, m->alloc );
+	w->p = m;
+	w->nrows = nrows;
+	w->alloc = m->alloc;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_batch_cancel( msgpack_batch_writer *w )
+{
+	if ( !w ) return MSGPACK_ARGERR;
+	if ( w->p ) {
+		msgpack_pack_rollback( w->p, &w->mark );
+		msgpack_intern_free( &w->dict );
+	}
+	memset( w, 0, sizeof( *w ));
+	return MSGPACK_SUCCESS;
+}
+
+/* a raw string always copied, even by a zero-copy packer, as names and dictionary keys do not outlive the writer */
+static MSGPACK_ERR msgpack_batch_raw( msgpack_p *m, const void *data, uint32_t n )
+{
+	MSGPACK_ERR ret = msgpack_pack_arr_head( m, 0xa0, MSGPACK_RAW, n );
+	return ret ? ret : msgpack_pack_append( m, data, n );
+}
+
+/* integers are gathered a block at a time (unless already contiguous) and written without type checks */
+#define BATCH_INTS( CODE, T ) \
+	case MSGPACK_##CODE: { \
+		T##_t tmp[BULK_BLOCK]; \
+		if ( stride == sizeof( T##_t )) return msgpack_pack_##T##_items( m, ( const T##_t* )x, n ); \
+		for ( i = 0; i < n; i += k ) { \
+			k = ( n - i < BULK_BLOCK ) ? n - i : BULK_BLOCK; \
+			for ( j = 0; j < k; ++j ) memcpy( tmp + j, x + ( size_t )( i + j )*stride, sizeof( T##_t )); \
+			if (( ret = msgpack_pack_##T##_items( m, tmp, k ))) return ret; \
+		} \
+		return MSGPACK_SUCCESS; \
+	}
+static MSGPACK_ERR msgpack_batch_ints( msgpack_p *m, int type, const byte *x, uint32_t stride, uint32_t n )
+{
+	uint32_t i, j, k;
+	MSGPACK_ERR ret = msgpack_pack_array( m, n );
+	if ( ret ) return ret;
+	switch ( type ) {
+		BATCH_INTS( INT8, int8 )
+		BATCH_INTS( INT16, int16 )
+		BATCH_INTS( INT32, int32 )
+		BATCH_INTS( INT64, int64 )
+		BATCH_INTS( UINT8, uint8 )
+		BATCH_INTS( UINT16, uint16 )
+		BATCH_INTS( UINT32, uint32 )
+		BATCH_INTS( UINT64, uint64 )
+	}
+	return MSGPACK_TYPEERR;
+}
+#undef BATCH_INTS
+
+/* floats and doubles are all the same size, so they need no type codes: the column is one bin of
+big-endian values, byteswapped a block at a time */
+static MSGPACK_ERR msgpack_batch_reals( msgpack_p *m, uint32_t w, const byte *x, uint32_t stride, uint32_t n )
+{
+	uint64_t tmp[BULK_BLOCK];
+	uint32_t i, j, k, bytes, nh = 5;
+	byte h[5];
+	MSGPACK_ERR ret;
+	if ( n > 0xffffffffu / w ) return MSGPACK_MEMERR;
+	bytes = n*w;
+	if ( bytes < ( 1u<<8 ))			{ h[0] = MSGPACK_BIN; h[1] = ( byte )bytes; nh = 2; }
+	else if ( bytes < ( 1u<<16 ))	{ h[0] = MSGPACK_BIN+1; msgpack_copy_bits( &bytes, h + 1, 2 ); nh = 3; }
+	else							{ h[0] = MSGPACK_BIN+2; msgpack_copy_bits( &bytes, h + 1, 4 ); }
+	if (( ret = msgpack_pack_append( m, h, nh ))) return ret;
+	if (( ret = msgpack_expand( m, bytes ))) return ret;
+	for ( i = 0; i < n; i += k, m->p += k*w ) {
+		k = ( n - i < BULK_BLOCK ) ? n - i : BULK_BLOCK;
+		if ( stride == w ) memcpy( tmp, x + ( size_t )i*w, k*w );
+		else for ( j = 0; j < k; ++j ) memcpy(( byte* )tmp + j*w, x + ( size_t )( i + j )*stride, w );
+		if ( w == 4 ) msgpack_bswap32_block(( uint32_t* )tmp, ( const uint32_t* )tmp, k );
+		else msgpack_bswap64_block( tmp, tmp, k );
+		memcpy( m->p, tmp, k*w );
+	}
+	return MSGPACK_SUCCESS;
+}
+
+/* strings are replaced by their index in a dictionary of the distinct values, which is packed first */
+static MSGPACK_ERR msgpack_batch_strings( msgpack_batch_writer *w, const byte *x, uint32_t stride, uint32_t n )
+{
+	msgpack_intern *t = &w->dict;
+	msgpack_intern_key *e;
+	uint32_t i, *idx = NULL;
+	const char *s;
+	MSGPACK_ERR ret = MSGPACK_SUCCESS;
+	if ( n > 0xffffffffu / sizeof( uint32_t )) return MSGPACK_MEMERR;
+	if ( n && !( idx = ( uint32_t* )msgpack_malloc( w->alloc, n*sizeof( uint32_t )))) return MSGPACK_MEMERR;
+	msgpack_intern_reset( t );
+	for ( i = 0; i < n; ++i ) {
+		memcpy( &s, x + ( size_t )i*stride, sizeof( s ));
+		if ( !s ) { ret = MSGPACK_ARGERR; break; }
+		if ( !( e = msgpack_intern_lookup( t, ( const byte* )s, ( uint32_t )strlen( s ), 1 ))) { ret = MSGPACK_MEMERR; break; }
+		idx[i] = ( uint32_t )( e - t->keys );
+	}
+	if ( !ret ) ret = msgpack_pack_array( w->p, t->n );
+	for ( i = 0; !ret && ( i < t->n ); ++i ) ret = msgpack_batch_raw( w->p, t->keys[i].key, t->keys[i].n );
+	if ( !ret ) ret = msgpack_pack_uint32_array( w->p, idx, n );
+	msgpack_free( w->alloc, idx, n*sizeof( uint32_t ));
+	return ret;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_batch_column( msgpack_batch_writer *w, const char *name, MSGPACK_TYPE_CODES type, const void *base, uint32_t stride )
+{
+	const uint32_t width = msgpack_column_width( type );
+	msgpack_mark c;
+	MSGPACK_ERR ret;
+	if ( !w || !w->p || !name || !width || ( !base && w->nrows )) return MSGPACK_ARGERR;
+	msgpack_pack_checkpoint( w->p, &c );
+	if ( !( ret = msgpack_batch_raw( w->p, name, ( uint32_t )strlen( name ))) && !( ret = msgpack_pack_uint8( w->p, ( uint8_t )type )))
+		switch ( type ) {
+			case MSGPACK_FLOAT: case MSGPACK_DOUBLE:
+				ret = msgpack_batch_reals( w->p, width, ( const byte* )base, stride, w->nrows ); break;
+			case MSGPACK_RAW:
+				ret = msgpack_batch_strings( w, ( const byte* )base, stride, w->nrows ); break;
+			default:
+				ret = msgpack_batch_ints( w->p, type, ( const byte* )base, stride, w->nrows );
+		}
+	if ( ret ) msgpack_pack_rollback( w->p, &c );		/* drop the partial column */
+	return ret;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_batch_end( msgpack_batch_writer *w )
+{
+	msgpack_p *m;
+	uint32_t n;
+	byte *h;
+	if ( !w || !w->p ) return MSGPACK_ARGERR;
+	m = w->p;
+	h = m->buffer + w->mark.offset;
+	if (( w->mark.flushed != m->flushed ) || ( w->mark.offset + 6 > ( uint32_t )( m->p - m->buffer ))
+		|| ( h[0] != MSGPACK_EXT+2 ) || ( h[5] != ( byte )MSGPACK_EXT_BATCH ))
+	{	/* the header has been flushed or overwritten, so the batch cannot be closed */
+		msgpack_batch_cancel( w );
+		return MSGPACK_ARGERR;
+	}
+	n = msgpack_get_len( m ) - w->mark.offset - w->mark.refbytes - 6;
+	msgpack_copy_bits( &n, h + 1, 4 );
+	msgpack_intern_free( &w->dict );
+	memset( w, 0, sizeof( *w ));
+	return MSGPACK_SUCCESS;
+}
+
+/* decode the values of column "c" from "s" */
+#define BATCH_UNPACK( CODE, T ) \
+	case MSGPACK_##CODE: ret = msgpack_unpack_##T##_array( s, ( T##_t* )c->data, nrows, &k ); break;
+static MSGPACK_ERR msgpack_unpack_column( msgpack_u *s, msgpack_column *c, uint32_t nrows, const msgpack_alloc *a )
+{
+	const uint32_t w = msgpack_column_width( c->type );
+	const byte *p;
+	uint32_t i, k = 0;
+	MSGPACK_ERR ret;
+	if ( !w ) return MSGPACK_TYPEERR;
+	if ( nrows > msgpack_unpack_len( s )) return MSGPACK_TYPEERR;	/* every value takes a byte at least */
+	if ( nrows > 0xffffffffu / w ) return MSGPACK_TYPEERR;		/* nor could the column be allocated */
+	if ( nrows && !( c->data = msgpack_malloc( a, nrows*w ))) return MSGPACK_MEMERR;
+	switch ( c->type ) {
+		case MSGPACK_FLOAT: case MSGPACK_DOUBLE:
+			if (( ret = msgpack_unpack_bin( s, &p, &k ))) return ret;
+			if ( k != nrows*w ) return MSGPACK_TYPEERR;
+			memcpy( c->data, p, k );
+			if ( w == 4 ) msgpack_bswap32_block(( uint32_t* )c->data, ( const uint32_t* )c->data, nrows );
+			else msgpack_bswap64_block(( uint64_t* )c->data, ( const uint64_t* )c->data, nrows );
+			return MSGPACK_SUCCESS;
+		case MSGPACK_RAW:
+			if (( ret = msgpack_unpack_array( s, &k ))) return ret;
+			if ( k > msgpack_unpack_len( s )) return MSGPACK_TYPEERR;
+			if ( k && !( c->dict = ( msgpack_value* )msgpack_malloc( a, k*sizeof( msgpack_value )))) return MSGPACK_MEMERR;
+			if ( k ) memset( c->dict, 0, k*sizeof( msgpack_value ));
+			for ( c->ndict = k, i = 0; i < k; ++i ) {
+				c->dict[i].type = MSGPACK_RAW;
+				if (( ret = msgpack_unpack_raw( s, &c->dict[i].v.p, &c->dict[i].n ))) return ret;
+			}
+			if (( ret = msgpack_unpack_uint32_array( s, ( uint32_t* )c->data, nrows, &k ))) return ret;
+			for ( i = 0; i < k; ++i ) if ((( const uint32_t* )c->data )[i] >= c->ndict ) return MSGPACK_TYPEERR;
+			break;
+		BATCH_UNPACK( INT8, int8 )
+		BATCH_UNPACK( INT16, int16 )
+		BATCH_UNPACK( INT32, int32 )
+		BATCH_UNPACK( INT64, int64 )
+		BATCH_UNPACK( UINT8, uint8 )
+		BATCH_UNPACK( UINT16, uint16 )
+		BATCH_UNPACK( UINT32, uint32 )
+		BATCH_UNPACK( UINT64, uint64 )
+		default: return MSGPACK_TYPEERR;
+	}
+	if ( ret ) return ret;
+	return ( k == nrows ) ? MSGPACK_SUCCESS : MSGPACK_TYPEERR;
+}
+#undef BATCH_UNPACK
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_batch( msgpack_u *m, msgpack_batch *b, const msgpack_alloc *a )
+{
+	const byte *p0, *data;
+	msgpack_column *c;
+	msgpack_u s;
+	uint32_t n;
+	uint8_t code;
+	int8_t type;
+	MSGPACK_ERR ret;
+	UNPACK_CHK( m );
+	if ( !b ) return MSGPACK_ARGERR;
+	memset( b, 0, sizeof( *b ));
+	b->alloc = a;
+	p0 = m->p;
+	if (( ret = msgpack_unpack_ext( m, &type, &data, &n ))) return ret;
+	if ( type != MSGPACK_EXT_BATCH ) { m->p = p0; return MSGPACK_TYPEERR; }
+	msgpack_unpack_init_fixed( &s, data, n );
+	ret = msgpack_unpack_uint32( &s, &b->nrows );
+	while ( !ret && msgpack_unpack_len( &s )) {
+		if (( ret = msgpack_grow( a, ( void** )&b->col, &b->size, b->ncols, sizeof( msgpack_column )))) break;
+		c = b->col + b->ncols++;		/* counted at once, so a partial column is freed too */
+		memset( c, 0, sizeof( *c ));
+		if (( ret = msgpack_unpack_raw( &s, &data, &c->nlen )) || ( ret = msgpack_unpack_uint8( &s, &code ))) break;
+		c->name = ( const char* )data;
+		c->type = ( MSGPACK_TYPE_CODES )code;
+		ret = msgpack_unpack_column( &s, c, b->nrows, a );
+	}
+	if ( ret ) {
+		msgpack_batch_free( b );
+		m->p = p0;
+		if (( ret == MSGPACK_NEEDMORE ) || ( ret == MSGPACK_DEPTHERR )) ret = MSGPACK_TYPEERR;	/* the extension itself was complete */
+	}
+	return ret;
+}
+
+MSGPACKF const msgpack_column* msgpack_batch_find( const msgpack_batch *b, const char *name )
+{
+	uint32_t i, n;
+	if ( !b || !name ) return NULL;
+	n = ( uint32_t )strlen( name );
+	for ( i = 0; i < b->ncols; ++i )
+		if (( b->col[i].nlen == n ) && ( memcmp( b->col[i].name, name, n ) == 0 )) return b->col + i;
+	return NULL;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_batch_pack_row( const msgpack_batch *b, uint32_t i, msgpack_p *m )
+{
+	const msgpack_column *c;
+	const msgpack_value *v;
+	uint32_t j;
+	MSGPACK_ERR ret;
+	if ( !b || ( i >= b->nrows )) return MSGPACK_ARGERR;
+	ret = msgpack_pack_map( m, b->ncols );
+	for ( j = 0, c = b->col; !ret && ( j < b->ncols ); ++j, ++c ) {
+		if (( ret = msgpack_pack_raw( m, c->name, c->nlen ))) break;
+		switch ( c->type ) {
+			case MSGPACK_INT8:		ret = msgpack_pack_int8( m, (( const int8_t* )c->data )[i] ); break;
+			case MSGPACK_INT16:		ret = msgpack_pack_int16( m, (( const int16_t* )c->data )[i] ); break;
+			case MSGPACK_INT32:		ret = msgpack_pack_int32( m, (( const int32_t* )c->data )[i] ); break;
+			case MSGPACK_INT64:		ret = msgpack_pack_int64( m, (( const int64_t* )c->data )[i] ); break;
+			case MSGPACK_UINT8:		ret = msgpack_pack_uint8( m, (( const uint8_t* )c->data )[i] ); break;
+			case MSGPACK_UINT16:	ret = msgpack_pack_uint16( m, (( const uint16_t* )c->data )[i] ); break;
+			case MSGPACK_UINT32:	ret = msgpack_pack_uint32( m, (( const uint32_t* )c->data )[i] ); break;
+			case MSGPACK_UINT64:	ret = msgpack_pack_uint64( m, (( const uint64_t* )c->data )[i] ); break;
+			case MSGPACK_FLOAT:		ret = msgpack_pack_float( m, (( const float* )c->data )[i] ); break;
+			case MSGPACK_DOUBLE:	ret = msgpack_pack_double( m, (( const double* )c->data )[i] ); break;
+			case MSGPACK_RAW:
+				v = c->dict + (( const uint32_t* )c->data )[i];
+				ret = msgpack_pack_raw( m, v->v.p, v->n ); break;
+			default:				ret = MSGPACK_TYPEERR;
+		}
+	}
+	return ret;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_batch_free( msgpack_batch *b )
+{
+	uint32_t i;
+	if ( !b ) return MSGPACK_ARGERR;
+	for ( i = 0; i < b->ncols; ++i ) {		/* columns of more than 32 bits of bytes are never allocated */
+		msgpack_free( b->alloc, b->col[i].data, b->nrows*msgpack_column_width( b->col[i].type ));
+		msgpack_free( b->alloc, b->col[i].dict, b->col[i].ndict*sizeof( msgpack_value ));
+	}
+	msgpack_free( b->alloc, b->col, b->size*sizeof( msgpack_column ));
+	memset( b, 0, sizeof( *b ));
+	return MSGPACK_SUCCESS;
+}
+#undef BULK_BLOCK
+
+/* **************************************** COMPRESSION **************************************** */
+/* an LZ77 block is a series of sequences, each a token byte holding the number of literals (high nibble)
+and the match length less 4 (low nibble), either nibble being 15 if continued in following bytes that
+add 255 until one is smaller; then the literals, a 16-bit little-endian offset back into the output
+and the rest of the match length. the last sequence has literals only */
+#define LZ_HASH_BITS	12
+#define LZ_MIN_MATCH	4
+#define LZ_HASH( x )	((( x )*2654435761u ) >> ( 32 - LZ_HASH_BITS ))
+
+static INLINE uint32_t msgpack_lz_read32( const byte *p )	{ uint32_t x; memcpy( &x, p, 4 ); return x; }
+
+/* write a nibble's continuation bytes for the length "k" (already less 15) */
+static INLINE byte* msgpack_lz_length( byte *op, uint32_t k )
+{
+	for ( ; k >= 255; k -= 255 ) *op++ = 255;
+	*op++ = ( byte )k;
+	return op;
+}
+
+MSGPACKF uint32_t msgpack_lz_bound( uint32_t n )
+{
+	return ( n > 0xff000000u ) ? 0 : n + n/255 + 16;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_lz_compress( const void *src, uint32_t n, void *dst, uint32_t max, uint32_t *out )
+{
+	uint32_t table[1u << LZ_HASH_BITS];		/* offset of the last position seen with each hash */
+	const byte *const s = ( const byte* )src, *const end = s + n, *ip = s, *anchor = s, *ref;
+	byte *op = ( byte* )dst, *const oend = op + max;
+	uint32_t x, h, lit, len;
+	if (( !src && n ) || ( !dst && max )) return MSGPACK_ARGERR;
+	memset( table, 0, sizeof( table ));
+	while ( n >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH ) {
+		x = msgpack_lz_read32( ip ); h = LZ_HASH( x );
+		ref = s + table[h];
+		table[h] = ( uint32_t )( ip - s );
+		if (( ref >= ip ) || ( ip - ref > 65535 ) || ( msgpack_lz_read32( ref ) != x )) {
+			ip += 1 + (( ip - anchor ) >> 6 );		/* step faster through data that does not compress */
+			continue;
+		}
+		for ( len = LZ_MIN_MATCH; ( ip + len < end ) && ( ip[len] == ref[len] ); ++len );
+		lit = ( uint32_t )( ip - anchor );
+		if (( uint32_t )( oend - op ) < 1 + lit + lit/255 + 1 + 2 + ( len - LZ_MIN_MATCH )/255 + 1 ) return MSGPACK_OVERFLOW;
+		*op = ( byte )((( lit < 15 ? lit : 15 ) << 4 ) | ( len - LZ_MIN_MATCH < 15 ? len - LZ_MIN_MATCH : 15 ));
+		++op;
+		if ( lit >= 15 ) op = msgpack_lz_length( op, lit - 15 );
+		memcpy( op, anchor, lit ); op += lit;
+		*op++ = ( byte )( ip - ref ); *op++ = ( byte )(( ip - ref ) >> 8 );
+		if ( len - LZ_MIN_MATCH >= 15 ) op = msgpack_lz_length( op, len - LZ_MIN_MATCH - 15 );
+		ip += len; anchor = ip;
+		if ( ip <= end - LZ_MIN_MATCH ) table[LZ_HASH( msgpack_lz_read32( ip - 2 ))] = ( uint32_t )( ip - 2 - s );
+	}
+	lit = ( uint32_t )( end - anchor );
+	if (( uint32_t )( oend - op ) < 1 + lit + lit/255 + 1 ) return MSGPACK_OVERFLOW;
+	*op++ = ( byte )(( lit < 15 ? lit : 15 ) << 4 );
+	if ( lit >= 15 ) op = msgpack_lz_length( op, lit - 15 );
+	memcpy( op, anchor, lit ); op += lit;
+	if ( out ) *out = ( uint32_t )( op - ( byte* )dst );
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_lz_decompress( const void *src, uint32_t n, void *dst, uint32_t max, uint32_t *out )
+{
+	const byte *ip = ( const byte* )src, *const iend = ip + n, *ref;
+	byte *op = ( byte* )dst, *const oend = op + max;
+	uint32_t token, lit, len, off, b;
+	if (( !src && n ) || ( !dst && max )) return MSGPACK_ARGERR;
+	while ( ip < iend ) {
+		token = *ip++;
+		if (( lit = token >> 4 ) == 15 ) do {
+			if ( ip == iend ) return MSGPACK_TYPEERR;
+			lit += ( b = *ip++ );
+		} while ( b == 255 );
+		if ( lit > ( uint32_t )( iend - ip )) return MSGPACK_TYPEERR;
+		if ( lit > ( uint32_t )( oend - op )) return MSGPACK_OVERFLOW;
+		if (( lit <= 16 ) && ( iend - ip >= 16 ) && ( oend - op >= 16 )) memcpy( op, ip, 16 );	/* fixed size, so inlined */
+		else memcpy( op, ip, lit );
+		op += lit; ip += lit;
+		if ( ip == iend ) break;			/* the last sequence has no match */
+		if ( iend - ip < 2 ) return MSGPACK_TYPEERR;
+		off = ip[0] | ( ip[1] << 8 ); ip += 2;
+		if (( len = token & 15 ) == 15 ) do {
+			if ( ip == iend ) return MSGPACK_TYPEERR;
+			len += ( b = *ip++ );
+		} while ( b == 255 );
+		len += LZ_MIN_MATCH;
+		if ( !off || ( off > ( uint32_t )( op - ( byte* )dst ))) return MSGPACK_TYPEERR;
+		if ( len > ( uint32_t )( oend - op )) return MSGPACK_OVERFLOW;
+		ref = op - off;
+		if (( off >= 8 ) && ( len + 8 <= ( uint32_t )( oend - op )))		/* copy in words, overrunning the end harmlessly */
+			for ( b = 0; b < len; b += 8 ) memcpy( op + b, ref + b, 8 );
+		else for ( b = 0; b < len; ++b ) op[b] = ref[b];	/* overlapping: repeats the last "off" bytes */
+		op += len;
+	}
+	if ( out ) *out = ( uint32_t )( op - ( byte* )dst );
+	return MSGPACK_SUCCESS;
+}
+#undef LZ_HASH
+#undef LZ_MIN_MATCH
+#undef LZ_HASH_BITS
+
+MSGPACKF MSGPACK_ERR msgpack_pack_lz( msgpack_p *m, const void *data, uint32_t n )
+{
+	const uint32_t bound = msgpack_lz_bound( n );
+	uint32_t k, nh;
+	byte *h;
+	MSGPACK_ERR ret;
+	PTR_CHK( m );
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return MSGPACK_TYPEERR;
+	if ( !data && n ) return MSGPACK_ARGERR;
+	if ( !n ) return MSGPACK_SUCCESS;
+	if ( !bound ) return MSGPACK_MEMERR;
+	if (( ret = msgpack_expand( m, 6 + 4 + bound ))) return ret;
+	h = m->p;		/* compress after the largest header, then move up behind the one needed */
+	if ( msgpack_lz_compress( data, n, h + 10, bound, &k ) || ( k >= n )) { memcpy( h + 10, data, n ); k = n; }	/* stored */
+	k += 4;
+	if ( k < ( 1u<<8 ))			{ h[0] = MSGPACK_EXT; h[1] = ( byte )k; nh = 3; }
+	else if ( k < ( 1u<<16 ))	{ h[0] = MSGPACK_EXT+1; h[1] = ( byte )( k >> 8 ); h[2] = ( byte )k; nh = 4; }
+	else						{ h[0] = MSGPACK_EXT+2; h[1] = ( byte )( k >> 24 ); h[2] = ( byte )( k >> 16 ); h[3] = ( byte )( k >> 8 ); h[4] = ( byte )k; nh = 6; }
+	if ( nh < 6 ) memmove( h + nh + 4, h + 10, k - 4 );
+	h[nh-1] = MSGPACK_EXT_LZ;
+	h[nh] = ( byte )( n >> 24 ); h[nh+1] = ( byte )( n >> 16 ); h[nh+2] = ( byte )( n >> 8 ); h[nh+3] = ( byte )n;
+	m->p += nh + k;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF int msgpack_sink_lz( void *ctx, const byte *data, uint32_t n )
+{
+	uint32_t k;
+	MSGPACK_ERR ret;
+	for ( ; n; data += k, n -= k ) {
+		k = ( n < MSGPACK_LZ_BLOCK ) ? n : MSGPACK_LZ_BLOCK;
+		if (( ret = msgpack_pack_lz(( msgpack_p* )ctx, data, k ))) return ret;
+	}
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_lz( msgpack_u *m, msgpack_u *out )
+{
+	const byte *p0, *data;
+	uint32_t n, raw, k;
+	int8_t type;
+	MSGPACK_ERR ret;
+	if ( !m || !out ) return MSGPACK_ARGERR;
+	while ( m->p < m->end ) {
+		p0 = m->p;
+		if (( ret = msgpack_unpack_ext( m, &type, &data, &n ))) return ret;
+		if (( type != MSGPACK_EXT_LZ ) || ( n < 4 )) { m->p = p0; return MSGPACK_TYPEERR; }
+		raw = (( uint32_t )data[0] << 24 ) | (( uint32_t )data[1] << 16 ) | (( uint32_t )data[2] << 8 ) | data[3];
+		data += 4; n -= 4;
+		if (( raw > n ) && ( raw > 255ull*n )) ret = MSGPACK_TYPEERR;		/* no block expands that much */
+		else if ( !( ret = msgpack_unpack_room( out, raw ))) {
+			if ( raw == n ) memcpy(( byte* )out->end, data, n );
+			else if ( msgpack_lz_decompress( data, n, ( byte* )out->end, raw, &k ) || ( k != raw )) ret = MSGPACK_TYPEERR;
+		}
+		if ( ret ) { m->p = p0; return ret; }
+		out->end += raw;
+		out->max += raw;
+	}
+	return MSGPACK_SUCCESS;
+}
+
+/* **************************************** FRAMES **************************************** */
+#ifndef MSGPACK_CRC32C_HW
+/* one byte at a time, with the reflected Castagnoli polynomial 0x82f63b78 */
+static const uint32_t msgpack_crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+	0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b, 0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+	0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+	0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a, 0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+	0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a, 0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+	0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+	0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927, 0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+	0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+	0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859, 0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+	0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c, 0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+	0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+	0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c, 0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+	0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+	0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d, 0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+	0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+	0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff, 0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+	0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee, 0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+	0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e, 0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
+};
+#endif
+
+MSGPACKF uint32_t msgpack_crc32c( uint32_t crc, const void *data, uint32_t n )
+{
+	const byte *p = ( const byte* )data;
+	crc = ~crc;
+#ifdef MSGPACK_CRC32C_HW
+	for ( ; n && (( size_t )p & 7 ); --n ) crc = _mm_crc32_u8( crc, *p++ );	/* align for the wide loads */
+	#if defined( __x86_64__ ) || defined( _M_X64 )
+	{
+		uint64_t c = crc, x;
+		for ( ; n >= 8; n -= 8, p += 8 ) { memcpy( &x, p, 8 ); c = _mm_crc32_u64( c, x ); }
+		crc = ( uint32_t )c;
+	}
+	#else
+	{
+		uint32_t x;
+		for ( ; n >= 4; n -= 4, p += 4 ) { memcpy( &x, p, 4 ); crc = _mm_crc32_u32( crc, x ); }
+	}
+	#endif
+	for ( ; n; --n ) crc = _mm_crc32_u8( crc, *p++ );
+#else
+	for ( ; n; --n ) crc = msgpack_crc32c_table[( crc ^ *p++ ) & 0xff] ^ ( crc >> 8 );
+#endif
+	return ~crc;
+}
+
+static INLINE uint32_t msgpack_frame_read32( const byte *p )	{ uint32_t x; memcpy( &x, p, 4 ); return BYTESWAP32( x ); }
+static INLINE void msgpack_frame_write32( byte *p, uint32_t x )	{ x = BYTESWAP32( x ); memcpy( p, &x, 4 ); }
+
+MSGPACKF MSGPACK_ERR msgpack_pack_frame_begin( msgpack_p *m, msgpack_mark *c )
+{
+	MSGPACK_ERR ret;
+	PTR_CHK( m ); if ( !c ) return MSGPACK_ARGERR;
+	if ( m->flags & MSGPACK_FLAG_COMPAT ) return MSGPACK_TYPEERR;
+	if (( ret = msgpack_expand( m, MSGPACK_FRAME_HEAD ))) return ret;	/* may flush, so mark afterwards */
+	msgpack_pack_checkpoint( m, c );
+	memset( m->p, 0, MSGPACK_FRAME_HEAD );
+	m->p[0] = MSGPACK_EXT+2; m->p[5] = ( byte )MSGPACK_EXT_FRAME;		/* always ext32, so it can be patched */
+	m->p += MSGPACK_FRAME_HEAD;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_pack_frame_end( msgpack_p *m, const msgpack_mark *c, int flags )
+{
+	const msgpack_ref *r;
+	uint32_t i, off, n, crc = 0;
+	byte *h;
+	PTR_CHK( m ); if ( !c ) return MSGPACK_ARGERR;
+	if (( flags & ~( MSGPACK_FRAME_CRC | MSGPACK_FRAME_BATCH )) || ( c->flushed != m->flushed )) return MSGPACK_ARGERR;
+	if (( c->offset + MSGPACK_FRAME_HEAD > ( uint32_t )( m->p - m->buffer )) || ( c->nref > ( m->sg ? m->sg->n : 0 ))) return MSGPACK_ARGERR;
+	h = m->buffer + c->offset;
+	if (( h[0] != MSGPACK_EXT+2 ) || ( h[5] != ( byte )MSGPACK_EXT_FRAME )) return MSGPACK_ARGERR;
+	n = msgpack_get_len( m ) - c->offset - c->refbytes - MSGPACK_FRAME_HEAD;
+	if ( flags & MSGPACK_FRAME_CRC )
+	{	/* the body is the buffer interleaved with any payloads packed by reference since the mark */
+		off = c->offset + MSGPACK_FRAME_HEAD;
+		if ( m->sg ) for ( i = c->nref; i < m->sg->n; ++i )
+		{
+			r = m->sg->refs + i;
+			crc = msgpack_crc32c( crc, m->buffer + off, r->offset - off );
+			crc = msgpack_crc32c( crc, r->data, r->n );
+			off = r->offset;
+		}
+		crc = msgpack_crc32c( crc, m->buffer + off, ( uint32_t )( m->p - m->buffer ) - off );
+	}
+	msgpack_frame_write32( h + 1, n + 5 );
+	h[6] = ( byte )flags;
+	msgpack_frame_write32( h + 7, crc );
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_begin( msgpack_frame_writer *w, msgpack_p *m, int flags )
+{
+	MSGPACK_ERR ret;
+	if ( !w ) return MSGPACK_ARGERR;
+	memset( w, 0, sizeof( *w ));
+	if ( flags & ~MSGPACK_FRAME_CRC ) return MSGPACK_ARGERR;
+	if (( ret = msgpack_pack_frame_begin( m, &w->mark ))) return ret;
+	w->p = m;
+	w->flags = flags;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_next( msgpack_frame_writer *w )
+{
+	if ( !w || !w->p ) return MSGPACK_ARGERR;
+	if ( msgpack_grow( w->p->alloc, ( void** )&w->offsets, &w->size, w->n, sizeof( uint32_t ))) return MSGPACK_MEMERR;
+	w->offsets[w->n++] = msgpack_get_len( w->p ) - w->mark.offset - w->mark.refbytes - MSGPACK_FRAME_HEAD;
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_cancel( msgpack_frame_writer *w )
+{
+	if ( !w ) return MSGPACK_ARGERR;
+	if ( w->p ) {
+		msgpack_pack_rollback( w->p, &w->mark );
+		msgpack_free( w->p->alloc, w->offsets, w->size*sizeof( uint32_t ));
+	}
+	memset( w, 0, sizeof( *w ));
+	return MSGPACK_SUCCESS;
+}
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_end( msgpack_frame_writer *w )
+{
+	msgpack_p *m;
+	uint32_t i;
+	MSGPACK_ERR ret;
+	if ( !w || !w->p ) return MSGPACK_ARGERR;
+	m = w->p;
+	if ( w->n > ( 0xffffffffu - 4 )/4 ) ret = MSGPACK_MEMERR;
+	else if ( !( ret = msgpack_expand( m, 4*w->n + 4 ))) {		/* offset table, then the count last so a reader can find the table */
+		for ( i = 0; i < w->n; ++i ) msgpack_frame_write32( m->p + 4*i, w->offsets[i] );
+		msgpack_frame_write32( m->p + 4*w->n, w->n );
+		m->p += 4*w->n + 4;
+		ret = msgpack_pack_frame_end( m, &w->mark, w->flags | MSGPACK_FRAME_BATCH );
+	}
+	if ( ret ) msgpack_frame_batch_cancel( w );	/* discard the partial frame */
+	else {
+		msgpack_free( m->alloc, w->offsets, w->size*sizeof( uint32_t ));
+		memset( w, 0, sizeof( *w ));
+	}
+	return ret;
+}
+
+/* fill "f" from the payload of a frame extension */
+static MSGPACK_ERR msgpack_frame_parse( const byte *data, uint32_t n, msgpack_frame *f )
+{
+	uint32_t i, k, o, prev = 0;
+	if (( n < 5 ) || ( data[0] & ~( MSGPACK_FRAME_CRC | MSGPACK_FRAME_BATCH ))) return MSGPACK_TYPEERR;
+	f->flags = data[0];
+	f->data = data + 5; f->n = n - 5;
+	f->count = 1; f->offsets = NULL;
+	if (( f->flags & MSGPACK_FRAME_CRC ) && ( msgpack_crc32c( 0, f->data, f->n ) != msgpack_frame_read32( data + 1 ))) return MSGPACK_TYPEERR;
+	if ( !( f->flags & MSGPACK_FRAME_BATCH )) return MSGPACK_SUCCESS;
+	if ( f->n < 4 ) return MSGPACK_TYPEERR;
+	k = msgpack_frame_read32( f->data + f->n - 4 );
+	if ( k > ( f->n - 4 )/4 ) return MSGPACK_TYPEERR;
+	f->n -= 4 + 4*k;
+	f->count = k;
+	f->offsets = f->data + f->n;
+	for ( i = 0; i < k; prev = o, ++i )		/* messages in order, within the body */
+		if ((( o = msgpack_frame_read32( f->offsets + 4*i )) < prev ) || ( o > f->n )) return MSGPACK_TYPEERR;
+	return MSGPACK_SUCCESS;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_frame( msgpack_u *m, msgpack_frame *f )
+{
+	const byte *p0, *data;
+	uint32_t n;
+	int8_t type;
+	MSGPACK_ERR ret;
+	if ( !m || !f ) return MSGPACK_ARGERR;
+	p0 = m->p;
+	if (( ret = msgpack_unpack_ext( m, &type, &data, &n ))) return ret;
+	if ( type != MSGPACK_EXT_FRAME ) ret = MSGPACK_TYPEERR;
+	else ret = msgpack_frame_parse( data, n, f );
+	if ( ret ) { m->p = p0; memset( f, 0, sizeof( *f )); }
+	return ret;
+}
+
+MSGPACKF MSGPACK_ERR msgpack_frame_message( const msgpack_frame *f, uint32_t i, msgpack_u *u )
+{
+	uint32_t s, e;
+	if ( !f || ( i >= f->count )) return MSGPACK_ARGERR;
+	if ( !f->offsets ) return msgpack_unpack_init_fixed( u, f->data, f->n );
+	s = msgpack_frame_read32( f->offsets + 4*i );
+	e = ( i + 1 < f->count ) ? msgpack_frame_read32( f->offsets + 4*( i+1 )) : f->n;
+	return msgpack_unpack_init_fixed( u, f->data + s, e - s );
 }
 
+#undef UNPACK_NEED
 #undef UNPACK_CHK
 #undef PTR_CHK
@@ -12,6 +12,7 @@ The MessagePack protocol is specified at http://wiki.msgpack.org/display/MSGPACK
 use preprocessor definitions
 	MSGPACK_INLINE to include definitions and compile inline
 	MSGPACK_BUILDDLL to export functions to dll
+	MSGPACK_NO_SIMD to disable the SSSE3/AVX2 kernels used by the bulk array functions
 
 requires one of __BYTE_ORDER__, __LITTLE_ENDIAN__ or __BIG_ENDIAN__
 to be defined to determine host byte order for byte swapping
@@ -31,6 +32,7 @@ extern "C" {
 #else
 	#include <stdint.h>
 #endif
+#include <stddef.h>	/* size_t */
 #define INLINE __inline
 
 typedef uint8_t byte;
@@ -66,9 +68,32 @@ typedef enum {
 	MSGPACK_SUCCESS = 0,	///< no problem
 	MSGPACK_TYPEERR = -1,	///< type code did not match expected value
 	MSGPACK_MEMERR = -2,	///< out of memory error
-	MSGPACK_ARGERR = -3		///< received unexpected argument
+	MSGPACK_ARGERR = -3,	///< received unexpected argument
+	MSGPACK_OVERFLOW = -4,	///< fixed-size buffer is full
+	MSGPACK_IOERR = -5,		///< a streaming sink failed to accept data
+	MSGPACK_NEEDMORE = -6,	///< buffer ends part-way through an object; append more data and retry
+	MSGPACK_DEPTHERR = -7	///< containers are nested more deeply than allowed
 } MSGPACK_ERR;
 
+#ifndef MSGPACK_MAX_DEPTH
+	#define MSGPACK_MAX_DEPTH 64	///< Deepest container nesting accepted by the non-recursive walkers
+#endif
+
+/// Flags stored in the packer and unpacker objects for memory management
+typedef enum {
+	MSGPACK_FLAG_OWNED  = 0x01,	///< buffer belongs to the object and is free'd with it
+	MSGPACK_FLAG_FIXED  = 0x02,	///< buffer is caller-supplied and is never expanded
+	MSGPACK_FLAG_STATIC = 0x04,	///< object struct is caller-owned, so only release its buffer
+	MSGPACK_FLAG_COMPAT = 0x08	///< packer emits only the original raw formats, for legacy peers
+} MSGPACK_FLAGS;
+
+/// Options of a frame, stored in its header
+typedef enum {
+	MSGPACK_FRAME_CRC   = 0x01,	///< header holds the CRC32C of the body, checked on receipt
+	MSGPACK_FRAME_BATCH = 0x02	///< body holds several messages followed by their offset table
+} MSGPACK_FRAME_FLAGS;
+#define MSGPACK_FRAME_HEAD	11	///< Bytes of a frame header: ext32 header, flags and CRC
+
 /// Enum containing types defined by the MessagePack protocol
 typedef enum {
 	MSGPACK_FIX     = 0x7f,		/* fixnums are integers between (-32, 128) */
@@ -76,6 +101,8 @@ typedef enum {
 	MSGPACK_FALSE   = 0xc2,
 	MSGPACK_BOOL	= MSGPACK_FALSE,
 	MSGPACK_TRUE    = 0xc3,
+	MSGPACK_BIN     = 0xc4,		/* bin8, bin16 and bin32 follow */
+	MSGPACK_EXT     = 0xc7,		/* ext8, ext16 and ext32 follow */
 	MSGPACK_FLOAT   = 0xca,
 	MSGPACK_DOUBLE  = 0xcb,
 	MSGPACK_UINT8   = 0xcc,
@@ -86,34 +113,269 @@ typedef enum {
 	MSGPACK_INT16   = 0xd1,
 	MSGPACK_INT32   = 0xd2,
 	MSGPACK_INT64   = 0xd3,
-	MSGPACK_RAW     = 0xda,
+	MSGPACK_FIXEXT  = 0xd4,		/* fixext 1, 2, 4, 8 and 16 follow */
+	MSGPACK_STR8    = 0xd9,
+	MSGPACK_RAW     = 0xda,		/* a.k.a. str16 */
+	MSGPACK_STR     = MSGPACK_RAW,
 	MSGPACK_ARRAY   = 0xdc,
 	MSGPACK_MAP     = 0xde
 } MSGPACK_TYPE_CODES;
 
+#define MSGPACK_EXT_TIMESTAMP	( -1 )	///< Extension type reserved by the protocol for timestamps
+#ifndef MSGPACK_EXT_KEYDEF
+	#define MSGPACK_EXT_KEYDEF	( 126 )	///< Application extension type defining the next key of a key dictionary
+	#define MSGPACK_EXT_KEYREF	( 127 )	///< Application extension type referring to a defined key by its id
+#endif
+#ifndef MSGPACK_EXT_BATCH
+	#define MSGPACK_EXT_BATCH	( 125 )	///< Application extension type holding a columnar record batch
+#endif
+#ifndef MSGPACK_EXT_LZ
+	#define MSGPACK_EXT_LZ		( 124 )	///< Application extension type holding one compressed block
+#endif
+#ifndef MSGPACK_EXT_FRAME
+	#define MSGPACK_EXT_FRAME	( 123 )	///< Application extension type holding one frame of a log or stream
+#endif
+#ifndef MSGPACK_LZ_BLOCK
+	#define MSGPACK_LZ_BLOCK	65536	///< Most uncompressed bytes per block from msgpack_sink_lz
+#endif
+#ifndef MSGPACK_INTERN_MAX
+	#define MSGPACK_INTERN_MAX	65536	///< Default number of dictionary ids in a key table
+#endif
+
+/// Allocator hooks used by a packer or unpacker for all of its memory
+/** A NULL msgpack_alloc pointer selects malloc/realloc/free. free_fn may be NULL for
+ *	allocators that release everything at once (e.g. msgpack_arena). */
+typedef struct {
+	void* ( *alloc_fn )( void *ctx, uint32_t n );						///< allocate "n" bytes
+	void* ( *realloc_fn )( void *ctx, void *ptr, uint32_t old, uint32_t n );	///< resize a block of "old" bytes to "n"
+	void  ( *free_fn )( void *ctx, void *ptr, uint32_t n );				///< release a block of "n" bytes
+	void *ctx;															///< user pointer passed to every call
+} msgpack_alloc;
+
+/// A bump-pointer arena allocator: memory is carved from large blocks and released all at once
+/** Not thread-safe, so use one arena per thread (e.g. per request). */
+typedef struct {
+	msgpack_alloc hooks;			///< Hooks to hand to packers/unpackers, pointing at this arena
+	struct msgpack_arena_block *head;	///< Block currently being carved
+	uint32_t block;					///< Default block size
+	byte *last;						///< Most recent allocation, which can be resized in place
+} msgpack_arena;
+
+/// A raw payload packed by reference rather than copied into the packer buffer
+typedef struct {
+	uint32_t offset;	///< Position in the packer buffer where the payload belongs
+	uint32_t n;			///< Payload length
+	const void *data;	///< Caller's payload, which must stay valid until the output is consumed
+} msgpack_ref;
+
+/// Scatter-gather state of a packer: the payloads recorded by reference
+typedef struct {
+	msgpack_ref *refs;	///< Recorded payloads, in buffer order
+	uint32_t n;			///< Number of recorded payloads
+	uint32_t max;		///< Allocated length of refs
+	uint32_t bytes;		///< Total length of the recorded payloads
+	uint32_t threshold;	///< Raw payloads of at least this many bytes are packed by reference (0 = only msgpack_pack_raw_ref)
+} msgpack_sg;
+
+/// One segment of a scatter-gather list; same layout as the POSIX struct iovec for writev/sendmsg
+typedef struct {
+	void *iov_base;		///< Start of the segment
+	size_t iov_len;		///< Length of the segment
+} msgpack_iovec;
+
+/// Callback receiving the output of a streaming packer. return a negative value to report failure
+typedef int ( *msgpack_sink_fn )( void *ctx, const byte *data, uint32_t n );
+
 /// The msgpackalt packer object
 typedef struct {
 	uint32_t max; 	///< Size of allocated buffer
 	byte *p; 		///< Pointer to current place in buffer
 	byte *buffer; 	///< Pointer to start of buffer
+	byte flags;		///< Flags for memory management
+	const msgpack_alloc *alloc;	///< Allocator for the buffer and struct, NULL for malloc
+	msgpack_sg *sg;	///< Payloads packed by reference, NULL unless zero-copy packing is used
+	msgpack_sink_fn sink;	///< Streaming output, NULL to keep the whole message in the buffer
+	void *sink_ctx;	///< User pointer passed to the sink
+	uint32_t watermark;	///< Buffered bytes that trigger a flush to the sink
+	uint64_t flushed;	///< Bytes already handed to the sink
 } msgpack_p;
 
+/// A saved position of a packer, from msgpack_pack_checkpoint or msgpack_pack_begin_array/map
+typedef struct {
+	uint32_t offset;	///< Buffered bytes at the mark
+	uint32_t nref;		///< Payloads recorded by reference at the mark
+	uint32_t refbytes;	///< Their total length
+	uint64_t flushed;	///< Bytes handed to the sink at the mark
+} msgpack_mark;
+
 /// The msgpackalt unpacker object
 typedef struct {
 	uint32_t max; 	///< Size of allocated buffer
 	const byte *p; 	///< Pointer to current location in buffer
 	const byte *end;///< Pointer to end of buffer
 	byte flags;		///< Flags for memory management
+	const msgpack_alloc *alloc;	///< Allocator for the buffer and struct, NULL for malloc
+	uint32_t size;	///< Capacity of an owned buffer, which is reused by msgpack_unpack_append
 } msgpack_u;
 
+/// A heap buffer of packed data taken from a packer, e.g. to queue it for an unpacker without copying
+typedef struct {
+	byte *data;					///< Packed bytes, NULL if there are none
+	uint32_t n;					///< Number of packed bytes
+	uint32_t size;				///< Allocated size of "data"
+	const msgpack_alloc *alloc;	///< Allocator "data" came from, NULL for malloc
+} msgpack_buffer;
+
+/// One object in a parsed tape, stored in document (pre-)order
+typedef struct {
+	byte type;			///< Type class, as from msgpack_unpack_peek_code
+	byte head;			///< Header bytes before any payload
+	uint32_t offset;	///< Position of the object's lead byte in the parsed data
+	uint32_t len;		///< Payload bytes (raw, bin, ext) or element count (array, map pairs)
+	uint32_t next;		///< Index of the next sibling, i.e. the first entry after this subtree
+} msgpack_tape_entry;
+
+/// A flat index of every object in a message, built in one pass by msgpack_tape_parse
+typedef struct {
+	msgpack_tape_entry *e;	///< Entries, e[0] being the root; a container's first child is the entry after it
+	uint32_t n;				///< Number of entries
+	const byte *data;		///< The parsed data, which must outlive the tape
+	uint32_t size;			///< Bytes of data covered by the root object
+	const msgpack_alloc *alloc;	///< Allocator the entries came from
+} msgpack_tape;
+
+/// Any single object, decoded by msgpack_unpack_any
+typedef struct {
+	MSGPACK_TYPE_CODES type;	///< MSGPACK_NULL, BOOL, UINT64 (any integer >= 0), INT64 (< 0), FLOAT, DOUBLE, RAW, BIN, EXT, ARRAY or MAP
+	int8_t ext;					///< Extension type of an EXT
+	uint32_t n;					///< Payload bytes (raw, bin, ext) or element count (array, map pairs)
+	union {
+		int b;					///< BOOL
+		int64_t i;				///< INT64
+		uint64_t u;				///< UINT64
+		double d;				///< FLOAT (widened) or DOUBLE
+		const byte *p;			///< Payload of a RAW, BIN or EXT, pointing into the unpacker's buffer
+	} v;
+} msgpack_value;
+
+/// One distinct key held by a key table
+typedef struct {
+	char *key;				///< NUL-terminated copy, unchanged until the table is reset or freed
+	uint32_t n;				///< Length, excluding the NUL
+	uint32_t hash;			///< Hash of the key bytes
+	uint32_t id;			///< Dictionary id, or ~0u if the key has not been defined in the stream
+} msgpack_intern_key;
+
+/// A key table for one stream session: interns decoded map keys and numbers them for the key dictionary
+typedef struct {
+	msgpack_intern_key *keys;	///< Distinct keys, in order of first appearance
+	uint32_t n, size;			///< Keys held and allocated
+	uint32_t *slot;				///< Open-addressing hash of 1 + key index, 0 marking a free slot
+	uint32_t mask;				///< Slots less one (a power of two less one)
+	uint32_t *dict;				///< Key index of each dictionary id
+	uint32_t ndict, dsize;		///< Ids assigned and allocated
+	uint32_t max;				///< Most dictionary ids, and most keys interned from plain strings
+	const msgpack_alloc *alloc;	///< Allocator for the table and the key copies
+} msgpack_intern;
+
+/// Writer transposing homogeneous records into the columns of one record batch
+typedef struct {
+	msgpack_p *p;				///< Packer the columns are written into, NULL once released
+	msgpack_mark mark;			///< Where the batch began
+	msgpack_intern dict;		///< Distinct strings of the string column being packed
+	uint32_t nrows;				///< Records in the batch
+	const msgpack_alloc *alloc;	///< Allocator for scratch space, the packer's
+} msgpack_batch_writer;
+
+/// One decoded column of a record batch
+typedef struct {
+	const char *name;			///< Field name, pointing into the packed batch (not NUL-terminated)
+	uint32_t nlen;				///< Length of the name
+	MSGPACK_TYPE_CODES type;	///< MSGPACK_INT8 .. INT64, UINT8 .. UINT64, FLOAT, DOUBLE or RAW
+	void *data;					///< One value per row of the C type, or for RAW a uint32_t index into dict
+	msgpack_value *dict;		///< RAW only: the distinct strings, pointing into the packed batch
+	uint32_t ndict;				///< RAW only: number of distinct strings
+} msgpack_column;
+
+/// A decoded record batch, holding each column as one contiguous array
+typedef struct {
+	uint32_t nrows, ncols;		///< Records and fields
+	msgpack_column *col;		///< The columns, in packed order
+	uint32_t size;				///< Columns allocated
+	const msgpack_alloc *alloc;	///< Allocator the columns were taken from
+} msgpack_batch;
+
+/// Writer packing many messages into one frame, followed by a table of where each starts
+typedef struct {
+	msgpack_p *p;				///< Packer holding the frame, into which each message is packed
+	msgpack_mark mark;			///< Position of the frame header
+	uint32_t *offsets;			///< Start of each message, from the start of the frame body
+	uint32_t n, size;			///< Messages begun and offsets allocated
+	int flags;					///< MSGPACK_FRAME_CRC or 0
+} msgpack_frame_writer;
+
+/// A received frame, pointing into the unpacker's buffer
+typedef struct {
+	const byte *data;			///< The message, or the messages of a batch
+	uint32_t n;					///< Bytes at "data", excluding the offset table of a batch
+	uint32_t count;				///< Number of messages, 1 unless a batch
+	const byte *offsets;		///< Batch only: the big-endian uint32 start of each message in "data"
+	byte flags;					///< MSGPACK_FRAME_CRC and/or MSGPACK_FRAME_BATCH
+} msgpack_frame;
+
+/* **************************************** ERRORS **************************************** */
+MSGPACKF const char* msgpack_strerror( int code );
+/* a constant description of an error code, e.g. "unexpected type code" for MSGPACK_TYPEERR. nothing
+is formatted or allocated, so it costs nothing until called */
+
 
 /* **************************************** MEMORY FUNCTIONS **************************************** */
+/// Allocate "n" bytes using the allocator "a" (NULL for malloc) */
+MSGPACKF void* msgpack_malloc( const msgpack_alloc *a, uint32_t n );
+/// Resize the "old" byte block "ptr" to "n" bytes using the allocator "a" */
+MSGPACKF void* msgpack_realloc( const msgpack_alloc *a, void *ptr, uint32_t old, uint32_t n );
+/// Release the "n" byte block "ptr" obtained from the allocator "a" */
+MSGPACKF void msgpack_free( const msgpack_alloc *a, void *ptr, uint32_t n );
+
+/// Initialise an arena whose blocks are at least "block" bytes. pass &arena->hooks to the *_alloc functions */
+MSGPACKF MSGPACK_ERR msgpack_arena_init( msgpack_arena *a, uint32_t block );
+/// Allocate "n" bytes from the arena, aligned for any basic type */
+MSGPACKF void* msgpack_arena_alloc( msgpack_arena *a, uint32_t n );
+/// Release every allocation at once, keeping the current block for reuse. objects using the arena must not be referenced afterwards */
+MSGPACKF MSGPACK_ERR msgpack_arena_reset( msgpack_arena *a );
+/// Return all of the arena's blocks to the system */
+MSGPACKF MSGPACK_ERR msgpack_arena_free( msgpack_arena *a );
+
 /// Create a packer (msgpack_p) object, allocate some memory and return a pointer 
 MSGPACKF msgpack_p* msgpack_pack_init( );
 
+/// Create a packer as for msgpack_pack_init, taking all memory from the allocator "a" */
+MSGPACKF msgpack_p* msgpack_pack_init_alloc( const msgpack_alloc *a );
+
+/// Initialise a caller-owned packer (e.g. on the stack) to pack into the fixed "max" byte "buffer". no memory is allocated; packing returns MSGPACK_OVERFLOW once the buffer is full */
+MSGPACKF MSGPACK_ERR msgpack_pack_init_fixed( msgpack_p *m, void *buffer, uint32_t max );
+
+/// Initialise a caller-owned packer that starts in the "max" byte "buffer" and moves to memory from "a" (NULL for malloc) only if it outgrows it. release with msgpack_pack_free */
+MSGPACKF MSGPACK_ERR msgpack_pack_init_buffer( msgpack_p *m, void *buffer, uint32_t max, const msgpack_alloc *a );
+
 /// Free the packer object and its associated memory. do not reference *m after calling this function */
 MSGPACKF MSGPACK_ERR msgpack_pack_free( msgpack_p *m );
 
+/// Discard the packed contents but keep the allocated buffer for reuse */
+MSGPACKF MSGPACK_ERR msgpack_pack_reset( msgpack_p *m );
+
+/// Ensure there is room for "n" more bytes, growing the buffer once instead of repeatedly */
+MSGPACKF MSGPACK_ERR msgpack_pack_reserve( msgpack_p *m, uint32_t n );
+
+/// Shrink the allocated buffer to "max" bytes (but no smaller than the packed contents) */
+MSGPACKF MSGPACK_ERR msgpack_pack_shrink( msgpack_p *m, uint32_t max );
+
+/// Hand the packed contents to "b" (see msgpack_buffer) and start again with an empty buffer. the packer's own memory is passed on without copying; a caller-supplied buffer is copied. release "b" with msgpack_buffer_free or msgpack_unpack_adopt */
+MSGPACKF MSGPACK_ERR msgpack_pack_release( msgpack_p *m, msgpack_buffer *b );
+
+/// Free a buffer released from a packer, leaving it empty */
+MSGPACKF void msgpack_buffer_free( msgpack_buffer *b );
+
 /// Return the current length of the packed buffer */
 MSGPACKF uint32_t msgpack_get_len( const msgpack_p *m );
 
@@ -123,6 +385,38 @@ MSGPACKF MSGPACK_ERR msgpack_get_buffer( msgpack_p *m, const byte ** data, uint3
 /// Copies the internal buffer into the user-specified buffer "data" with length "max", returning the number of bytes copied. */
 MSGPACKF uint32_t msgpack_copy_to( const msgpack_p *m, void *data, uint32_t max );
 
+/* zero-copy (scatter-gather) packing: large raw payloads are recorded by reference instead of copied,
+	and the message is read out as a list of segments interleaving the packer's own bytes with the
+	caller's payloads. the payloads must stay valid until the output has been consumed.
+	msgpack_get_len and msgpack_copy_to account for the payloads; msgpack_get_buffer flattens them first */
+
+/// Pack raw payloads of "threshold" bytes or more by reference (0 restricts this to msgpack_pack_raw_ref) */
+MSGPACKF MSGPACK_ERR msgpack_pack_set_zerocopy( msgpack_p *m, uint32_t threshold );
+/// Return the number of segments needed to describe the packed message */
+MSGPACKF int msgpack_get_iovcnt( const msgpack_p *m );
+/// Fill "iov" with up to "max" segments describing the packed message, returning the number used or MSGPACK_OVERFLOW */
+MSGPACKF int msgpack_get_iovec( const msgpack_p *m, msgpack_iovec *iov, int max );
+/// Copy all payloads packed by reference into the buffer, so it holds the whole message, moving the bytes after each (see msgpack_pack_checkpoint) */
+MSGPACKF MSGPACK_ERR msgpack_pack_flatten( msgpack_p *m );
+
+/* streaming: a packer with a sink flushes its buffer to the sink whenever packing would take it past
+	the watermark, and passes large raw payloads straight through, so memory stays bounded however long
+	the stream is. all msgpack_pack_* functions work unchanged; call msgpack_pack_flush at the end.
+	msgpack_get_len/msgpack_get_buffer then only describe the bytes not yet flushed. if the sink fails, the
+	bytes it accepted are dropped from the buffer, so msgpack_pack_flush can be called again to resume;
+	a packing call that fails with MSGPACK_IOERR may however have sent part of its object */
+
+/// Stream the packer's output to "fn", flushing once "watermark" bytes are buffered (0 = the buffer size) */
+MSGPACKF MSGPACK_ERR msgpack_pack_set_sink( msgpack_p *m, msgpack_sink_fn fn, void *ctx, uint32_t watermark );
+/// Hand all buffered bytes to the sink */
+MSGPACKF MSGPACK_ERR msgpack_pack_flush( msgpack_p *m );
+/// Return the total number of bytes packed, including those already flushed */
+MSGPACKF uint64_t msgpack_pack_total( const msgpack_p *m );
+/// Sink writing to the stdio stream given as "ctx" (a FILE*) */
+MSGPACKF int msgpack_sink_file( void *ctx, const byte *data, uint32_t n );
+/// Sink writing to the file descriptor given as "ctx", i.e. ( void* )( intptr_t )fd */
+MSGPACKF int msgpack_sink_fd( void *ctx, const byte *data, uint32_t n );
+
 /* **************************************** PACKING FUNCTIONS **************************************** */
 /* the packing function pack the given variable into the buffer. if the value can be stored in a smaller
 	representation, it is packed in the smallest form that does not produce loss of data
@@ -145,14 +439,60 @@ MSGPACKF MSGPACK_ERR msgpack_pack_float( msgpack_p *m, float x );
 MSGPACKF MSGPACK_ERR msgpack_pack_double( msgpack_p *m, double x );
 /* array types ------------------------- */
 MSGPACKF MSGPACK_ERR msgpack_pack_raw( msgpack_p* m, const void *data, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_raw_ref( msgpack_p* m, const void *data, uint32_t n );   /* zero-copy: "data" is referenced, not copied */
 MSGPACKF MSGPACK_ERR msgpack_pack_str( msgpack_p* m, const char *str );   /* convenience wrapper for msgpack_pack_raw taking n=strlen */
+MSGPACKF MSGPACK_ERR msgpack_pack_bin( msgpack_p* m, const void *data, uint32_t n );   /* binary rather than text; raw in compat mode */
+MSGPACKF MSGPACK_ERR msgpack_pack_ext( msgpack_p* m, int8_t type, const void *data, uint32_t n );   /* MSGPACK_TYPEERR in compat mode */
+MSGPACKF MSGPACK_ERR msgpack_pack_timestamp( msgpack_p* m, int64_t sec, uint32_t nsec );
+/* packs seconds (and nanoseconds, < 1e9) since 1970-01-01 UTC as the timestamp extension, using the
+smallest of its 32, 64 and 96-bit forms */
 MSGPACKF MSGPACK_ERR msgpack_pack_array( msgpack_p* m, uint32_t n );
 MSGPACKF MSGPACK_ERR msgpack_pack_map( msgpack_p* m, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_begin_array( msgpack_p* m, msgpack_mark *c );
+MSGPACKF MSGPACK_ERR msgpack_pack_end_array( msgpack_p* m, const msgpack_mark *c, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_begin_map( msgpack_p* m, msgpack_mark *c );
+MSGPACKF MSGPACK_ERR msgpack_pack_end_map( msgpack_p* m, const msgpack_mark *c, uint32_t n );
+/* for containers whose size is not known up front: begin reserves a 5-byte array32/map32 header with a zero
+count and end patches in "n" (pairs for a map), so nothing is moved. the header is always the 32-bit form. with
+a sink the header must still be buffered at end, so keep the watermark above the size of the container */
+
+MSGPACKF MSGPACK_ERR msgpack_pack_checkpoint( msgpack_p *m, msgpack_mark *c );
+MSGPACKF MSGPACK_ERR msgpack_pack_rollback( msgpack_p *m, const msgpack_mark *c );
+/* rollback discards everything packed since the checkpoint, e.g. a partially encoded element after an error.
+gives MSGPACK_ARGERR if the packer has flushed to its sink in between or the mark is past the current position;
+a mark is invalidated by msgpack_pack_reset and by rolling back to an earlier mark. msgpack_pack_flatten (and so
+msgpack_get_buffer with payloads packed by reference) and msgpack_pack_header move the buffered bytes, which
+marks do not survive and which is not detected: end any deferred header, frame or batch and drop any mark first */
+
+MSGPACKF MSGPACK_ERR msgpack_pack_set_compat( msgpack_p *m, int legacy );
+/* with "legacy" non-zero the packer only emits formats understood by peers predating the str8, bin and
+ext families: strings of 32-255 bytes take a raw16 header, bin is packed as raw and ext is refused */
 
 MSGPACKF MSGPACK_ERR msgpack_pack_append( msgpack_p *m, const void* data, uint32_t n );
 MSGPACKF MSGPACK_ERR msgpack_pack_header( msgpack_p *m );
 /* EXTENSION: packs a unsigned int value to the start of the message specifying the length of the buffer.
-provides a way to check whether a given binary string is a msgpack'd buffer or not */
+provides a way to check whether a given binary string is a msgpack'd buffer or not. this shifts the whole
+message, so no mark may be outstanding (see msgpack_pack_checkpoint) */
+
+/* the unchecked packing functions skip the capacity check, so they are ONLY safe once msgpack_pack_reserve
+has made room for the worst case: 1 byte for nil and bool, 9 for a number (5 for a float or an int of 32 bits
+or fewer), 5 for an array or map header and 5+n for raw data. raw data is always copied, ignoring any sink
+or zero-copy threshold */
+MSGPACKF void msgpack_unchecked_pack_null( msgpack_p* m );
+MSGPACKF void msgpack_unchecked_pack_bool( msgpack_p* m, bool x );
+MSGPACKF void msgpack_unchecked_pack_int8( msgpack_p *m, int8_t x );
+MSGPACKF void msgpack_unchecked_pack_int16( msgpack_p *m, int16_t x );
+MSGPACKF void msgpack_unchecked_pack_int32( msgpack_p *m, int32_t x );
+MSGPACKF void msgpack_unchecked_pack_int64( msgpack_p *m, int64_t x );
+MSGPACKF void msgpack_unchecked_pack_uint8( msgpack_p *m, uint8_t x );
+MSGPACKF void msgpack_unchecked_pack_uint16( msgpack_p *m, uint16_t x );
+MSGPACKF void msgpack_unchecked_pack_uint32( msgpack_p *m, uint32_t x );
+MSGPACKF void msgpack_unchecked_pack_uint64( msgpack_p *m, uint64_t x );
+MSGPACKF void msgpack_unchecked_pack_float( msgpack_p *m, float x );
+MSGPACKF void msgpack_unchecked_pack_double( msgpack_p *m, double x );
+MSGPACKF void msgpack_unchecked_pack_raw( msgpack_p* m, const void *data, uint32_t n );
+MSGPACKF void msgpack_unchecked_pack_array( msgpack_p* m, uint32_t n );
+MSGPACKF void msgpack_unchecked_pack_map( msgpack_p* m, uint32_t n );
 
 /* **************************************** UNPACKING FUNCTIONS **************************************** */
 MSGPACKF msgpack_u* msgpack_unpack_init( const void* data, uint32_t n, const int flags );
@@ -160,6 +500,19 @@ MSGPACKF msgpack_u* msgpack_unpack_init( const void* data, uint32_t n, const int
 if "flags" is non-zero, a copy of the data is made, else the data pointer is used directly and should not
 be free'd until after msgpack_unpack_free is called */
 
+MSGPACKF msgpack_u* msgpack_unpack_init_alloc( const void* data, uint32_t n, const int flags, const msgpack_alloc *a );
+/* creates an unpacker as for msgpack_unpack_init, taking all memory from the allocator "a" */
+
+MSGPACKF msgpack_u* msgpack_unpack_adopt( msgpack_buffer *b );
+/* creates an unpacker that takes ownership of a released buffer (see msgpack_pack_release) without copying it,
+leaving "b" empty. the buffer is freed with the unpacker. on failure NULL is returned and "b" is untouched */
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_init_fixed( msgpack_u *m, const void* data, uint32_t n );
+/* initialises a caller-owned unpacker (e.g. on the stack) to unpack the "n" byte buffer pointed to by "data"
+without allocating or copying. may be called again on the same object to switch to the next buffer, unless
+msgpack_unpack_append has since given it a buffer of its own: call msgpack_unpack_free first to release that
+buffer, which leaves the caller's object itself alone */
+
 MSGPACKF MSGPACK_ERR msgpack_unpack_free( msgpack_u *m );
 /* frees the unpacker object. the data buffer that was being unpacked can now be safely free'd */
 
@@ -171,7 +524,14 @@ MSGPACKF uint32_t msgpack_unpack_len( msgpack_u *m );
 /* return the number of bytes in the buffer remaining to be unpacked */
 
 MSGPACKF MSGPACK_ERR msgpack_unpack_append( msgpack_u *m, const void* data, const uint32_t n );
-/* appends more data to the end of the buffer for unpacking */
+/* appends more data to the end of the buffer for unpacking. the unpacker keeps one growable buffer,
+discarding the bytes already unpacked when it needs room, so positions from msgpack_unpack_getpos
+are only valid until the next append */
+
+MSGPACKF int msgpack_unpack_complete( const msgpack_u *m );
+/* STREAMING: returns the length of the next object if it is entirely in the buffer, without moving the
+unpacker; MSGPACK_NEEDMORE if more data must be appended first, or another error if it is malformed.
+unpacking functions also return MSGPACK_NEEDMORE for truncated objects and leave the buffer unchanged */
 
 MSGPACKF uint32_t msgpack_unpack_getpos( msgpack_u *m );
 /* get the position of the unpacker in the current bytestream */
@@ -197,17 +557,214 @@ MSGPACKF MSGPACK_ERR msgpack_unpack_uint32( msgpack_u *m, uint32_t *x );
 MSGPACKF MSGPACK_ERR msgpack_unpack_uint64( msgpack_u *m, uint64_t *x );
 MSGPACKF MSGPACK_ERR msgpack_unpack_float( msgpack_u *m, float *x );
 MSGPACKF MSGPACK_ERR msgpack_unpack_double( msgpack_u *m, double *x );
-MSGPACKF MSGPACK_ERR msgpack_unpack_raw( msgpack_u* m, const byte **data, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_raw( msgpack_u* m, const byte **data, uint32_t *n );   /* str or bin */
 MSGPACKF MSGPACK_ERR msgpack_unpack_str( msgpack_u* m, char *dest, uint32_t max );
+MSGPACKF MSGPACK_ERR msgpack_unpack_bin( msgpack_u* m, const byte **data, uint32_t *n );   /* bin only */
+MSGPACKF MSGPACK_ERR msgpack_unpack_ext( msgpack_u* m, int8_t *type, const byte **data, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_timestamp( msgpack_u* m, int64_t *sec, uint32_t *nsec );
 MSGPACKF MSGPACK_ERR msgpack_unpack_array( msgpack_u* m, uint32_t *n );
 MSGPACKF MSGPACK_ERR msgpack_unpack_map( msgpack_u* m, uint32_t *n );
 
+MSGPACKF MSGPACK_ERR msgpack_unpack_any( msgpack_u* m, msgpack_value *v );
+/* unpacks the next object whatever its type, with one lookup of the lead byte and one bounds check.
+integers are reported by sign rather than width, and raw, bin and ext payloads are pointers into
+the buffer. only the header of an array or map is consumed: its "n" elements (2*n for a map) follow.
+MSGPACK_TYPEERR for a reserved code; on any error the unpacker is left where it was */
+
 MSGPACKF int msgpack_unpack_skip( msgpack_u *m );
+MSGPACKF int msgpack_unpack_skip_depth( msgpack_u *m, uint32_t max_depth );
+/* skips the next object without recursing and returns its length in bytes. nesting deeper than
+"max_depth" (0 or MSGPACK_MAX_DEPTH at most) gives MSGPACK_DEPTHERR; on any error the unpacker is
+left where it was */
 
 MSGPACKF int msgpack_unpack_header( msgpack_u *m );
 /* EXTENSION: unpacks an unsigned int from the buffer and checks that it equals the length of the buffer.
 this provides a way to check whether arbitrary data is indeed a msgpack'd buffer */
 
+/* **************************************** VALIDATION **************************************** */
+MSGPACKF int msgpack_validate( const void *data, uint32_t n, uint32_t max_depth );
+/* walks the "n" byte buffer once, checking that every type code is valid, every header and payload
+fits in the buffer, every container is complete and nesting is no deeper than "max_depth" (0 selects
+MSGPACK_MAX_DEPTH, which is also the upper limit). returns the number of top-level objects, or
+MSGPACK_TYPEERR, MSGPACK_NEEDMORE or MSGPACK_DEPTHERR */
+
+/* the unchecked unpacking functions skip all bounds checks, so they are ONLY safe on a buffer that
+has passed msgpack_validate and must not be called once it is exhausted. type checking and conversion
+are as for the checked functions, so MSGPACK_TYPEERR may still be returned */
+MSGPACKF MSGPACK_ERR msgpack_unchecked_int8( msgpack_u *m, int8_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_int16( msgpack_u *m, int16_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_int32( msgpack_u *m, int32_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_int64( msgpack_u *m, int64_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_uint8( msgpack_u *m, uint8_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_uint16( msgpack_u *m, uint16_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_uint32( msgpack_u *m, uint32_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_uint64( msgpack_u *m, uint64_t *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_float( msgpack_u *m, float *x );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_double( msgpack_u *m, double *x );
+MSGPACKF int msgpack_unchecked_bool( msgpack_u *m );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_raw( msgpack_u* m, const byte **data, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_ext( msgpack_u* m, int8_t *type, const byte **data, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_array( msgpack_u* m, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unchecked_map( msgpack_u* m, uint32_t *n );
+
+/* **************************************** TAPE **************************************** */
+MSGPACKF MSGPACK_ERR msgpack_tape_parse( msgpack_tape *t, msgpack_u *m, uint32_t max_depth, const msgpack_alloc *a );
+/* parses the next object in the unpacker into a tape with a single allocation from "a" (NULL for malloc;
+an arena works well), then moves the unpacker past it. the tape points into the unpacker's buffer, so
+appending to a streaming unpacker invalidates it. errors are as for msgpack_unpack_skip_depth */
+MSGPACKF void msgpack_tape_free( msgpack_tape *t );
+
+MSGPACKF MSGPACK_ERR msgpack_tape_unpacker( const msgpack_tape *t, uint32_t i, msgpack_u *u );
+/* initialises a caller-owned unpacker at entry "i", so any of the unpacking functions decode it lazily */
+MSGPACKF MSGPACK_ERR msgpack_tape_raw( const msgpack_tape *t, uint32_t i, const byte **data, uint32_t *n );
+/* the payload of a raw, bin or ext entry, without decoding anything else */
+MSGPACKF uint32_t msgpack_tape_find( const msgpack_tape *t, uint32_t i, const void *key, uint32_t n );
+/* index of the value stored under the raw key "key" in the map at entry "i", jumping over the other values
+without looking inside them. returns 0 (which is always the root, never a value) if absent */
+
+/* **************************************** BULK ARRAYS **************************************** */
+/* pack "n" values from "x" as an array, choosing the same encoding for each element as the scalar
+functions. output is sized a block at a time rather than per element */
+MSGPACKF MSGPACK_ERR msgpack_pack_int8_array( msgpack_p *m, const int8_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_int16_array( msgpack_p *m, const int16_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_int32_array( msgpack_p *m, const int32_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_int64_array( msgpack_p *m, const int64_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_uint8_array( msgpack_p *m, const uint8_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_uint16_array( msgpack_p *m, const uint16_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_uint32_array( msgpack_p *m, const uint32_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_uint64_array( msgpack_p *m, const uint64_t *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_float_array( msgpack_p *m, const float *x, uint32_t n );
+MSGPACKF MSGPACK_ERR msgpack_pack_double_array( msgpack_p *m, const double *x, uint32_t n );
+
+/* unpack an array of at most "max" values into "x" and set "n" to its length. if the array is longer
+than "max", "n" is still set but MSGPACK_MEMERR is returned, so calling with max = 0 (and x = NULL)
+finds the length; "n" is 0 if there is no array header to read. on any error the unpacker is left where it was */
+MSGPACKF MSGPACK_ERR msgpack_unpack_int8_array( msgpack_u *m, int8_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_int16_array( msgpack_u *m, int16_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_int32_array( msgpack_u *m, int32_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_int64_array( msgpack_u *m, int64_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_uint8_array( msgpack_u *m, uint8_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_uint16_array( msgpack_u *m, uint16_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_uint32_array( msgpack_u *m, uint32_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_uint64_array( msgpack_u *m, uint64_t *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_float_array( msgpack_u *m, float *x, uint32_t max, uint32_t *n );
+MSGPACKF MSGPACK_ERR msgpack_unpack_double_array( msgpack_u *m, double *x, uint32_t max, uint32_t *n );
+
+/* **************************************** KEY INTERNING **************************************** */
+/* a key table serves one stream session. decoding, msgpack_unpack_key returns the same stable copy for
+every occurrence of a key, so repeated map keys are neither copied nor allocated again. encoding,
+msgpack_pack_key sends each key once as a KEYDEF extension holding its bytes, then as a KEYREF holding
+its id (the number of keys defined before it) in 1, 2 or 4 bytes, so a peer decoding with its own table
+sees the same ids. both ends must handle every key of the session, in order, through the functions
+below, and reset their tables together */
+MSGPACKF MSGPACK_ERR msgpack_intern_init( msgpack_intern *t, uint32_t max, const msgpack_alloc *a );
+/* initialise an empty table taking memory from "a" (NULL for malloc). "max" (0 for MSGPACK_INTERN_MAX)
+bounds the dictionary ids, and the plain-string keys interned while decoding; a decoder must allow at
+least as many ids as its encoder */
+MSGPACKF MSGPACK_ERR msgpack_intern_reset( msgpack_intern *t );
+/* forget every key and id, e.g. at the start of a new session. earlier key pointers become invalid */
+MSGPACKF MSGPACK_ERR msgpack_intern_free( msgpack_intern *t );
+MSGPACKF const char* msgpack_intern_str( msgpack_intern *t, const void *key, uint32_t n );
+/* return the table's copy of the "n" byte "key", adding it if new; NULL if out of memory */
+
+MSGPACKF MSGPACK_ERR msgpack_pack_key( msgpack_p *m, msgpack_intern *t, const void *key, uint32_t n );
+/* pack a map key through the dictionary "t". keys of under 3 bytes (which a KEYREF would not shorten),
+keys met once "max" ids are in use, and all keys with a NULL table or in compat mode are packed as
+plain str */
+MSGPACKF MSGPACK_ERR msgpack_unpack_key( msgpack_u *m, msgpack_intern *t, const char **key, uint32_t *n );
+/* unpack a map key written by msgpack_pack_key, or any str or bin, setting "key" to the table's
+NUL-terminated copy. once the table is full, new plain keys point into the buffer instead (and are
+not NUL-terminated). an undefined id or a repeated definition gives MSGPACK_TYPEERR, and a peer
+defining more than "max" ids MSGPACK_MEMERR; on any error the unpacker is left where it was */
+
+/* **************************************** RECORD BATCHES **************************************** */
+/* a record batch packs N records with the same fields column by column, as one MSGPACK_EXT_BATCH extension,
+so that field names and type codes are sent once per column instead of once per record. the payload is a
+sequence of objects: the number of rows, then for each column its name, type code and values. integer
+columns are bulk arrays, float and double columns a bin of big-endian values, and string columns an array
+of their distinct values followed by a uint array of indices into it */
+MSGPACKF MSGPACK_ERR msgpack_batch_begin( msgpack_batch_writer *w, msgpack_p *m, uint32_t nrows );
+/* start a batch of "nrows" records in "m", whose columns are then packed in place after an ext32 header
+patched when the batch ends. as with msgpack_pack_frame_begin, a packer with a sink must keep the whole
+batch buffered until it ends */
+MSGPACKF MSGPACK_ERR msgpack_batch_column( msgpack_batch_writer *w, const char *name, MSGPACK_TYPE_CODES type, const void *base, uint32_t stride );
+/* add the field "name" of every record, value i being read from base + i*stride as the C type of "type"
+(int8_t .. uint64_t, float, double, or a NUL-terminated const char* for MSGPACK_RAW). for an array of
+structs, pass &recs[0].field and sizeof( recs[0] ). on error the column is left out */
+MSGPACKF MSGPACK_ERR msgpack_batch_end( msgpack_batch_writer *w );
+/* patch the header and release the writer. on error the writer is released too, the partial batch being
+discarded as by msgpack_batch_cancel */
+MSGPACKF MSGPACK_ERR msgpack_batch_cancel( msgpack_batch_writer *w );
+/* release the writer and roll the packer back to where the batch began */
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_batch( msgpack_u *m, msgpack_batch *b, const msgpack_alloc *a );
+/* unpack a record batch, decoding each column into one array taken from "a" (NULL for malloc). names and
+strings point into the unpacker's buffer, which must outlive "b". on error the unpacker is left where it was */
+MSGPACKF const msgpack_column* msgpack_batch_find( const msgpack_batch *b, const char *name );
+/* the column called "name", or NULL */
+MSGPACKF MSGPACK_ERR msgpack_batch_pack_row( const msgpack_batch *b, uint32_t i, msgpack_p *m );
+/* pack record "i" as a map from field names to values, as it would have been sent without the batch, so
+code reading one record at a time can take it through an unpacker */
+MSGPACKF MSGPACK_ERR msgpack_batch_free( msgpack_batch *b );
+
+/* **************************************** COMPRESSION **************************************** */
+/* a byte-oriented LZ77 compressor, fast rather than thorough, for the repeated keys and headers of packed
+data. a compressed stream is a series of MSGPACK_EXT_LZ extensions, each holding the uncompressed length
+(4 bytes, big-endian) and then the compressed block, or the bytes themselves if they did not shrink.
+blocks are independent, so each can be decoded as soon as it arrives and they can be compressed on
+separate threads. the functions keep no state, and are safe to call from any number of threads */
+MSGPACKF uint32_t msgpack_lz_bound( uint32_t n );
+/* largest compressed size of "n" bytes, or 0 if "n" is too large for one block */
+MSGPACKF MSGPACK_ERR msgpack_lz_compress( const void *src, uint32_t n, void *dst, uint32_t max, uint32_t *out );
+MSGPACKF MSGPACK_ERR msgpack_lz_decompress( const void *src, uint32_t n, void *dst, uint32_t max, uint32_t *out );
+/* (de)compress the "n" bytes at "src" into at most "max" bytes at "dst", setting "out" to the bytes
+written (any of the "max" may be overwritten). MSGPACK_OVERFLOW if "dst" is too small, and
+MSGPACK_TYPEERR if decompressing corrupt data */
+
+MSGPACKF MSGPACK_ERR msgpack_pack_lz( msgpack_p *m, const void *data, uint32_t n );
+/* compress "n" bytes of (typically packed) data as one block. nothing is packed for n = 0 */
+MSGPACKF int msgpack_sink_lz( void *ctx, const byte *data, uint32_t n );
+/* sink compressing a packer's output into the packer given as "ctx", e.g.
+msgpack_pack_set_sink( m, msgpack_sink_lz, out, MSGPACK_LZ_BLOCK ); each flush becomes at least one block,
+none larger than MSGPACK_LZ_BLOCK. "out" may stream in turn, e.g. to msgpack_sink_file */
+MSGPACKF MSGPACK_ERR msgpack_unpack_lz( msgpack_u *m, msgpack_u *out );
+/* decompress the blocks in "m" onto the end of "out", leaving "m" empty. if the last block is incomplete,
+MSGPACK_NEEDMORE is returned with "m" at its start: append the rest to "m" and call again. a block that is
+not MSGPACK_EXT_LZ or is corrupt gives MSGPACK_TYPEERR, again leaving "m" at its start */
+
+/* **************************************** FRAMES **************************************** */
+/* a frame delimits one message, or a batch of them, for logs and byte streams. it is a MSGPACK_EXT_FRAME
+extension with a 32-bit length (so a reader unaware of frames can skip it), whose payload is a flags byte,
+the big-endian CRC32C of the body (0 without MSGPACK_FRAME_CRC) and the body. the header is reserved when
+the frame is begun and patched when it ends, so nothing is moved. a batch body is its messages followed by
+the big-endian uint32 offset of each and then their count. as with msgpack_pack_begin_array, a packer with
+a sink must keep the whole frame buffered until it ends, and referenced payloads are allowed */
+MSGPACKF uint32_t msgpack_crc32c( uint32_t crc, const void *data, uint32_t n );
+/* CRC32C (Castagnoli) of "n" bytes, continuing from "crc" (0 to start). built with SSE4.2 enabled (e.g.
+-msse4.2 or -march=native) it uses the crc32 instruction, otherwise a table */
+
+MSGPACKF MSGPACK_ERR msgpack_pack_frame_begin( msgpack_p *m, msgpack_mark *c );
+MSGPACKF MSGPACK_ERR msgpack_pack_frame_end( msgpack_p *m, const msgpack_mark *c, int flags );
+/* begin reserves the header of a frame holding whatever is packed until end, which fills in the length and,
+if "flags" has MSGPACK_FRAME_CRC, the checksum. MSGPACK_ARGERR if the header has been flushed */
+
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_begin( msgpack_frame_writer *w, msgpack_p *m, int flags );
+/* start a batch frame in "m", "flags" being MSGPACK_FRAME_CRC or 0 */
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_next( msgpack_frame_writer *w );
+/* start the next message, which is then packed into w->p. a message may be any number of objects */
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_end( msgpack_frame_writer *w );
+/* pack the offset table and patch the header. the writer is released, on error too, when the partial
+frame is discarded as by msgpack_frame_batch_cancel */
+MSGPACKF MSGPACK_ERR msgpack_frame_batch_cancel( msgpack_frame_writer *w );
+/* release the writer and roll the packer back to where the frame began */
+
+MSGPACKF MSGPACK_ERR msgpack_unpack_frame( msgpack_u *m, msgpack_frame *f );
+/* unpack the frame at the front of "m" without copying, checking its CRC and offset table. an incomplete
+frame gives MSGPACK_NEEDMORE, and a corrupt one or any other object MSGPACK_TYPEERR, leaving "m" where it
+was. "f" points into the unpacker's buffer, which must outlive it */
+MSGPACKF MSGPACK_ERR msgpack_frame_message( const msgpack_frame *f, uint32_t i, msgpack_u *u );
+/* point the caller's unpacker "u" at message "i" of the frame, as with msgpack_unpack_init_fixed */
+
 #ifdef MSGPACK_INLINE	/* compiling inline so include the source code */
 	#include "msgpackalt.c"
 #endif
@@ -29,6 +29,48 @@ http://code.google.com/p/msgpackalt
 	#include <cstdio>		/* snprintf */
 #endif
 #include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>			/* timespec */
+#ifdef MSGPACK_INLINE		/* system headers used by msgpackalt.c, included here outside the namespace */
+	#include <errno.h>
+	#include <limits.h>
+	#if !defined( MSGPACK_NO_SIMD ) && defined( __AVX2__ )
+		#include <immintrin.h>
+	#elif !defined( MSGPACK_NO_SIMD ) && defined( __SSSE3__ )
+		#include <tmmintrin.h>
+	#endif
+	#ifdef _WIN32
+		#include <io.h>
+	#else
+		#include <unistd.h>
+	#endif
+#endif
+
+#if ( __cplusplus >= 201103L ) || ( defined( _MSC_VER ) && _MSC_VER >= 1900 )
+	#define MSGPACK_CXX11	/* enable the features needing C++11 (thread_local, move semantics, ...) */
+	#include <chrono>
+	#if defined( MSGPACK_STL ) && !defined( MSGPACK_NO_THREADS )
+		#define MSGPACK_THREADS	/* compress blocks on several threads */
+		#include <thread>
+	#endif
+#endif
+
+#ifndef MSGPACK_PACKAGE_INLINE
+	#define MSGPACK_PACKAGE_INLINE	16	/* encodings up to this size are stored inside a package, without allocating */
+#endif
+
+#if !defined( MSGPACK_NO_EXCEPTIONS ) && ( defined( __cpp_exceptions ) || defined( __EXCEPTIONS ) || defined( _CPPUNWIND ))
+	#define MSGPACK_EXCEPTIONS	/* failures throw; otherwise they abort, so use the try_unpack functions */
+#endif
+#if defined( __GNUC__ )
+	#define MSGPACK_COLD __attribute__(( noinline, cold ))
+#elif defined( _MSC_VER )
+	#define MSGPACK_COLD __declspec( noinline )
+#else
+	#define MSGPACK_COLD
+#endif
 
 #ifdef _MSC_VER			/* visual c++ fixes */
 #define snprintf _snprintf
@@ -39,7 +81,7 @@ http://code.google.com/p/msgpackalt
 namespace msgpackalt {
 #include "msgpackalt.h"
 
-/// Takes the msgpackalt return code and throws a relevant exception on error 
+/// Throws a relevant exception for a failed msgpackalt call; kept out of line so the checks stay small
 /** The underlying msgpack C library returns negative values denoting failure.
  *	A different exception is thrown for each error type so errors can be trapped.
  *	
@@ -52,37 +94,305 @@ namespace msgpackalt {
  *	                    throws std::runtime_error
  *	MSGPACK_ARGERR:  function called with invalid argument
  *						throws std::invalid_argument
+ *	MSGPACK_OVERFLOW: a fixed-size buffer is full
+ *						throws std::overflow_error
+ *	MSGPACK_IOERR:   a streaming sink failed to accept data
+ *						throws std::runtime_error
+ *	MSGPACK_NEEDMORE: the buffer ends part-way through an object
+ *						throws std::underflow_error
+ *	MSGPACK_DEPTHERR: containers nested beyond the depth limit
+ *						throws std::length_error
  *	other error:     received negative return code, but unknown cause
  *						throws std::exception
+ *	
+ *	Built without exceptions, the error is instead passed to MSGPACK_ERROR_HANDLER( code, f ) if
+ *	defined, or printed before calling abort(). Use the try_unpack functions to handle failures.
  */	
-INLINE void msgpack_assert( MSGPACK_ERR code, const char* f )
+MSGPACK_COLD INLINE void msgpack_throw( MSGPACK_ERR code, const char* f )
 {
-	if ( code < MSGPACK_SUCCESS ) 	// error codes are negative
+#ifdef MSGPACK_EXCEPTIONS
+	char buffer[128];
+	if ( code == MSGPACK_TYPEERR )
 	{
-		char buffer[128];
-		if ( code == MSGPACK_TYPEERR )
-		{
-			snprintf( buffer, 128, "Unexpected type code in %s", f );
-			throw std::out_of_range(buffer);
-		} else if ( code == MSGPACK_MEMERR ) {
-			snprintf( buffer, 128, "Memory allocation/access error in %s", f );
-			throw std::runtime_error(buffer);
-		} else if ( code == MSGPACK_ARGERR ) {
-			snprintf( buffer, 128, "Invalid argument passed inside %s", f );
-			throw std::invalid_argument(buffer);
-		} else {
-			snprintf( buffer, 128, "Unknown error code %i during %s", code, f );
-			throw std::range_error(buffer);
-		}
+		snprintf( buffer, 128, "Unexpected type code in %s", f );
+		throw std::out_of_range(buffer);
+	} else if ( code == MSGPACK_MEMERR ) {
+		snprintf( buffer, 128, "Memory allocation/access error in %s", f );
+		throw std::runtime_error(buffer);
+	} else if ( code == MSGPACK_ARGERR ) {
+		snprintf( buffer, 128, "Invalid argument passed inside %s", f );
+		throw std::invalid_argument(buffer);
+	} else if ( code == MSGPACK_OVERFLOW ) {
+		snprintf( buffer, 128, "Fixed buffer overflow in %s", f );
+		throw std::overflow_error(buffer);
+	} else if ( code == MSGPACK_IOERR ) {
+		snprintf( buffer, 128, "Sink write error in %s", f );
+		throw std::runtime_error(buffer);
+	} else if ( code == MSGPACK_NEEDMORE ) {
+		snprintf( buffer, 128, "Incomplete object in %s", f );
+		throw std::underflow_error(buffer);
+	} else if ( code == MSGPACK_DEPTHERR ) {
+		snprintf( buffer, 128, "Nesting too deep in %s", f );
+		throw std::length_error(buffer);
+	} else {
+		snprintf( buffer, 128, "Unknown error code %i during %s", code, f );
+		throw std::range_error(buffer);
 	}
+#elif defined( MSGPACK_ERROR_HANDLER )
+	MSGPACK_ERROR_HANDLER( code, f );
+	abort( );
+#else
+	fprintf( stderr, "msgpackalt: %s in %s\n", msgpack_strerror( code ), f );
+	abort( );
+#endif
+}
+/// Takes the msgpackalt return code and throws a relevant exception on error (see msgpack_throw)
+INLINE void msgpack_assert( MSGPACK_ERR code, const char* f )
+{
+	if ( code < MSGPACK_SUCCESS ) msgpack_throw( code, f );	// error codes are negative
 }
 #define MSGPACK_ASSERT(x) msgpack_assert(x,__PRETTY_FUNCTION__)
 
+/// The fixed-width integer type with the size and signedness of "T", for the bulk array functions; void if "T" is not an integer
+/** int8_t..uint64_t are typedefs of some of the fundamental types, and which ones differs between platforms,
+ *	so every fundamental integer type is mapped here and e.g. char, long and long long reach the bulk path too. */
+template<class T> struct bulk_int { typedef void type; };
+template<size_t S, bool Signed> struct bulk_fixed { typedef void type; };
+template<> struct bulk_fixed<1, true> { typedef int8_t type; };
+template<> struct bulk_fixed<2, true> { typedef int16_t type; };
+template<> struct bulk_fixed<4, true> { typedef int32_t type; };
+template<> struct bulk_fixed<8, true> { typedef int64_t type; };
+template<> struct bulk_fixed<1, false> { typedef uint8_t type; };
+template<> struct bulk_fixed<2, false> { typedef uint16_t type; };
+template<> struct bulk_fixed<4, false> { typedef uint32_t type; };
+template<> struct bulk_fixed<8, false> { typedef uint64_t type; };
+#define MSGPACK_BULK_INT( T )	template<> struct bulk_int<T> : bulk_fixed<sizeof( T ), (( T )-1 < ( T )0 )> { };
+MSGPACK_BULK_INT( char )
+MSGPACK_BULK_INT( signed char )
+MSGPACK_BULK_INT( unsigned char )
+MSGPACK_BULK_INT( short )
+MSGPACK_BULK_INT( unsigned short )
+MSGPACK_BULK_INT( int )
+MSGPACK_BULK_INT( unsigned int )
+MSGPACK_BULK_INT( long )
+MSGPACK_BULK_INT( unsigned long )
+MSGPACK_BULK_INT( long long )
+MSGPACK_BULK_INT( unsigned long long )
+#undef MSGPACK_BULK_INT
+
+/// A value unpacked without throwing, or the code saying why it could not be. The error text is only looked up by what().
+template<class T> struct result {
+	T value;			///< The unpacked value, default-constructed on failure
+	MSGPACK_ERR error;	///< MSGPACK_SUCCESS or the (negative) reason for failure
+	
+	result( )							: value( ), error( MSGPACK_SUCCESS ) { }
+	/// True if the value was unpacked
+	bool ok( ) const					{ return error == MSGPACK_SUCCESS; }
+#ifdef MSGPACK_CXX11
+	explicit operator bool( ) const		{ return ok( ); }
+#endif
+	/// Description of the error, e.g. for logging
+	const char* what( ) const			{ return msgpack_strerror( error ); }
+	/// The value, or "x" if unpacking failed
+	const T& value_or( const T &x ) const	{ return ok( ) ? value : x; }
+	/// The value, raising the error (throw or abort) if unpacking failed
+	const T& get( ) const				{ MSGPACK_ASSERT( error ); return value; }
+};
+
+/// An object of any type, read with a single dispatch on its lead byte by unpacker::operator>>( value& )
+/** Integers are tagged by sign (MSGPACK_UINT64 or MSGPACK_INT64) and convert to any integer type they fit;
+ *	raw, bin and ext payloads point into the unpacker's buffer; arrays and maps hold only their counts,
+ *	their elements following in the stream. */
+class value : public msgpack_value {
+	public:
+		/// Default constructor: nil
+		value( )						{ type = MSGPACK_NULL; ext = 0; n = 0; v.u = 0; }
+		
+		bool is_nil( ) const			{ return type == MSGPACK_NULL; }
+		bool is_bool( ) const			{ return type == MSGPACK_BOOL; }
+		bool is_int( ) const			{ return ( type == MSGPACK_INT64 ) || ( type == MSGPACK_UINT64 ); }
+		bool is_float( ) const			{ return ( type == MSGPACK_FLOAT ) || ( type == MSGPACK_DOUBLE ); }
+		bool is_raw( ) const			{ return ( type == MSGPACK_RAW ) || ( type == MSGPACK_BIN ); }
+		bool is_ext( ) const			{ return type == MSGPACK_EXT; }
+		bool is_array( ) const			{ return type == MSGPACK_ARRAY; }
+		bool is_map( ) const			{ return type == MSGPACK_MAP; }
+		/// Payload of a raw, bin or ext
+		const byte* data( ) const		{ return ( is_raw( ) || is_ext( )) ? v.p : NULL; }
+		/// Payload bytes (raw, bin, ext) or element count (array, map pairs)
+		uint32_t size( ) const			{ return n; }
+		
+		/// Convert to "x" without throwing: MSGPACK_TYPEERR if the type differs or the number does not fit
+		MSGPACK_ERR try_get( bool &x ) const		{ if ( type != MSGPACK_BOOL ) return MSGPACK_TYPEERR; x = v.b != 0; return MSGPACK_SUCCESS; }
+		MSGPACK_ERR try_get( uint8_t &x ) const		{ return get_int( x ); }
+		MSGPACK_ERR try_get( uint16_t &x ) const	{ return get_int( x ); }
+		MSGPACK_ERR try_get( uint32_t &x ) const	{ return get_int( x ); }
+		MSGPACK_ERR try_get( uint64_t &x ) const	{ return get_int( x ); }
+		MSGPACK_ERR try_get( int8_t &x ) const		{ return get_int( x ); }
+		MSGPACK_ERR try_get( int16_t &x ) const		{ return get_int( x ); }
+		MSGPACK_ERR try_get( int32_t &x ) const		{ return get_int( x ); }
+		MSGPACK_ERR try_get( int64_t &x ) const		{ return get_int( x ); }
+		/// Floats widen to double; integers are converted too, as a value read generically is often either
+		MSGPACK_ERR try_get( double &x ) const	{
+			if ( is_float( )) x = v.d;
+			else if ( type == MSGPACK_UINT64 ) x = ( double )v.u;
+			else if ( type == MSGPACK_INT64 ) x = ( double )v.i;
+			else return MSGPACK_TYPEERR;
+			return MSGPACK_SUCCESS;
+		}
+		MSGPACK_ERR try_get( float &x ) const	{ double d; MSGPACK_ERR ret = try_get( d ); if ( ret == MSGPACK_SUCCESS ) x = ( float )d; return ret; }
+#ifdef MSGPACK_STL
+		MSGPACK_ERR try_get( std::string &x ) const	{ if ( !is_raw( )) return MSGPACK_TYPEERR; x.assign(( const char* )v.p, n ); return MSGPACK_SUCCESS; }
+#endif
+		/// Convert to T, raising MSGPACK_TYPEERR if it cannot be
+		template<class T> T get( ) const		{ T x = T( ); MSGPACK_ASSERT( try_get( x )); return x; }
+		/// True if the value converts to T
+		template<class T> bool holds( ) const	{ T x; return try_get( x ) == MSGPACK_SUCCESS; }
+#ifdef MSGPACK_CXX11
+		/// Call "f" with the value as its natural C++ type: nullptr, bool, int64_t, uint64_t or double, or else
+		/// the value itself for raw, bin, ext, array and map
+		template<class F> auto visit( F &&f ) const -> decltype( f( nullptr ))	{
+			switch ( type ) {
+				case MSGPACK_NULL:		return f( nullptr );
+				case MSGPACK_BOOL:		return f( v.b != 0 );
+				case MSGPACK_INT64:		return f( v.i );
+				case MSGPACK_UINT64:	return f( v.u );
+				case MSGPACK_FLOAT:
+				case MSGPACK_DOUBLE:	return f( v.d );
+				default:				return f( *this );
+			}
+		}
+#endif
+		
+	protected:
+		/// Range-checked integer conversion, so e.g. 300 is not read as an int8_t
+		template<class T> MSGPACK_ERR get_int( T &x ) const	{
+			T y;
+			if ( type == MSGPACK_UINT64 ) {
+				y = ( T )v.u;
+				if (( uint64_t )y != v.u || ( v.u && y < ( T )1 )) return MSGPACK_TYPEERR;
+			} else if ( type == MSGPACK_INT64 ) {
+				y = ( T )v.i;
+				if (( int64_t )y != v.i || !( y < ( T )1 )) return MSGPACK_TYPEERR;
+			} else return MSGPACK_TYPEERR;
+			x = y;
+			return MSGPACK_SUCCESS;
+		}
+};
+
+#ifdef MSGPACK_CXX11
+// ********************************* STRUCT REFLECTION *********************************
+/// Largest encoding of a value of type T, or 0 if it has no fixed bound
+template<class T, class = void> struct max_packed_size		{ static constexpr uint32_t value = 0; };
+template<> struct max_packed_size<bool>					{ static constexpr uint32_t value = 1; };
+template<> struct max_packed_size<int8_t>				{ static constexpr uint32_t value = 2; };
+template<> struct max_packed_size<uint8_t>				{ static constexpr uint32_t value = 2; };
+template<> struct max_packed_size<int16_t>				{ static constexpr uint32_t value = 3; };
+template<> struct max_packed_size<uint16_t>				{ static constexpr uint32_t value = 3; };
+template<> struct max_packed_size<int32_t>				{ static constexpr uint32_t value = 5; };
+template<> struct max_packed_size<uint32_t>				{ static constexpr uint32_t value = 5; };
+template<> struct max_packed_size<int64_t>				{ static constexpr uint32_t value = 9; };
+template<> struct max_packed_size<uint64_t>				{ static constexpr uint32_t value = 9; };
+template<> struct max_packed_size<float>				{ static constexpr uint32_t value = 5; };
+template<> struct max_packed_size<double>				{ static constexpr uint32_t value = 9; };
+/// Structs declared with MSGPACKALT_DEFINE whose fields all have fixed bounds
+template<class T> struct max_packed_size<T, decltype(( void )T::msgpack_max_size( ))>
+	{ static constexpr uint32_t value = T::msgpack_max_size( ); };
+
+/// Header size of an array of "n" elements
+constexpr uint32_t array_head_size( uint32_t n )	{ return n < 16 ? 1 : n < 65536 ? 3 : 5; }
+/// Total of max_packed_size over the types, if they are all bounded
+template<class... A> struct max_fields_size;
+template<> struct max_fields_size<> {
+	static constexpr bool bounded = true;
+	static constexpr uint32_t value = 0;
+};
+template<class T, class... R> struct max_fields_size<T,R...> {
+	static constexpr bool bounded = ( max_packed_size<T>::value > 0 ) && max_fields_size<R...>::bounded;
+	static constexpr uint32_t value = bounded ? max_packed_size<T>::value + max_fields_size<R...>::value : 0;
+};
+/// Largest encoding of an array holding one value of each type, or 0 if any of them is unbounded
+template<class... A> struct max_tuple_size {
+	static constexpr uint32_t value = max_fields_size<A...>::bounded ? array_head_size( sizeof...( A )) + max_fields_size<A...>::value : 0;
+};
+/// The field types of MSGPACKALT_DEFINE, deduced in an unevaluated context
+template<class... A> struct field_list		{ static constexpr uint32_t max_size = max_tuple_size<A...>::value; };
+template<class... A> field_list<A...> field_types( const A&... );
+
+/// Largest encoding of "x", from its type if that has a bound, else from its value; 0 if unknown
+template<class T> inline auto packed_bound_of( const T &x, int ) -> decltype( x.msgpack_bound( ))	{ return x.msgpack_bound( ); }
+template<class T> inline uint32_t packed_bound_of( const T&, long )	{ return max_packed_size<T>::value; }
+template<class T> inline uint32_t packed_bound( const T &x )			{ return packed_bound_of( x, 0 ); }
+#ifdef MSGPACK_STL
+inline uint32_t packed_bound( const std::string &s )					{ return 5 + ( uint32_t )s.size( ); }
+#endif
+inline bool fields_bound( uint32_t& )									{ return true; }
+template<class T, class... R> inline bool fields_bound( uint32_t &n, const T &x, const R&... r )
+	{ uint32_t k = packed_bound( x ); n += k; return k && fields_bound( n, r... ); }
+/// Largest encoding of the arguments packed as one array, or 0 if any of them is unbounded
+template<class... A> inline uint32_t tuple_bound( const A&... a )
+	{ uint32_t n = array_head_size( sizeof...( A )); return fields_bound( n, a... ) ? n : 0; }
+
+/// Declare the fields of a struct or class to pack and unpack as one array, e.g. MSGPACKALT_DEFINE( id, name, score )
+/** This gives the type operator<< and operator>> support through packer::pack_tuple and
+ *	unpacker::unpack_tuple, and a constexpr msgpack_max_size() that is non-zero when every field
+ *	has a fixed worst-case size. */
+#define MSGPACKALT_DEFINE( ... ) \
+	static constexpr uint32_t msgpack_max_size( )		{ return decltype( msgpackalt::field_types( __VA_ARGS__ ))::max_size; } \
+	uint32_t msgpack_bound( ) const						{ return msgpack_max_size( ) ? msgpack_max_size( ) : msgpackalt::tuple_bound( __VA_ARGS__ ); } \
+	void msgpack_pack( msgpackalt::packer &p ) const	{ p.pack_tuple( __VA_ARGS__ ); } \
+	void msgpack_unpack( msgpackalt::unpacker &u )		{ u.unpack_tuple( __VA_ARGS__ ); }
+#endif
+
+/// A key table for one stream session, see msgpack_pack_key and msgpack_unpack_key
+/** Decoding, every occurrence of a map key yields the same stable pointer, so keys can be
+ *	compared by address and are not copied again. Encoding, each key is sent once and then
+ *	referred to by a small id. Use one table per stream and direction, and reset() both ends together. */
+class key_table {
+	public:
+		/// an empty table allowing up to "max" dictionary ids (0 for MSGPACK_INTERN_MAX), taking memory from "a"
+		explicit key_table( uint32_t max = 0, const msgpack_alloc *a = NULL )	{ msgpack_intern_init( &this->t, max, a ); }
+		/// release every key; pointers returned by the table become invalid
+		~key_table( )							{ msgpack_intern_free( &this->t ); }
+		
+		/// forget every key and id to start a new session
+		void reset( )							{ msgpack_intern_reset( &this->t ); }
+		/// the table's NUL-terminated copy of the "n" byte "key", added if new
+		const char* intern( const void *key, uint32_t n )
+			{ const char *s = msgpack_intern_str( &this->t, key, n ); if ( !s ) MSGPACK_ASSERT( MSGPACK_MEMERR ); return s; }
+		const char* intern( const char *key )	{ return intern( key, ( uint32_t )strlen( key )); }
+		/// number of distinct keys held
+		uint32_t size( ) const					{ return this->t.n; }
+		/// number of keys defined in the stream's dictionary
+		uint32_t ids( ) const					{ return this->t.ndict; }
+		
+		/// return pointer to underlying C struct -- internal use only
+		msgpack_intern* ptr( )					{ return &this->t; }
+		
+	protected:
+		msgpack_intern t;
+		
+	private:
+		/// The table owns its keys, so prevent copies
+		key_table( const key_table& );
+		key_table& operator=( const key_table& );
+};
+
 /// The serialisation class which packs data in the MessagePack format
 class packer {
 	public:
 		/// default copy constructor; allocate a msgpack packer object
 		packer( )       	{ this->m = msgpack_pack_init( ); }
+		/// allocate the packer and its buffer from the given allocator, e.g. &arena.hooks
+		explicit packer( const msgpack_alloc *a )	{ this->m = msgpack_pack_init_alloc( a ); }
+		/// wrap a caller-owned packer struct, e.g. from msgpack_pack_init_buffer; only memory it owns is released
+		explicit packer( msgpack_p *caller )		{ this->m = caller; }
+#ifdef MSGPACK_CXX11
+		/// move constructor; "x" is left without a buffer and may only be assigned to or destroyed
+		packer( packer &&x )	{ this->m = x.m; x.m = NULL; }
+		/// move assignment, freeing this packer's own buffer
+		packer& operator=( packer &&x )
+			{ if ( this != &x ) { msgpack_pack_free( this->m ); this->m = x.m; x.m = NULL; } return *this; }
+#endif
 		/// default destructor; cleans up any allocated memory
 		~packer( )      	{ msgpack_pack_free( this->m ); this->m = NULL; }
 		
@@ -91,15 +401,28 @@ class packer {
 		
 		/// return the number of bytes packed so far
 		uint32_t len( ) const                   { return msgpack_get_len( this->m ); }
-		/// return a pointer to a copy of the data
-		void* duplicate( uint32_t &n ) const	{ n = len(); if ( n == 0 ) return NULL; void *x = malloc( n ); memcpy( x, m->buffer, n ); return x; }
+		/// return a pointer to a copy of the data, taken from the packer's allocator (release with msgpack_free)
+		void* duplicate( uint32_t &n ) const	{ n = len(); if ( n == 0 ) return NULL; void *x = msgpack_malloc( m->alloc, n ); if ( x ) msgpack_copy_to( m, x, n ); return x; }
+		/// hand over the packed buffer without copying and start again empty; pass it to an unpacker or msgpack_buffer_free
+		msgpack_buffer release( )				{ msgpack_buffer b; MSGPACK_ASSERT( msgpack_pack_release( this->m, &b )); return b; }
 		/// clears the contents of the internal buffer
-		void clear( )							{ if ( this->m ) m->p = m->buffer; }
+		void clear( )							{ msgpack_pack_reset( this->m ); }
+		/// return the number of bytes allocated for the buffer
+		uint32_t capacity( ) const				{ return this->m ? this->m->max : 0; }
+		/// grow the buffer once so that "n" more bytes can be packed without reallocating
+		void reserve( uint32_t n )				{ MSGPACK_ASSERT( msgpack_pack_reserve( this->m, n )); }
+		/// release buffer memory beyond "max" bytes (the packed contents are kept)
+		void shrink( uint32_t max )				{ MSGPACK_ASSERT( msgpack_pack_shrink( this->m, max )); }
 
 #ifdef MSGPACK_STL
 		/// return an STL string with the contents of the buffer
 		std::string string( ) const				{ const byte* b = NULL; uint32_t n = 0; MSGPACK_ASSERT( msgpack_get_buffer( this->m, &b, &n )); return std::string(( char* )b,n ); }
 #endif
+#ifdef MSGPACK_STL
+		/// return the packed message as a list of segments for writev/sendmsg, without copying referenced payloads
+		std::vector<msgpack_iovec> iovec( ) const
+			{ std::vector<msgpack_iovec> v( msgpack_get_iovcnt( this->m )); if ( v.empty( )) return v; int k = msgpack_get_iovec( this->m, &v[0], ( int )v.size( )); MSGPACK_ASSERT(( MSGPACK_ERR )k ); v.resize( k ); return v; }
+#endif
 #ifdef MSGPACK_QT
 		QByteArray string( ) const				{ const byte* b = NULL; uint32_t n = 0; MSGPACK_ASSERT( msgpack_get_buffer( this->m, &b, &n )); return QByteArray(( char* )b,n ); }
 #endif
@@ -108,6 +431,23 @@ class packer {
 		void start_array( uint32_t n )			{ MSGPACK_ASSERT( msgpack_pack_array( this->m, n )); }
 		/// LOW-LEVEL: specifies a map is to follow, with "n" sets of keys and values consisting of the next 2*n calls.
 		void start_map( uint32_t n )			{ MSGPACK_ASSERT( msgpack_pack_map( this->m, n )); }
+		/// LOW-LEVEL: starts an array whose size is not yet known; pass the mark and the element count to end_array.
+		msgpack_mark begin_array( )				{ msgpack_mark c; MSGPACK_ASSERT( msgpack_pack_begin_array( this->m, &c )); return c; }
+		/// LOW-LEVEL: fills in the element count of an array started with begin_array
+		void end_array( const msgpack_mark &c, uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_end_array( this->m, &c, n )); }
+		/// LOW-LEVEL: starts a map whose size is not yet known; pass the mark and the number of pairs to end_map.
+		msgpack_mark begin_map( )				{ msgpack_mark c; MSGPACK_ASSERT( msgpack_pack_begin_map( this->m, &c )); return c; }
+		/// LOW-LEVEL: fills in the pair count of a map started with begin_map
+		void end_map( const msgpack_mark &c, uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_end_map( this->m, &c, n )); }
+		/// Remember the current position, to discard anything packed after it with rollback
+		msgpack_mark checkpoint( ) const		{ msgpack_mark c; MSGPACK_ASSERT( msgpack_pack_checkpoint( this->m, &c )); return c; }
+		/// Discard everything packed since the checkpoint "c"
+		void rollback( const msgpack_mark &c )	{ MSGPACK_ASSERT( msgpack_pack_rollback( this->m, &c )); }
+		/// Start a frame holding whatever is packed until end_frame, see msgpack_pack_frame_begin
+		msgpack_mark begin_frame( )				{ msgpack_mark c; MSGPACK_ASSERT( msgpack_pack_frame_begin( this->m, &c )); return c; }
+		/// Close the frame started at "c", with the CRC32C of its contents unless "crc" is false
+		void end_frame( const msgpack_mark &c, bool crc = true )
+			{ MSGPACK_ASSERT( msgpack_pack_frame_end( this->m, &c, crc ? MSGPACK_FRAME_CRC : 0 )); }
 		
 		// *********************************** PACKING FUNCTIONS ***********************************
 		/// Pack a boolean value
@@ -135,17 +475,142 @@ class packer {
 		/// Pack a double (64-bit float)
 		packer& operator<<( const double &x )   { MSGPACK_ASSERT( msgpack_pack_double( this->m, x )); return *this; }
 		
+		/// Pack a value read by unpack_any; an array or map packs only its header, so copy its elements after it
+		packer& operator<<( const value &x )	{
+			switch ( x.type ) {
+				case MSGPACK_BOOL:		MSGPACK_ASSERT( msgpack_pack_bool( this->m, x.v.b != 0 )); break;
+				case MSGPACK_UINT64:	MSGPACK_ASSERT( msgpack_pack_uint64( this->m, x.v.u )); break;
+				case MSGPACK_INT64:		MSGPACK_ASSERT( msgpack_pack_int64( this->m, x.v.i )); break;
+				case MSGPACK_FLOAT:		MSGPACK_ASSERT( msgpack_pack_float( this->m, ( float )x.v.d )); break;
+				case MSGPACK_DOUBLE:	MSGPACK_ASSERT( msgpack_pack_double( this->m, x.v.d )); break;
+				case MSGPACK_RAW:		MSGPACK_ASSERT( msgpack_pack_raw( this->m, x.v.p, x.n )); break;
+				case MSGPACK_BIN:		MSGPACK_ASSERT( msgpack_pack_bin( this->m, x.v.p, x.n )); break;
+				case MSGPACK_EXT:		MSGPACK_ASSERT( msgpack_pack_ext( this->m, x.ext, x.v.p, x.n )); break;
+				case MSGPACK_ARRAY:		MSGPACK_ASSERT( msgpack_pack_array( this->m, x.n )); break;
+				case MSGPACK_MAP:		MSGPACK_ASSERT( msgpack_pack_map( this->m, x.n )); break;
+				default:				MSGPACK_ASSERT( msgpack_pack_null( this->m )); break;
+			}
+			return *this;
+		}
+		
+		/// Pack a timespec as a timestamp
+		packer& operator<<( const timespec &t )	{ MSGPACK_ASSERT( msgpack_pack_timestamp( this->m, t.tv_sec, ( uint32_t )t.tv_nsec )); return *this; }
+#ifdef MSGPACK_CXX11
+		/// Pack a std::chrono time point as a timestamp, taking the clock's epoch as 1970-01-01 UTC
+		template<class C, class D> packer& operator<<( const std::chrono::time_point<C,D> &t ) {
+			const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>( t.time_since_epoch( ));
+			std::chrono::nanoseconds ns = std::chrono::duration_cast<std::chrono::nanoseconds>( t.time_since_epoch( ) - s );
+			int64_t sec = s.count( );
+			if ( ns.count( ) < 0 ) { ns += std::chrono::seconds( 1 ); --sec; }	/* round down before the epoch */
+			MSGPACK_ASSERT( msgpack_pack_timestamp( this->m, sec, ( uint32_t )ns.count( )));
+			return *this;
+		}
+#endif
+		
 		/// Pack a C-style string as raw data
 		packer& operator<<( const char *s )
 			{ MSGPACK_ASSERT( msgpack_pack_str( this->m, s )); return *this; }
 		/// Pack "n" bytes of raw data specified by the given pointer
 		packer& pack_raw( const void* data, const uint32_t n )
 			{ MSGPACK_ASSERT( msgpack_pack_raw( this->m, ( const byte* )data, n )); return *this; }
+		/// Pack "n" bytes of raw data by reference: the data is not copied and must outlive the packed output
+		packer& pack_raw_ref( const void* data, const uint32_t n )
+			{ MSGPACK_ASSERT( msgpack_pack_raw_ref( this->m, data, n )); return *this; }
+		/// Pack "n" bytes of binary (as opposed to text) data
+		packer& pack_bin( const void* data, const uint32_t n )
+			{ MSGPACK_ASSERT( msgpack_pack_bin( this->m, data, n )); return *this; }
+		/// Pack "n" bytes of data as the application-defined extension "type"
+		packer& pack_ext( int8_t type, const void* data, const uint32_t n )
+			{ MSGPACK_ASSERT( msgpack_pack_ext( this->m, type, data, n )); return *this; }
+		/// Pack a map key through the key dictionary "t": its bytes the first time, a small id after that
+		packer& pack_key( key_table &t, const void *key, const uint32_t n )
+			{ MSGPACK_ASSERT( msgpack_pack_key( this->m, t.ptr( ), key, n )); return *this; }
+		packer& pack_key( key_table &t, const char *key )
+			{ return pack_key( t, key, ( uint32_t )strlen( key )); }
+#ifdef MSGPACK_STL
+		packer& pack_key( key_table &t, const std::string &key )
+			{ return pack_key( t, key.data( ), ( uint32_t )key.size( )); }
+#endif
+		/// Emit only the formats understood by legacy peers (no str8, bin or ext)
+		void set_compat( bool legacy )			{ MSGPACK_ASSERT( msgpack_pack_set_compat( this->m, legacy )); }
+		/// Pack raw data of at least "threshold" bytes by reference from now on (0 to stop)
+		void set_zerocopy( uint32_t threshold )	{ MSGPACK_ASSERT( msgpack_pack_set_zerocopy( this->m, threshold )); }
+		
+		/// STREAMING: send the output to "fn" whenever "watermark" bytes are buffered (0 = the buffer size). call flush() when done
+		void set_sink( msgpack_sink_fn fn, void *ctx, uint32_t watermark = 0 )
+			{ MSGPACK_ASSERT( msgpack_pack_set_sink( this->m, fn, ctx, watermark )); }
+		/// STREAMING: write the output to a stdio stream
+		void set_sink( FILE *fp, uint32_t watermark = 0 )	{ set_sink( msgpack_sink_file, fp, watermark ); }
+		/// STREAMING: write the output to a file descriptor
+		void set_sink_fd( int fd, uint32_t watermark = 0 )	{ set_sink( msgpack_sink_fd, ( void* )( intptr_t )fd, watermark ); }
+		/// STREAMING: hand all buffered bytes to the sink
+		void flush( )							{ MSGPACK_ASSERT( msgpack_pack_flush( this->m )); }
+		/// STREAMING: total bytes packed, including those already flushed
+		uint64_t total( ) const					{ return msgpack_pack_total( this->m ); }
+		/// STREAMING: compress the output into "out" a block at a time; flush() this packer, then "out" if it streams too
+		void set_compression( packer &out, uint32_t block = MSGPACK_LZ_BLOCK )	{ set_sink( msgpack_sink_lz, out.m, block ); }
+		
+		/// Compress "n" bytes of packed data in independent blocks of "block" bytes, spread over up to "threads" threads
+		packer& pack_compressed( const void *data, uint32_t n, unsigned threads = 1, uint32_t block = MSGPACK_LZ_BLOCK )	{
+			const byte *p = ( const byte* )data;
+			if ( !block || ( !data && n )) MSGPACK_ASSERT( MSGPACK_ARGERR );
+			const uint32_t nb = n/block + ( n % block != 0 );
+			MSGPACK_ERR ret = MSGPACK_SUCCESS;
+#ifdef MSGPACK_THREADS
+			if (( threads > 1 ) && ( nb > 1 )) {
+				if ( threads > nb ) threads = nb;
+				std::vector<msgpack_p*> part( threads );	// each thread packs a contiguous run of blocks
+				std::vector<MSGPACK_ERR> err( threads, MSGPACK_SUCCESS );
+				std::vector<std::thread> pool;
+				for ( unsigned t = 0; t < threads; ++t ) if ( !( part[t] = msgpack_pack_init( ))) err[t] = MSGPACK_MEMERR;
+				for ( unsigned t = 1; t < threads; ++t ) {
+					const uint32_t b0 = ( uint32_t )(( uint64_t )t*nb/threads ), b1 = ( uint32_t )(( uint64_t )( t + 1 )*nb/threads );
+	#ifdef MSGPACK_EXCEPTIONS
+					try { pool.push_back( std::thread( compress_blocks, part[t], p, n, block, b0, b1, &err[t] )); }
+					catch ( ... ) { compress_blocks( part[t], p, n, block, b0, b1, &err[t] ); }	// no thread to spare
+	#else
+					pool.push_back( std::thread( compress_blocks, part[t], p, n, block, b0, b1, &err[t] ));
+	#endif
+				}
+				compress_blocks( part[0], p, n, block, 0, nb/threads, &err[0] );
+				for ( size_t t = 0; t < pool.size( ); ++t ) pool[t].join( );
+				for ( unsigned t = 0; t < threads; ++t ) {
+					if ( !ret ) ret = err[t] ? err[t] : msgpack_pack_append( this->m, part[t]->buffer, msgpack_get_len( part[t] ));
+					if ( part[t] ) msgpack_pack_free( part[t] );
+				}
+				MSGPACK_ASSERT( ret );
+				return *this;
+			}
+#else
+			( void )threads;
+#endif
+			compress_blocks( this->m, p, n, block, 0, nb, &ret );
+			MSGPACK_ASSERT( ret );
+			return *this;
+		}
 		/// Pack the "null" object
 		packer& pack_null( )
 			{ MSGPACK_ASSERT( msgpack_pack_null( this->m )); return *this; }
-		/// Pack a C-style array of "n" points starting at the pointer "v"
+		/// Pack a C-style array of "n" points starting at the pointer "v"; integers of any type are packed in bulk
 		template<class T> packer& pack_array( const T* v, const uint32_t n )
+			{ return this->pack_array_as( v, n, ( typename bulk_int<T>::type* )NULL ); }
+		/// Pack numeric arrays in bulk
+		packer& pack_array( const int8_t* v, const uint32_t n )		{ MSGPACK_ASSERT( msgpack_pack_int8_array( this->m, v, n )); return *this; }
+		packer& pack_array( const int16_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_int16_array( this->m, v, n )); return *this; }
+		packer& pack_array( const int32_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_int32_array( this->m, v, n )); return *this; }
+		packer& pack_array( const int64_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_int64_array( this->m, v, n )); return *this; }
+		packer& pack_array( const uint8_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_uint8_array( this->m, v, n )); return *this; }
+		packer& pack_array( const uint16_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_uint16_array( this->m, v, n )); return *this; }
+		packer& pack_array( const uint32_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_uint32_array( this->m, v, n )); return *this; }
+		packer& pack_array( const uint64_t* v, const uint32_t n )	{ MSGPACK_ASSERT( msgpack_pack_uint64_array( this->m, v, n )); return *this; }
+		packer& pack_array( const float* v, const uint32_t n )		{ MSGPACK_ASSERT( msgpack_pack_float_array( this->m, v, n )); return *this; }
+		packer& pack_array( const double* v, const uint32_t n )		{ MSGPACK_ASSERT( msgpack_pack_double_array( this->m, v, n )); return *this; }
+		
+		/// pack_array for an integer type that is none of int8_t..uint64_t, through the one of the same size and sign
+		template<class T, class U> packer& pack_array_as( const T* v, const uint32_t n, U* )
+			{ return this->pack_array(( const U* )( const void* )v, n ); }
+		/// pack_array for other types, one element at a time
+		template<class T> packer& pack_array_as( const T* v, const uint32_t n, void* )
 			{ this->start_array( n ); for ( uint32_t i = 0; i < n; ++i ) *this << v[i]; return *this; }
 		
 		uint32_t append( const void* ptr, uint32_t n )
@@ -160,7 +625,7 @@ class packer {
 			{ this->pack_raw( s.data( ), s.size( )); return *this; }
 		/// Pack an STL vector of any valid type
 		template<class T> packer& operator<<( const std::vector<T> &v )
-			{ return this->pack_array( &v[0], v.size( )); }
+			{ return this->pack_array( v.empty( ) ? NULL : &v[0], v.size( )); }
 		/// Pack an STL map between any valid types
 		template<class T, class U> packer& operator<<( const std::map<T,U> &v )
 			{ this->start_map( v.size()); for ( typename std::map<T,U>::const_iterator i = v.begin(); i != v.end(); ++i ) *this << i->first << i->second; return *this; }
@@ -177,10 +642,55 @@ class packer {
 			{ this->start_map( v.size()); QMapIterator<T,U> i(v); while ( i.hasNext( )) { i.next(); *this << i.key() << i.value(); } return *this; }
 #endif
 			
+#ifdef MSGPACK_CXX11
+		/// Pack the arguments as one array. When they are all bounded, the header is a compile-time
+		/// constant, room is reserved once and the fields are written without capacity checks.
+		template<class... A> packer& pack_tuple( const A&... a )	{
+			const uint32_t n = max_tuple_size<A...>::value ? max_tuple_size<A...>::value : tuple_bound( a... );
+			if ( !n ) { start_array( sizeof...( A )); pack_fields( a... ); return *this; }
+			reserve( n );
+			if ( sizeof...( A ) < 16 ) { *this->m->p = ( byte )( 0x90 | sizeof...( A )); ++this->m->p; }
+			else msgpack_unchecked_pack_array( this->m, sizeof...( A ));
+			put_fields( a... );
+			return *this;
+		}
+		/// Pack any type declared with MSGPACKALT_DEFINE
+		template<class T> auto operator<<( const T &x ) -> decltype( x.msgpack_pack( *this ), *this )
+			{ x.msgpack_pack( *this ); return *this; }
+#endif
+			
 	protected:
 		/// Underlying C packer object
 		msgpack_p *m;
 		friend class unpacker;
+		/// Compress blocks [b0,b1) of the "n" bytes at "p" into "out"
+		static void compress_blocks( msgpack_p *out, const byte *p, uint32_t n, uint32_t block, uint32_t b0, uint32_t b1, MSGPACK_ERR *err )	{
+			for ( uint32_t i = b0; ( i < b1 ) && !*err; ++i )
+				*err = msgpack_pack_lz( out, p + ( size_t )i*block, ( n - i*block < block ) ? n - i*block : block );
+		}
+#ifdef MSGPACK_CXX11
+		void pack_fields( )		{ }
+		template<class T, class... R> void pack_fields( const T &x, const R&... r )	{ *this << x; pack_fields( r... ); }
+		/// Write fields whose room pack_tuple has reserved
+		void put_fields( )		{ }
+		template<class T, class... R> void put_fields( const T &x, const R&... r )	{ put( x ); put_fields( r... ); }
+		void put( bool x )				{ msgpack_unchecked_pack_bool( this->m, x ); }
+		void put( const uint8_t &x )	{ msgpack_unchecked_pack_uint8( this->m, x ); }
+		void put( const uint16_t &x )	{ msgpack_unchecked_pack_uint16( this->m, x ); }
+		void put( const uint32_t &x )	{ msgpack_unchecked_pack_uint32( this->m, x ); }
+		void put( const uint64_t &x )	{ msgpack_unchecked_pack_uint64( this->m, x ); }
+		void put( const int8_t &x )		{ msgpack_unchecked_pack_int8( this->m, x ); }
+		void put( const int16_t &x )	{ msgpack_unchecked_pack_int16( this->m, x ); }
+		void put( const int32_t &x )	{ msgpack_unchecked_pack_int32( this->m, x ); }
+		void put( const int64_t &x )	{ msgpack_unchecked_pack_int64( this->m, x ); }
+		void put( const float &x )		{ msgpack_unchecked_pack_float( this->m, x ); }
+		void put( const double &x )		{ msgpack_unchecked_pack_double( this->m, x ); }
+#ifdef MSGPACK_STL
+		void put( const std::string &s )	{ msgpack_unchecked_pack_raw( this->m, s.data( ), ( uint32_t )s.size( )); }
+#endif
+		/// Nested structs check their (already reserved) room once and then write unchecked too
+		template<class T> void put( const T &x )	{ *this << x; }
+#endif
 	
 	private:
 		/// Pointers are not reference counted, so prevent automatic copies. Use the << operator to append instead.
@@ -191,22 +701,44 @@ class packer {
 class unpacker {
 	public:
 		/// Default constructor: start with the empty string
-		unpacker( )
+		unpacker( ) : owned( true )
 			{ this->u = msgpack_unpack_init( NULL, 0, true ); }
 		/// Create unpacker from a raw block of memory
-		unpacker( const byte *buffer, uint32_t len, bool copy = true )
+		unpacker( const byte *buffer, uint32_t len, bool copy = true ) : owned( true )
 			{ this->u = msgpack_unpack_init( buffer, len, copy ); }
+		/// Create unpacker taking all memory from the given allocator, e.g. &arena.hooks
+		unpacker( const byte *buffer, uint32_t len, bool copy, const msgpack_alloc *a ) : owned( true )
+			{ this->u = msgpack_unpack_init_alloc( buffer, len, copy, a ); }
+		/// Wrap a caller-owned unpacker struct, e.g. from msgpack_unpack_init_fixed, so reading allocates nothing.
+		/// The struct is never freed here: if msgpack_unpack_append gave it a buffer, release that with msgpack_unpack_free
+		explicit unpacker( msgpack_u *caller ) : owned( false )
+			{ this->u = caller; }
+		/// Take ownership of a buffer released from a packer, without copying it; "b" is left empty
+		explicit unpacker( msgpack_buffer &b ) : owned( true )
+			{ this->u = msgpack_unpack_adopt( &b ); if ( !this->u ) MSGPACK_ASSERT( MSGPACK_MEMERR ); }
+#ifdef MSGPACK_CXX11
+		/// Adopt a buffer straight from packer::release()
+		explicit unpacker( msgpack_buffer &&b ) : owned( true )
+			{ this->u = msgpack_unpack_adopt( &b ); if ( !this->u ) { msgpack_buffer_free( &b ); MSGPACK_ASSERT( MSGPACK_MEMERR ); } }
+		/// Move constructor; "x" is left empty and may only be assigned to or destroyed
+		unpacker( unpacker &&x ) : owned( x.owned )
+			{ this->u = x.u; x.u = NULL; }
+		/// Move assignment, freeing this unpacker's own buffer
+		unpacker& operator=( unpacker &&x )
+			{ if ( this != &x ) { if ( this->u && this->owned ) msgpack_unpack_free( this->u ); this->u = x.u; this->owned = x.owned; x.u = NULL; } return *this; }
+#endif
 #ifdef MSGPACK_STL
-		unpacker( const std::string &str )
-			{ this->u = msgpack_unpack_init(( const byte* )str.data(), str.size(), true ); }
+		/// Unpack a string, by default from a copy; with copy=false the string must outlive the unpacker and stay unchanged
+		unpacker( const std::string &str, bool copy = true ) : owned( true )
+			{ this->u = msgpack_unpack_init(( const byte* )str.data(), str.size(), copy ); }
 #endif
 #ifdef MSGPACK_QT
-		unpacker( const QByteArray &data )
+		unpacker( const QByteArray &data ) : owned( true )
 			{ this->u = msgpack_unpack_init(( const byte* )data.data(), data.size(), true ); }
 #endif
 		/// Default destructor
 		~unpacker( )
-			{ if ( this->u ) msgpack_unpack_free( this->u ); this->u = NULL; }
+			{ if ( this->u && this->owned ) msgpack_unpack_free( this->u ); this->u = NULL; }
 		
 		/// Return pointer to underlying struct -- internal use only
 		const byte* ptr( )						{ return this->u->p; }
@@ -215,8 +747,12 @@ class unpacker {
 		uint32_t len( ) const                   { return msgpack_unpack_len( this->u ); }
 		/// Return the code of the next item to unpack
 		int peek( ) const        				{ return msgpack_unpack_peek( this->u ); }
-		/// Skip the next item in the buffer and return the number of bytes skipped
-		int skip( )								{ return msgpack_unpack_skip( this->u ); }
+		/// Skip the next item in the buffer and return the number of bytes skipped (or an error code)
+		int skip( uint32_t max_depth = 0 )		{ return msgpack_unpack_skip_depth( this->u, max_depth ); }
+		/// STREAMING: return the length of the next item if it is all in the buffer, else MSGPACK_NEEDMORE (or another error code)
+		int complete( ) const					{ return msgpack_unpack_complete( this->u ); }
+		/// Check the rest of the buffer in one pass; return the number of objects left, or an error code
+		int validate( uint32_t max_depth = 0 ) const	{ return msgpack_validate( this->u->p, ( uint32_t )( this->u->end - this->u->p ), max_depth ); }
 		/// Move the unpacker back to the start of the buffer
 		void restart( )							{ msgpack_unpack_setpos( this->u, 0 ); }
 		
@@ -226,6 +762,10 @@ class unpacker {
 		/// Append data to the end of the buffer, e.g. streaming data, and return the total size of the buffer (not necessarily bytes remaining to be unpacked)
 		uint32_t append( const byte *data, uint32_t len )
 			{ MSGPACK_ASSERT( msgpack_unpack_append( this->u, data, len )); return this->u->max; }
+		/// Decompress the blocks in "in" (from packer::pack_compressed or set_compression) onto the end of this buffer.
+		/// Returns false if "in" ends part way through a block, which is kept until more is appended to "in"
+		bool inflate( unpacker &in )
+			{ MSGPACK_ERR ret = msgpack_unpack_lz( in.u, this->u ); if ( ret == MSGPACK_NEEDMORE ) return false; MSGPACK_ASSERT( ret ); return true; }
 		/// Throw away the current buffer and copy the given data
 		void set( const byte *data, uint32_t len )
 			{ this->clear( ); this->append( data, len ); }
@@ -267,13 +807,40 @@ class unpacker {
 		/// Unpack a U8 value
 		unpacker& operator>>( double &x )       { MSGPACK_ASSERT( msgpack_unpack_double( this->u, &x )); return *this; }
 		
+		/// Unpack the next object whatever its type
+		unpacker& operator>>( value &x )		{ MSGPACK_ASSERT( msgpack_unpack_any( this->u, &x )); return *this; }
+		
+		/// Unpack a timestamp into a timespec
+		unpacker& operator>>( timespec &t )
+			{ int64_t s = 0; uint32_t ns = 0; MSGPACK_ASSERT( msgpack_unpack_timestamp( this->u, &s, &ns )); t.tv_sec = ( time_t )s; t.tv_nsec = ns; return *this; }
+#ifdef MSGPACK_CXX11
+		/// Unpack a timestamp into a std::chrono time point (truncated to its duration)
+		template<class C, class D> unpacker& operator>>( std::chrono::time_point<C,D> &t ) {
+			int64_t s = 0; uint32_t ns = 0;
+			MSGPACK_ASSERT( msgpack_unpack_timestamp( this->u, &s, &ns ));
+			t = std::chrono::time_point<C,D>( std::chrono::duration_cast<D>( std::chrono::seconds( s ) + std::chrono::nanoseconds( ns )));
+			return *this;
+		}
+#endif
+		
 #ifdef MSGPACK_STL
 		/// Unpack raw data into a std::string
 		unpacker& operator>>( std::string &s )
 			{ uint32_t n = 0; const void* b = unpack_raw( n ); s = std::string(( const char* )b, n ); return *this; }
-		/// Unpack a vector of homogeneous (single typed) data into the given STL vector
+		/// Unpack a vector of homogeneous (single typed) data into the given STL vector; integers of any type are unpacked in bulk
 		template<class T> unpacker& operator>>( std::vector<T> &v )
-			{ uint32_t n = start_array( ); T x; v.clear( ); for ( uint32_t i = 0; i < n; ++i ) { *this >> x; v.push_back( x ); } return *this; }
+			{ return this->unpack_vector_as( v, ( typename bulk_int<T>::type* )NULL ); }
+		/// Unpack numeric vectors in bulk
+		unpacker& operator>>( std::vector<int8_t> &v )		{ return unpack_vector( v, msgpack_unpack_int8_array ); }
+		unpacker& operator>>( std::vector<int16_t> &v )		{ return unpack_vector( v, msgpack_unpack_int16_array ); }
+		unpacker& operator>>( std::vector<int32_t> &v )		{ return unpack_vector( v, msgpack_unpack_int32_array ); }
+		unpacker& operator>>( std::vector<int64_t> &v )		{ return unpack_vector( v, msgpack_unpack_int64_array ); }
+		unpacker& operator>>( std::vector<uint8_t> &v )		{ return unpack_vector( v, msgpack_unpack_uint8_array ); }
+		unpacker& operator>>( std::vector<uint16_t> &v )	{ return unpack_vector( v, msgpack_unpack_uint16_array ); }
+		unpacker& operator>>( std::vector<uint32_t> &v )	{ return unpack_vector( v, msgpack_unpack_uint32_array ); }
+		unpacker& operator>>( std::vector<uint64_t> &v )	{ return unpack_vector( v, msgpack_unpack_uint64_array ); }
+		unpacker& operator>>( std::vector<float> &v )		{ return unpack_vector( v, msgpack_unpack_float_array ); }
+		unpacker& operator>>( std::vector<double> &v )		{ return unpack_vector( v, msgpack_unpack_double_array ); }
 		/// Unpack a map object with key and value types given by the STL map
 		template<class T, class U> unpacker& operator>>( std::map<T,U> &v )
 			{ uint32_t n = start_map( ); T x; U y; v.clear( ); for ( uint32_t i = 0; i < n; ++i ) { *this >> x >> y; v.insert( std::pair<T,U>( x,y )); } return *this; }
@@ -296,40 +863,235 @@ class unpacker {
 		uint32_t start_map( )		{ uint32_t n; MSGPACK_ASSERT( msgpack_unpack_map( this->u, &n )); return n; }
 		
 		const void* unpack_raw( uint32_t &n )	{ const byte* b; MSGPACK_ASSERT( msgpack_unpack_raw( this->u, &b, &n )); return b; }
+		const void* unpack_bin( uint32_t &n )	{ const byte* b; MSGPACK_ASSERT( msgpack_unpack_bin( this->u, &b, &n )); return b; }
+		/// Unpack a map key written by packer::pack_key (or any str or bin), returning the table's stable copy of its "n" bytes
+		const char* unpack_key( key_table &t, uint32_t &n )
+			{ const char *k; MSGPACK_ASSERT( msgpack_unpack_key( this->u, t.ptr( ), &k, &n )); return k; }
+		const char* unpack_key( key_table &t )	{ uint32_t n; return unpack_key( t, n ); }
+		/// Non-throwing unpack_key
+		MSGPACK_ERR try_unpack_key( key_table &t, const char *&k, uint32_t &n )
+			{ return msgpack_unpack_key( this->u, t.ptr( ), &k, &n ); }
+		/// Unpack an extension object, returning a pointer to its "n" data bytes and setting its "type"
+		const void* unpack_ext( int8_t &type, uint32_t &n )	{ const byte* b; MSGPACK_ASSERT( msgpack_unpack_ext( this->u, &type, &b, &n )); return b; }
+		/// Unpack a frame in place, checking its CRC; see msgpack_unpack_frame and frame_view
+		msgpack_frame unpack_frame( )			{ msgpack_frame f; MSGPACK_ASSERT( msgpack_unpack_frame( this->u, &f )); return f; }
+		/// Non-throwing unpack_frame, giving MSGPACK_NEEDMORE while the frame is incomplete
+		MSGPACK_ERR try_unpack_frame( msgpack_frame &f )	{ return msgpack_unpack_frame( this->u, &f ); }
+		
+		// ********************************* NON-THROWING UNPACKING *********************************
+		/// Unpack the next object if it has the type of "x", else return the error code. Nothing is thrown or
+		/// formatted, and on failure the unpacker does not move, so another type can be tried cheaply.
+		MSGPACK_ERR try_unpack( bool &b )
+			{ int x = msgpack_unpack_bool( this->u ); if ( x < 0 ) return ( MSGPACK_ERR )x; b = x > 0; return MSGPACK_SUCCESS; }
+		MSGPACK_ERR try_unpack( uint8_t &x )	{ return msgpack_unpack_uint8( this->u, &x ); }
+		MSGPACK_ERR try_unpack( uint16_t &x )	{ return msgpack_unpack_uint16( this->u, &x ); }
+		MSGPACK_ERR try_unpack( uint32_t &x )	{ return msgpack_unpack_uint32( this->u, &x ); }
+		MSGPACK_ERR try_unpack( uint64_t &x )	{ return msgpack_unpack_uint64( this->u, &x ); }
+		MSGPACK_ERR try_unpack( int8_t &x )		{ return msgpack_unpack_int8( this->u, &x ); }
+		MSGPACK_ERR try_unpack( int16_t &x )	{ return msgpack_unpack_int16( this->u, &x ); }
+		MSGPACK_ERR try_unpack( int32_t &x )	{ return msgpack_unpack_int32( this->u, &x ); }
+		MSGPACK_ERR try_unpack( int64_t &x )	{ return msgpack_unpack_int64( this->u, &x ); }
+		MSGPACK_ERR try_unpack( float &x )		{ return msgpack_unpack_float( this->u, &x ); }
+		MSGPACK_ERR try_unpack( double &x )		{ return msgpack_unpack_double( this->u, &x ); }
+		MSGPACK_ERR try_unpack( value &x )		{ return msgpack_unpack_any( this->u, &x ); }
+		MSGPACK_ERR try_unpack( timespec &t )	{
+			int64_t s = 0; uint32_t ns = 0;
+			MSGPACK_ERR ret = msgpack_unpack_timestamp( this->u, &s, &ns );
+			if ( ret == MSGPACK_SUCCESS ) { t.tv_sec = ( time_t )s; t.tv_nsec = ns; }
+			return ret;
+		}
+#ifdef MSGPACK_STL
+		MSGPACK_ERR try_unpack( std::string &s )	{
+			const byte *b = NULL; uint32_t n = 0;
+			MSGPACK_ERR ret = msgpack_unpack_raw( this->u, &b, &n );
+			if ( ret == MSGPACK_SUCCESS ) s.assign(( const char* )b, n );
+			return ret;
+		}
+		MSGPACK_ERR try_unpack( std::vector<int8_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_int8_array ); }
+		MSGPACK_ERR try_unpack( std::vector<int16_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_int16_array ); }
+		MSGPACK_ERR try_unpack( std::vector<int32_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_int32_array ); }
+		MSGPACK_ERR try_unpack( std::vector<int64_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_int64_array ); }
+		MSGPACK_ERR try_unpack( std::vector<uint8_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_uint8_array ); }
+		MSGPACK_ERR try_unpack( std::vector<uint16_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_uint16_array ); }
+		MSGPACK_ERR try_unpack( std::vector<uint32_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_uint32_array ); }
+		MSGPACK_ERR try_unpack( std::vector<uint64_t> &v )	{ return try_unpack_vector( v, msgpack_unpack_uint64_array ); }
+		MSGPACK_ERR try_unpack( std::vector<float> &v )		{ return try_unpack_vector( v, msgpack_unpack_float_array ); }
+		MSGPACK_ERR try_unpack( std::vector<double> &v )	{ return try_unpack_vector( v, msgpack_unpack_double_array ); }
+#endif
+		/// Unpack the next object as a T, e.g. u.try_unpack<int32_t>( ), returning the value or the error
+		template<class T> result<T> try_unpack( )	{ result<T> r; r.error = try_unpack( r.value ); return r; }
+		
+		/// Non-throwing start_array and start_map
+		MSGPACK_ERR try_start_array( uint32_t &n )	{ return msgpack_unpack_array( this->u, &n ); }
+		MSGPACK_ERR try_start_map( uint32_t &n )	{ return msgpack_unpack_map( this->u, &n ); }
+		/// Non-throwing unpack_raw: point "b" at the "n" bytes of the next str or bin
+		MSGPACK_ERR try_unpack_raw( const void *&b, uint32_t &n )
+			{ const byte *p = NULL; MSGPACK_ERR ret = msgpack_unpack_raw( this->u, &p, &n ); if ( ret == MSGPACK_SUCCESS ) b = p; return ret; }
+		
+#ifdef MSGPACK_CXX11
+		/// Unpack an array written by pack_tuple, checking its length once. When every field is bounded
+		/// and the buffer holds their worst case, they are read without bounds checks.
+		template<class... A> unpacker& unpack_tuple( A&... a )	{
+			if ( start_array( ) != sizeof...( A )) MSGPACK_ASSERT( MSGPACK_TYPEERR );
+			if ( max_fields_size<A...>::bounded && ( len( ) >= max_fields_size<A...>::value )) get_fields( a... );
+			else unpack_fields( a... );
+			return *this;
+		}
+		/// Unpack any type declared with MSGPACKALT_DEFINE
+		template<class T> auto operator>>( T &x ) -> decltype( x.msgpack_unpack( *this ), *this )
+			{ x.msgpack_unpack( *this ); return *this; }
+#endif
 		
 	protected:
 		/// Underlying C unpacker object
 		msgpack_u *u;
+		/// False for a wrapped caller struct, which the destructor leaves alone
+		bool owned;
+#ifdef MSGPACK_CXX11
+		void unpack_fields( )		{ }
+		template<class T, class... R> void unpack_fields( T &x, R&... r )	{ *this >> x; unpack_fields( r... ); }
+		/// Read fields that unpack_tuple has found room for
+		void get_fields( )			{ }
+		template<class T, class... R> void get_fields( T &x, R&... r )	{ get( x ); get_fields( r... ); }
+		void get( bool &b )				{ int x = msgpack_unchecked_bool( this->u ); b = x > 0; MSGPACK_ASSERT(( MSGPACK_ERR )x ); }
+		void get( uint8_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_uint8( this->u, &x )); }
+		void get( uint16_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_uint16( this->u, &x )); }
+		void get( uint32_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_uint32( this->u, &x )); }
+		void get( uint64_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_uint64( this->u, &x )); }
+		void get( int8_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_int8( this->u, &x )); }
+		void get( int16_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_int16( this->u, &x )); }
+		void get( int32_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_int32( this->u, &x )); }
+		void get( int64_t &x )			{ MSGPACK_ASSERT( msgpack_unchecked_int64( this->u, &x )); }
+		void get( float &x )			{ MSGPACK_ASSERT( msgpack_unchecked_float( this->u, &x )); }
+		void get( double &x )			{ MSGPACK_ASSERT( msgpack_unchecked_double( this->u, &x )); }
+		template<class T> void get( T &x )	{ *this >> x; }
+#endif
+#ifdef MSGPACK_STL
+		/// Size the vector from the array header, then unpack into it with the bulk function "f"
+		template<class T, class U> unpacker& unpack_vector( std::vector<T> &v, MSGPACK_ERR ( *f )( msgpack_u*, U*, uint32_t, uint32_t* ))
+			{ MSGPACK_ASSERT( try_unpack_vector( v, f )); return *this; }
+		/// As unpack_vector, but return the error and leave "v" unchanged on failure. "U" has the size of "T", see bulk_int
+		template<class T, class U> MSGPACK_ERR try_unpack_vector( std::vector<T> &v, MSGPACK_ERR ( *f )( msgpack_u*, U*, uint32_t, uint32_t* ))
+		{
+			uint32_t n = 0;
+			MSGPACK_ERR ret = f( this->u, NULL, 0, &n );
+			if ( ret == MSGPACK_MEMERR && n ) {
+				std::vector<T> w( n );
+				if (( ret = f( this->u, ( U* )( void* )&w[0], n, &n )) == MSGPACK_SUCCESS ) v.swap( w );
+			} else if ( ret == MSGPACK_SUCCESS ) v.clear( );
+			return ret;
+		}
+		/// operator>> for a vector of an integer type that is none of int8_t..uint64_t, through the one of the same size and sign
+		template<class T, class U> unpacker& unpack_vector_as( std::vector<T> &v, U* )
+			{ MSGPACK_ERR ( *f )( msgpack_u*, U*, uint32_t, uint32_t* ) = bulk_unpack; return unpack_vector( v, f ); }
+		/// operator>> for a vector of other types, one element at a time
+		template<class T> unpacker& unpack_vector_as( std::vector<T> &v, void* )
+			{ uint32_t n = start_array( ); T x; v.clear( ); for ( uint32_t i = 0; i < n; ++i ) { *this >> x; v.push_back( x ); } return *this; }
+		/// The bulk integer functions under one name, for unpack_vector_as to pick from
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, int8_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_int8_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, int16_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_int16_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, int32_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_int32_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, int64_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_int64_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, uint8_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_uint8_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, uint16_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_uint16_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, uint32_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_uint32_array( m, x, max, n ); }
+		static MSGPACK_ERR bulk_unpack( msgpack_u *m, uint64_t *x, uint32_t max, uint32_t *n )	{ return msgpack_unpack_uint64_array( m, x, max, n ); }
+#endif
 		
 	private:
 		/// Pointers are not reference counted, so prevent automatic copies. Use the << operator to append instead.
 		unpacker& operator=( const unpacker& P );
 };
 
+/// A non-owning reference to one packed object inside someone else's buffer, which must outlive it
+class package_view {
+	public:
+		/// Default constructor: the empty (nil) view
+		package_view( )									{ p = NULL; n = 0; }
+		/// View "len" bytes holding a single packed object
+		package_view( const void *ptr, uint32_t len )	{ p = ( const byte* )ptr; n = len; }
+		
+		/// Pointer to the packed bytes
+		const byte* data( ) const			{ return p; }
+		/// Number of packed bytes
+		uint32_t size( ) const				{ return n; }
+		/// True if the view refers to nothing
+		bool empty( ) const					{ return n == 0; }
+		MSGPACK_TYPE_CODES type( ) const	{ return p ? ( MSGPACK_TYPE_CODES )msgpack_unpack_peek_code( *p ) : MSGPACK_NULL; }
+		
+		/// Attempt to unpack the object as the specified datatype
+		template<class T> T as( ) const		{ T x; msgpack_u s; MSGPACK_ASSERT( msgpack_unpack_init_fixed( &s, p, n )); unpacker( &s ) >> x; return x; }
+		/// Convenience syntax for as<> casting
+		template<class T> const package_view& operator>>( T& x ) const	{ x = this->as<T>( ); return *this; }
+		/// Unpack the object into "x" without throwing; see unpacker::try_unpack
+		template<class T> MSGPACK_ERR try_as( T &x ) const	{
+			msgpack_u s; MSGPACK_ERR ret = msgpack_unpack_init_fixed( &s, p, n );
+			return ret ? ret : unpacker( &s ).try_unpack( x );
+		}
+		
+		/// Borrow the next object of the stream: the view stays valid until the unpacker's buffer changes
+		friend unpacker& operator>>( unpacker &u, package_view &v ) {
+			int k = u.skip( );
+			if ( k < 0 ) MSGPACK_ASSERT(( MSGPACK_ERR )k );
+			v.p = u.ptr( ) - k; v.n = k;
+			return u;
+		}
+		/// Insert the viewed object into the stream
+		friend packer& operator<<( packer &pk, const package_view &v )	{
+			if ( !v.n ) pk.pack_null( ); else pk.append( v.p, v.n );
+			return pk;
+		}
+		
+	protected:
+		const byte *p; uint32_t n;
+};
+
 /// A simple class containing a single packed object for packing or unpacking. Enables syntax simplification.
+/** Encodings of up to MSGPACK_PACKAGE_INLINE bytes (small ints, short strings) are kept inside the
+ *	package itself; only larger ones take memory from the allocator. */
 class package {
 	public:
 		/// Default constructor
-		package( )									{ data = NULL; n = 0; }
+		package( )									{ data = NULL; n = 0; alloc = NULL; }
+		/// Construct an empty package whose data will be taken from the given allocator, e.g. &arena.hooks
+		explicit package( const msgpack_alloc *a )	{ data = NULL; n = 0; alloc = a; }
 		/// Copy constructor
-		package( const package &p )					{ data = NULL; this->operator=( p ); }
+		package( const package &p )					{ data = NULL; n = 0; alloc = p.alloc; this->operator=( p ); }
 		/// Construct an object from an existing buffer
-		package( const void* ptr, uint32_t len )	{ data = NULL; set( ptr, len ); }
+		package( const void* ptr, uint32_t len )	{ data = NULL; n = 0; alloc = NULL; set( ptr, len ); }
+		/// Take a copy of a viewed object
+		package( const package_view &v )			{ data = NULL; n = 0; alloc = NULL; set( v.data( ), v.size( )); }
+#ifdef MSGPACK_CXX11
+		/// Move constructor: take the buffer of "p", which is left empty
+		package( package &&p )						{ data = NULL; n = 0; alloc = p.alloc; take( p ); }
+		/// Move assignment, adopting the allocator of "p" along with its buffer
+		package& operator=( package &&p )			{ if ( &p != this ) { reset( ); alloc = p.alloc; take( p ); } return *this; }
+#endif
 		/// Construct a package from anything that can be packed
 		//template<class T> package( const T &x )		{ data = NULL; packer p; p << x; this->data = p.duplicate( this->n ); }
 		/// Default destructor
 		~package( )									{ reset( ); }
 		/// Attempt to unpack the object as the specified datatype 
-		template<class T> T as( )					{ T x; unpacker(( const byte* )data,n,0 ) >> x; return x; }
+		template<class T> T as( )					{ return view( ).as<T>( ); }
 		/// Convenience syntax for as<> casting
 		template<class T> package& operator>>( T& x )		{ x = this->as<T>( ); return *this; }
 		
-		template<class T> package& operator<<( const T& x )	{ packer p; p << x; this->data = p.duplicate( this->n ); return *this; }
+		/// Pack "x", in place when it fits and otherwise into a single buffer that the package adopts
+		template<class T> package& operator<<( const T& x )	{
+			byte b[MSGPACK_PACKAGE_INLINE];
+			msgpack_p s;
+			MSGPACK_ASSERT( msgpack_pack_init_buffer( &s, b, sizeof( b ), alloc ));
+			packer p( &s );
+			p << x;
+			adopt( s );
+			return *this;
+		}
 		
 		void set( const void* ptr, uint32_t len )	{
 			reset( );
 			if ( !ptr || !len ) return;
-			data = malloc( len );
+			if ( len <= MSGPACK_PACKAGE_INLINE ) data = local;
+			else if ( !( data = msgpack_malloc( alloc, len ))) MSGPACK_ASSERT( MSGPACK_MEMERR );
 			memcpy( data, ptr, len );
 			n = len;
 		}
@@ -338,11 +1100,14 @@ class package {
 			if ( !data ) return MSGPACK_NULL;
 			return ( MSGPACK_TYPE_CODES )msgpack_unpack_peek_code( *( byte* )data );
 		}
+		/// A view of the packed data, valid while the package is unchanged
+		package_view view( ) const			{ return package_view( data, n ); }
 		
 		/// Extract a single object from the stream
 		friend unpacker& operator>>( unpacker &u, package &obj ) {
-			uint32_t k = u.skip( );
-			obj = package( u.ptr() - k, k );
+			int k = u.skip( );
+			if ( k < 0 ) MSGPACK_ASSERT(( MSGPACK_ERR )k );
+			obj.set( u.ptr() - k, k );
 			return u;
 		}
 		/// Insert this object into the stream
@@ -354,8 +1119,481 @@ class package {
 		package& operator=( const package& rhs )	{ if ( &rhs == this ) return *this; this->set( rhs.data, rhs.n ); return *this; }
 		
 	protected:
-		void reset( )	{ if ( data ) { free( data ); data = NULL; } n = 0; }
-		void *data; size_t n;
+		void reset( )	{ if ( data && ( data != local )) msgpack_free( alloc, data, n ); data = NULL; n = 0; }
+		/// Move the contents of "p" into this empty package
+		void take( package &p )	{
+			if ( p.data == p.local ) set( p.local, p.n );
+			else { data = p.data; n = p.n; }
+			p.data = NULL; p.n = 0;
+		}
+		/// Take the contents of a packer made by operator<<, copying small ones inline and keeping the buffer of large ones
+		void adopt( msgpack_p &s )	{
+			const byte *b = NULL; uint32_t len = 0;
+			MSGPACK_ASSERT( msgpack_get_buffer( &s, &b, &len ));
+			if ( len <= MSGPACK_PACKAGE_INLINE ) { set( b, len ); return; }
+			msgpack_pack_shrink( &s, len );		/* free exactly what was allocated */
+			reset( );
+			data = s.buffer; n = len;
+			s.flags &= ~MSGPACK_FLAG_OWNED;		/* the package frees it now */
+		}
+		void *data; uint32_t n;
+		/// Allocator for the packed data, NULL for malloc
+		const msgpack_alloc *alloc;
+		/// Storage for small encodings
+		byte local[MSGPACK_PACKAGE_INLINE];
+};
+
+/// A read-only dictionary over a packed map, used in place without copying or unpacking it
+/** Construction only measures the map. The first lookup walks it once and builds an open-addressing
+ *	hash index of the str/bin keys, so reading a few fields of a large map costs one allocation rather
+ *	than a string and a package per key. Keys and values are package_views into the original buffer,
+ *	which must outlive the map_view and must not be appended to meanwhile. Duplicate keys resolve to
+ *	their first occurrence, and other key types are only reachable by iterating. */
+class map_view {
+	public:
+		/// One (key,value) pair of the map
+		struct entry {
+			package_view key, value;
+		};
+		
+		/// Forward iterator over the pairs in packed order
+		class const_iterator {
+			public:
+				const_iterator( const byte *b, const byte *e )	{ p = b; end = e; load( ); }
+				const entry& operator*( ) const			{ return cur; }
+				const entry* operator->( ) const		{ return &cur; }
+				const_iterator& operator++( )			{ p = cur.value.data( ) + cur.value.size( ); load( ); return *this; }
+				bool operator==( const const_iterator &x ) const	{ return p == x.p; }
+				bool operator!=( const const_iterator &x ) const	{ return p != x.p; }
+			protected:
+				void load( )	{
+					if ( p >= end ) return;
+					uint32_t k = map_view::span( p, end );
+					cur.key = package_view( p, k );
+					cur.value = package_view( p + k, map_view::span( p + k, end ));
+				}
+				const byte *p, *end;
+				entry cur;
+		};
+		
+		/// View the next object of the unpacker, which must be a map, and move the unpacker past it
+		explicit map_view( unpacker &u, const msgpack_alloc *a = NULL )	{
+			init( a );
+			open( u.ptr( ), u.len( ));
+			int k = u.skip( );
+			if ( k < 0 ) MSGPACK_ASSERT(( MSGPACK_ERR )k );
+			last = first + ( k - head );
+		}
+		/// View the packed map held in the given memory
+		map_view( const void *ptr, uint32_t len, const msgpack_alloc *a = NULL )	{
+			init( a );
+			measure(( const byte* )ptr, len );
+		}
+		/// View a map held in a package_view, e.g. one nested in another map_view
+		explicit map_view( const package_view &v, const msgpack_alloc *a = NULL )	{
+			init( a );
+			measure( v.data( ), v.size( ));
+		}
+		/// Release the index
+		~map_view( )	{ if ( slot ) msgpack_free( alloc, slot, ( mask + 1 )*sizeof( index_slot )); }
+		
+		/// Number of pairs in the map
+		uint32_t size( ) const				{ return count; }
+		const_iterator begin( ) const		{ return const_iterator( first, last ); }
+		const_iterator end( ) const			{ return const_iterator( last, last ); }
+		
+		/// Look up a key of "len" bytes, setting "v" and returning true if it is present
+		bool find( const void *key, uint32_t len, package_view &v )	{
+			if ( !count ) return false;
+			if ( !slot ) build( );
+			uint32_t h = hash(( const byte* )key, len );
+			for ( uint32_t i = h & mask; slot[i].key; i = ( i + 1 ) & mask )
+				if (( slot[i].hash == h ) && ( slot[i].klen == len ) && !memcmp( slot[i].key, key, len ))
+					{ v = package_view( slot[i].val, slot[i].vlen ); return true; }
+			return false;
+		}
+		bool find( const char *key, package_view &v )	{ return find( key, ( uint32_t )strlen( key ), v ); }
+		/// Return the value for the given key, or an empty (nil) view if it is absent
+		package_view operator[]( const char *key )	{ package_view v; find( key, v ); return v; }
+#ifdef MSGPACK_STL
+		bool find( const std::string &key, package_view &v )	{ return find( key.data( ), ( uint32_t )key.size( ), v ); }
+		package_view operator[]( const std::string &key )	{ package_view v; find( key, v ); return v; }
+#endif
+		
+	protected:
+		/// A hash table slot, empty when key is NULL
+		struct index_slot {
+			const byte *key, *val;
+			uint32_t klen, vlen, hash;
+		};
+		
+		void init( const msgpack_alloc *a )	{ alloc = a; slot = NULL; mask = 0; }
+		/// Read the map header, leaving "first" at the first key
+		void open( const byte *b, uint32_t len )	{
+			msgpack_u u;
+			MSGPACK_ASSERT( msgpack_unpack_init_fixed( &u, b, len ));
+			MSGPACK_ASSERT( msgpack_unpack_map( &u, &count ));
+			first = u.p;
+			head = ( uint32_t )( u.p - b );
+		}
+		/// Read the header and find the end of the map held in "len" bytes at "b"
+		void measure( const byte *b, uint32_t len )	{
+			open( b, len );
+			msgpack_u u;
+			MSGPACK_ASSERT( msgpack_unpack_init_fixed( &u, b, len ));
+			int k = msgpack_unpack_skip( &u );
+			if ( k < 0 ) MSGPACK_ASSERT(( MSGPACK_ERR )k );
+			last = first + ( k - head );
+		}
+		/// Walk the map once, inserting every str/bin key into a table at most half full
+		void build( )	{
+			uint32_t nslot = 2;
+			while (( nslot/2 < count ) && ( nslot <= 0xffffffffu/sizeof( index_slot ))) nslot <<= 1;
+			if (( nslot/2 < count ) || ( nslot > 0xffffffffu/sizeof( index_slot ))) MSGPACK_ASSERT( MSGPACK_MEMERR );
+			slot = ( index_slot* )msgpack_malloc( alloc, nslot*sizeof( index_slot ));
+			if ( !slot ) MSGPACK_ASSERT( MSGPACK_MEMERR );
+			memset( slot, 0, nslot*sizeof( index_slot ));
+			mask = nslot - 1;
+			msgpack_u u;
+			MSGPACK_ASSERT( msgpack_unpack_init_fixed( &u, first, ( uint32_t )( last - first )));
+			for ( uint32_t j = 0; j < count; ++j ) {
+				const byte *k = NULL; uint32_t klen = 0;
+				if ( msgpack_unpack_raw( &u, &k, &klen ) != MSGPACK_SUCCESS ) { k = NULL; msgpack_unpack_skip( &u ); }
+				const byte *v = u.p;
+				uint32_t vlen = ( uint32_t )msgpack_unpack_skip( &u );
+				if ( !k ) continue;
+				if ( !klen ) k = v;		/* any non-NULL pointer marks the slot used */
+				uint32_t h = hash( k, klen ), i = h & mask;
+				while ( slot[i].key && !(( slot[i].hash == h ) && ( slot[i].klen == klen ) && !memcmp( slot[i].key, k, klen )))
+					i = ( i + 1 ) & mask;
+				if ( slot[i].key ) continue;	/* keep the first duplicate */
+				slot[i].key = k; slot[i].klen = klen; slot[i].val = v; slot[i].vlen = vlen; slot[i].hash = h;
+			}
+		}
+		/// 32-bit FNV-1a
+		static uint32_t hash( const byte *k, uint32_t n )	{
+			uint32_t h = 2166136261u;
+			while ( n-- ) h = ( h ^ *k++ )*16777619u;
+			return h;
+		}
+		/// Length of the (already validated) object at "p"
+		static uint32_t span( const byte *p, const byte *end )	{
+			msgpack_u u;
+			MSGPACK_ASSERT( msgpack_unpack_init_fixed( &u, p, ( uint32_t )( end - p )));
+			return ( uint32_t )msgpack_unpack_skip( &u );
+		}
+		
+		const byte *first, *last;
+		uint32_t count, head;
+		index_slot *slot;
+		uint32_t mask;
+		const msgpack_alloc *alloc;
+		
+	private:
+		/// The index is not reference counted, so prevent copies
+		map_view( const map_view& );
+		map_view& operator=( const map_view& );
+};
+
+// ********************************* RECORD BATCHES *********************************
+/// The record batch column type holding values of type T
+template<class T> struct column_type;
+template<> struct column_type<int8_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_INT8; };
+template<> struct column_type<int16_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_INT16; };
+template<> struct column_type<int32_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_INT32; };
+template<> struct column_type<int64_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_INT64; };
+template<> struct column_type<uint8_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_UINT8; };
+template<> struct column_type<uint16_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_UINT16; };
+template<> struct column_type<uint32_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_UINT32; };
+template<> struct column_type<uint64_t>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_UINT64; };
+template<> struct column_type<float>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_FLOAT; };
+template<> struct column_type<double>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_DOUBLE; };
+template<> struct column_type<const char*>		{ static const MSGPACK_TYPE_CODES value = MSGPACK_RAW; };
+template<> struct column_type<char*>			{ static const MSGPACK_TYPE_CODES value = MSGPACK_RAW; };
+
+/// Packs N records with the same fields column by column as one record batch, see msgpack_batch_begin
+/** Add every field with column() and then close the batch with finish(), e.g.
+ *	batch_writer( p, n ).column( "id", recs, &record::id ).column( "name", recs, &record::name ).finish( ); */
+class batch_writer {
+	public:
+		/// start a batch of "nrows" records in "p"
+		batch_writer( packer &p, uint32_t nrows )
+			{ MSGPACK_ASSERT( msgpack_batch_begin( &this->w, p.ptr( ), nrows )); }
+		/// discard the batch, if not finished
+		~batch_writer( )		{ msgpack_batch_cancel( &this->w ); }
+		
+		/// Add the field "name", value i being read from ( const byte* )base + i*stride
+		template<class T> batch_writer& column( const char *name, const T *base, uint32_t stride = sizeof( T ))
+			{ MSGPACK_ASSERT( msgpack_batch_column( &this->w, name, column_type<T>::value, base, stride )); return *this; }
+		/// Add the member "f" of each record in "recs"
+		template<class R, class T> batch_writer& column( const char *name, const R *recs, T R::*f )
+			{ return column( name, recs ? &( recs->*f ) : ( const T* )NULL, sizeof( R )); }
+#ifdef MSGPACK_STL
+		/// Add a string member of each record
+		template<class R> batch_writer& column( const char *name, const R *recs, std::string R::*f ) {
+			std::vector<const char*> s( this->w.nrows );
+			for ( uint32_t i = 0; i < this->w.nrows; ++i ) s[i] = ( recs[i].*f ).c_str( );
+			return column( name, s.empty( ) ? ( const char* const* )NULL : &s[0] );
+		}
+#endif
+		/// Close the batch; nothing more can be added afterwards
+		void finish( )			{ MSGPACK_ASSERT( msgpack_batch_end( &this->w )); }
+		
+	protected:
+		msgpack_batch_writer w;
+		
+	private:
+		/// The writer owns its dictionary and the open batch, so prevent copies
+		batch_writer( const batch_writer& );
+		batch_writer& operator=( const batch_writer& );
+};
+
+/// A decoded record batch, giving each column as one contiguous array and each record as a map
+/** Names and strings point into the unpacker's buffer, which must outlive the reader. Iterating
+ *	yields an unpacker over each record in turn, packed as the map it would have been without the
+ *	batch, so code written for one record at a time can read the batch unchanged. */
+class batch_reader {
+	public:
+		/// The values of one column
+		template<class T> struct span {
+			const T *ptr; uint32_t n;
+			const T* begin( ) const					{ return ptr; }
+			const T* end( ) const					{ return ptr + n; }
+			uint32_t size( ) const					{ return n; }
+			const T& operator[]( uint32_t i ) const	{ return ptr[i]; }
+		};
+		
+		/// Forward iterator over the records
+		class row_iterator {
+			public:
+				row_iterator( batch_reader *r, uint32_t i )	{ b = r; row = i; }
+				/// an unpacker over this record, valid until the next record is read
+				unpacker& operator*( ) const			{ return b->record( row ); }
+				row_iterator& operator++( )				{ ++row; return *this; }
+				bool operator==( const row_iterator &x ) const	{ return row == x.row; }
+				bool operator!=( const row_iterator &x ) const	{ return row != x.row; }
+			protected:
+				batch_reader *b;
+				uint32_t row;
+		};
+		
+		/// Unpack the next object of "u", which must be a record batch, taking the columns from "a"
+		explicit batch_reader( unpacker &u, const msgpack_alloc *a = NULL ) : rows( &s )	{
+			package_view v;
+			msgpack_unpack_init_fixed( &this->s, NULL, 0 );
+			u >> v;
+			msgpack_u t;
+			msgpack_unpack_init_fixed( &t, v.data( ), v.size( ));
+			MSGPACK_ASSERT( msgpack_unpack_batch( &t, &this->b, a ));
+		}
+		/// release the columns
+		~batch_reader( )							{ msgpack_batch_free( &this->b ); }
+		
+		/// number of records
+		uint32_t size( ) const						{ return this->b.nrows; }
+		/// number of fields
+		uint32_t columns( ) const					{ return this->b.ncols; }
+		/// the "j"th column
+		const msgpack_column& column( uint32_t j ) const
+			{ if ( j >= this->b.ncols ) MSGPACK_ASSERT( MSGPACK_ARGERR ); return this->b.col[j]; }
+		/// the column called "name", or NULL
+		const msgpack_column* find( const char *name ) const	{ return msgpack_batch_find( &this->b, name ); }
+		
+		/// The values of the column called "name", which must hold values of type T
+		template<class T> span<T> values( const char *name ) const	{
+			const msgpack_column *c = find( name );
+			if ( !c ) MSGPACK_ASSERT( MSGPACK_ARGERR );
+			if ( c->type != column_type<T>::value || c->type == MSGPACK_RAW ) MSGPACK_ASSERT( MSGPACK_TYPEERR );
+			span<T> x; x.ptr = ( const T* )c->data; x.n = this->b.nrows;
+			return x;
+		}
+		/// String "i" of the string column "c", which has "n" bytes and is not NUL-terminated
+		const char* str( const msgpack_column &c, uint32_t i, uint32_t &n ) const	{
+			if ( c.type != MSGPACK_RAW ) MSGPACK_ASSERT( MSGPACK_TYPEERR );
+			if ( i >= this->b.nrows ) MSGPACK_ASSERT( MSGPACK_ARGERR );
+			const msgpack_value &v = c.dict[(( const uint32_t* )c.data )[i]];
+			n = v.n; return ( const char* )v.v.p;
+		}
+#ifdef MSGPACK_STL
+		std::string str( const msgpack_column &c, uint32_t i ) const
+			{ uint32_t n; const char *p = str( c, i, n ); return std::string( p, n ); }
+#endif
+		
+		/// An unpacker over record "i" packed as a map, valid until the next record is read
+		unpacker& record( uint32_t i )	{
+			this->row.clear( );
+			MSGPACK_ASSERT( msgpack_batch_pack_row( &this->b, i, this->row.ptr( )));
+			msgpack_unpack_init_fixed( &this->s, this->row.ptr( )->buffer, this->row.len( ));
+			return this->rows;
+		}
+		row_iterator begin( )			{ return row_iterator( this, 0 ); }
+		row_iterator end( )				{ return row_iterator( this, this->b.nrows ); }
+		
+		/// return pointer to underlying C struct -- internal use only
+		const msgpack_batch* ptr( ) const	{ return &this->b; }
+		
+	protected:
+		msgpack_batch b;
+		packer row;
+		msgpack_u s;
+		unpacker rows;
+		
+	private:
+		/// The reader owns its columns, so prevent copies
+		batch_reader( const batch_reader& );
+		batch_reader& operator=( const batch_reader& );
+};
+
+/// Packs many small messages into one frame with an offset table, see msgpack_frame_batch_begin
+/** Call next() before packing each message and finish() after the last, e.g.
+ *	frame_writer f( p ); for ( ... ) f.next( ) << id << name; f.finish( ); */
+class frame_writer {
+	public:
+		/// start a batch frame in "p", with a CRC32C of its contents unless "crc" is false
+		explicit frame_writer( packer &p, bool crc = true ) : pk( p )
+			{ MSGPACK_ASSERT( msgpack_frame_batch_begin( &this->w, p.ptr( ), crc ? MSGPACK_FRAME_CRC : 0 )); }
+		/// discard the frame, if not finished
+		~frame_writer( )		{ msgpack_frame_batch_cancel( &this->w ); }
+		
+		/// Start the next message, returning the packer to pack it into
+		packer& next( )			{ MSGPACK_ASSERT( msgpack_frame_batch_next( &this->w )); return this->pk; }
+		/// Number of messages begun
+		uint32_t size( ) const	{ return this->w.n; }
+		/// Pack the offset table and close the frame; nothing more can be added afterwards
+		void finish( )			{ MSGPACK_ASSERT( msgpack_frame_batch_end( &this->w )); }
+		
+	protected:
+		msgpack_frame_writer w;
+		packer &pk;
+		
+	private:
+		/// The writer owns its offset table, so prevent copies
+		frame_writer( const frame_writer& );
+		frame_writer& operator=( const frame_writer& );
+};
+
+/// A received frame, whose messages are read in place from the unpacker's buffer, which must outlive it
+/** Reading message i gives an unpacker over just that message, without copying it, e.g.
+ *	frame_view f( u ); for ( uint32_t i = 0; i < f.size( ); ++i ) f[i] >> id >> name; */
+class frame_view {
+	public:
+		/// Unpack the next object of "u", which must be a frame with a valid CRC
+		explicit frame_view( unpacker &u ) : msg( &s )
+			{ msgpack_unpack_init_fixed( &this->s, NULL, 0 ); this->f = u.unpack_frame( ); }
+		/// View a frame from unpacker::try_unpack_frame or msgpack_unpack_frame
+		explicit frame_view( const msgpack_frame &x ) : f( x ), msg( &s )
+			{ msgpack_unpack_init_fixed( &this->s, NULL, 0 ); }
+		
+		/// number of messages, 1 unless the frame is a batch
+		uint32_t size( ) const					{ return this->f.count; }
+		/// An unpacker over message "i", valid until the next message is read
+		unpacker& message( uint32_t i )			{ MSGPACK_ASSERT( msgpack_frame_message( &this->f, i, &this->s )); return this->msg; }
+		unpacker& operator[]( uint32_t i )		{ return message( i ); }
+		
+		/// return pointer to underlying C struct -- internal use only
+		const msgpack_frame* ptr( ) const		{ return &this->f; }
+		
+	protected:
+		msgpack_frame f;
+		msgpack_u s;
+		unpacker msg;
+		
+	private:
+		/// The view holds an unpacker over its own struct, so prevent copies
+		frame_view( const frame_view& );
+		frame_view& operator=( const frame_view& );
+};
+
+/// Counters describing the activity of a packer_pool, for sizing it in production
+struct pool_stats {
+	uint64_t hits;			///< acquire() calls served from the cache
+	uint64_t misses;		///< acquire() calls that had to construct a packer
+	uint64_t shrinks;		///< released packers whose buffer exceeded the high-water mark
+	uint64_t discards;		///< released packers deleted because the cache was full
+	uint64_t retained;		///< bytes of buffer held by idle packers
+	uint32_t idle;			///< number of idle packers in the cache
+};
+
+/// A cache of pre-grown packers, avoiding construction and regrowth for every message
+/** acquire() returns a cleared packer and release() hands it back. Buffers that grew past
+ *	the high-water mark are shrunk on release so occasional huge messages are not pinned.
+ *	A pool is not thread-safe; use packer_pool::local() for a per-thread instance. */
+class packer_pool {
+	public:
+		/// keep up to "max_idle" packers, each pre-grown to "initial" bytes and shrunk back to "high_water" bytes
+		packer_pool( uint32_t nmax = 16, uint32_t hwm = 1u<<20, uint32_t n0 = 4096 )
+			: nidle( 0 ), max_idle( nmax ), high_water( hwm ), initial( n0 ), st( )
+			{ idle = new packer*[nmax ? nmax : 1]; }
+		/// delete all idle packers
+		~packer_pool( )
+			{ while ( nidle ) delete idle[--nidle]; delete[] idle; }
+		
+		/// take a cleared packer from the cache, or construct one if the cache is empty
+		packer* acquire( )	{
+			if ( nidle ) { ++st.hits; packer *p = idle[--nidle]; st.retained -= p->capacity( ); st.idle = nidle; return p; }
+			++st.misses;
+			packer *p = new packer( );
+			MSGPACK_ERR ret = msgpack_pack_reserve( p->ptr( ), initial );
+			if ( ret ) { delete p; MSGPACK_ASSERT( ret ); }
+			return p;
+		}
+		/// return a packer to the cache, clearing it and applying the shrink policy; never throws
+		void release( packer *p )	{
+			if ( !p ) return;
+			if ( nidle >= max_idle ) { ++st.discards; delete p; return; }
+			msgpack_p *m = p->ptr( );
+			p->clear( );
+			msgpack_pack_set_compat( m, 0 );
+			m->sink = NULL; m->sink_ctx = NULL; m->watermark = 0;	// detach any sink and turn zero-copy off for the next user
+			if ( m->sg ) m->sg->threshold = 0;
+			if (( p->capacity( ) > high_water ) && !msgpack_pack_shrink( m, high_water )) ++st.shrinks;	// else keep the larger buffer
+			st.retained += p->capacity( );
+			idle[nidle++] = p;
+			st.idle = nidle;
+		}
+		/// usage counters
+		const pool_stats& stats( ) const		{ return st; }
+		/// change the high-water mark applied to subsequently released packers
+		void set_high_water( uint32_t n )		{ high_water = n; }
+		
+#ifdef MSGPACK_CXX11
+		/// the pool belonging to the calling thread
+		static packer_pool& local( )			{ static thread_local packer_pool pool; return pool; }
+#endif
+		
+	protected:
+		packer **idle;
+		uint32_t nidle, max_idle, high_water, initial;
+		pool_stats st;
+		
+	private:
+		/// The pool owns its packers, so prevent copies
+		packer_pool( const packer_pool& );
+		packer_pool& operator=( const packer_pool& );
+};
+
+/// A packer borrowed from a packer_pool for the lifetime of this object
+class pooled_packer {
+	public:
+#ifdef MSGPACK_CXX11
+		/// borrow from the calling thread's pool
+		pooled_packer( ) : pool( packer_pool::local( ))	{ p = pool.acquire( ); }
+#endif
+		/// borrow from the given pool
+		explicit pooled_packer( packer_pool &from ) : pool( from )	{ p = pool.acquire( ); }
+		/// return the packer to its pool (packer_pool::release does not throw)
+		~pooled_packer( )							{ pool.release( p ); }
+		
+		packer& operator*( )						{ return *p; }
+		packer* operator->( )						{ return p; }
+		
+	protected:
+		packer_pool &pool;
+		packer *p;
+		
+	private:
+		pooled_packer( const pooled_packer& );
+		pooled_packer& operator=( const pooled_packer& );
 };
 
 } // namespace msgpackalt
@@ -41,7 +41,7 @@ int main( int nargs, char** args )
 {
     TIMER_T T;
     int i, j, n=0, m=0, nobj;
-    double t1 = 0, t2 = 0, t3 = 0, t4 = 0;
+    double t1 = 0, t2 = 0, t3 = 0, t4 = 0, t5 = 0;
     
     test_t t = { 1, 2, 3, "Blah" };
     
@@ -86,12 +86,20 @@ int main( int nargs, char** args )
             test_yajl( &t, nobj );
         }
         t4 += stop_timer( T );
+        
+        T = start_timer( );
+        for ( i = 0; i < n; ++i )
+        {
+            test_msgpackgen( &t, nobj );
+        }
+        t5 += stop_timer( T );
     }
     printf( "Results:\n" );
     printf( ">> msgpackalt  : %f\n", t1/m );
     printf( ">> MessagePack : %f\n", t2/m );
     printf( ">> Protobuf    : %f\n", t3/m );
     printf( ">> YAJL JSON   : %f\n", t4/m );
+    printf( ">> msgpackgen  : %f\n", t5/m );
     
     return 0;
 }
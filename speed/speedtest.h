@@ -11,6 +11,7 @@ typedef struct {
 } test_t;
 
 void test_msgpackalt( test_t* t, int nobj );
+void test_msgpackgen( test_t* t, int nobj );
 void test_msgpack( test_t* t, int nobj );
 void test_protobuf( test_t* t, int nobj );
 void test_yajl( test_t* t, int nobj );
@@ -1,37 +1,85 @@
 #include "speedtest.h"
 #define MSGPACK_INLINE
 #include <msgpackalt.h>
+#include "test_proto_mpk.c"     /* generated by build.bat from test_proto.proto */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* errors are OR'd together in the loops and checked once, so a failure cannot go unnoticed */
+static void check( MSGPACK_ERR ret, const char *what )
+{
+    if ( ret )
+    {
+        fprintf( stderr, "%s failed (%d)\n", what, ret );
+        exit( 1 );
+    }
+}
 
 void test_msgpackalt( test_t* t, int nobj )
 {
-    int i, j;
-	msgpack_p *p;
-    msgpack_u *u;
+    int i, j, ret = 0;
+	msgpack_p p;                    /* packer and unpacker live on the stack and pack into */
+    msgpack_u u;                    /* a static buffer, only moving to the heap for large nobj */
+    static byte data[1<<16];
     const byte *buffer;
     uint32_t len;
     char dummy[256];
     
-    p = msgpack_pack_init( );
+    msgpack_pack_init_buffer( &p, data, sizeof( data ), NULL );
     for ( i = 0; i < nobj; ++i )
     {
-        msgpack_pack_int32( p, t->id );
-        msgpack_pack_int32( p, t->width );
-        msgpack_pack_int32( p, t->height );
-        msgpack_pack_str( p, t->str );
+        ret |= msgpack_pack_int32( &p, t->id );
+        ret |= msgpack_pack_int32( &p, t->width );
+        ret |= msgpack_pack_int32( &p, t->height );
+        ret |= msgpack_pack_str( &p, t->str );
     }
+    check(( MSGPACK_ERR )ret, "msgpackalt pack" );
     
-    msgpack_get_buffer( p, &buffer, &len );
-    u = msgpack_unpack_init( buffer, len );
+    check( msgpack_get_buffer( &p, &buffer, &len ), "msgpack_get_buffer" );
+    msgpack_unpack_init_fixed( &u, buffer, len );
     
     for ( i = 0; i < nobj; ++i )
     {
-        msgpack_unpack_int32( u, &j );
-        msgpack_unpack_int32( u, &j );
-        msgpack_unpack_int32( u, &j );
-        msgpack_unpack_str( u, dummy, 256 );
+        ret |= msgpack_unpack_int32( &u, &j );
+        ret |= msgpack_unpack_int32( &u, &j );
+        ret |= msgpack_unpack_int32( &u, &j );
+        ret |= msgpack_unpack_str( &u, dummy, 256 );
     }
+    check(( MSGPACK_ERR )ret, "msgpackalt unpack" );
     
-    msgpack_pack_free( p );
-    msgpack_unpack_free( u );
+    msgpack_pack_free( &p );
+    msgpack_unpack_free( &u );
 }
 
+void test_msgpackgen( test_t* t, int nobj )
+{
+    int i, ret = 0;
+    msgpack_p p;                    /* same buffers as above, but each object is */
+    msgpack_u u;                    /* one reserve and straight-line unchecked writes */
+    static byte data[1<<16];
+    const byte *buffer;
+    uint32_t len;
+    Test x;
+    
+    x.id = t->id;
+    x.width = t->width;
+    x.height = t->height;
+    x.data.data = ( const byte* )t->str;
+    x.data.n = strlen( t->str );
+    
+    msgpack_pack_init_buffer( &p, data, sizeof( data ), NULL );
+    for ( i = 0; i < nobj; ++i )
+        ret |= Test_pack( &p, &x );
+    check(( MSGPACK_ERR )ret, "Test_pack" );
+    
+    check( msgpack_get_buffer( &p, &buffer, &len ), "msgpack_get_buffer" );
+    msgpack_unpack_init_fixed( &u, buffer, len );
+    
+    for ( i = 0; i < nobj; ++i )
+        ret |= Test_unpack( &u, &x, NULL );
+    check(( MSGPACK_ERR )ret, "Test_unpack" );
+    
+    msgpack_pack_free( &p );
+    msgpack_unpack_free( &u );
+}
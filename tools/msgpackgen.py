@@ -0,0 +1,611 @@
+#!/usr/bin/env python3
+"""
+----------------------------------------------------------------------
+MSGPACKALT :: schema compiler
+----------------------------------------------------------------------
+Reads a protobuf-style schema and writes C structs with straight-line
+msgpackalt encoders and decoders for them:
+
+	python3 msgpackgen.py test_proto.proto [-o outdir]
+
+produces test_proto_mpk.h and test_proto_mpk.c. For every message Foo:
+
+	MSGPACK_ERR Foo_pack( msgpack_p *m, const Foo *x );      array of fields, in field-number order
+	MSGPACK_ERR Foo_pack_map( msgpack_p *m, const Foo *x );  map keyed by field name
+	MSGPACK_ERR Foo_unpack( msgpack_u *u, Foo *x, const msgpack_alloc *a );
+	void Foo_free( Foo *x, const msgpack_alloc *a );
+
+Encoders reserve room once for each run of bounded fields and then write them
+with the unchecked packers. The decoder accepts either form: arrays are read in
+fixed field order (runs of numbers unchecked once their room is known), and map
+keys are resolved with a perfect hash generated here. Strings and bytes decode
+in place as msgpack_slice pointing into the unpacker's buffer, which must
+outlive the struct. Repeated fields are allocated from "a" (NULL for malloc;
+an arena works well) and released by Foo_free. On error the unpacker is left
+where it was and nothing stays allocated.
+
+Supported: messages, enums, the scalar types, string, bytes, nested messages
+and required/optional/repeated labels (proto2 or proto3 syntax). Missing
+required fields fail with MSGPACK_TYPEERR; unknown keys and surplus array
+entries are skipped.
+"""
+import argparse
+import os
+import re
+import sys
+
+# wire type: (C type, unchecked/checked suffix, worst-case packed size or 0)
+SCALARS = {
+	'int32':    ( 'int32_t',  'int32',  5 ),
+	'sint32':   ( 'int32_t',  'int32',  5 ),
+	'sfixed32': ( 'int32_t',  'int32',  5 ),
+	'int64':    ( 'int64_t',  'int64',  9 ),
+	'sint64':   ( 'int64_t',  'int64',  9 ),
+	'sfixed64': ( 'int64_t',  'int64',  9 ),
+	'uint32':   ( 'uint32_t', 'uint32', 5 ),
+	'fixed32':  ( 'uint32_t', 'uint32', 5 ),
+	'uint64':   ( 'uint64_t', 'uint64', 9 ),
+	'fixed64':  ( 'uint64_t', 'uint64', 9 ),
+	'float':    ( 'float',    'float',  5 ),
+	'double':   ( 'double',   'double', 9 ),
+	'bool':     ( 'bool',     'bool',   1 ),
+}
+FNV_PRIME = 16777619
+
+
+class SchemaError( Exception ):
+	pass
+
+
+class Field( object ):
+	def __init__( self, label, type, name, number ):
+		self.label, self.type, self.name, self.number = label, type, name, number
+		self.kind = None		# scalar, enum, string, bytes or message
+
+	@property
+	def repeated( self ):
+		return self.label == 'repeated'
+
+	@property
+	def required( self ):
+		return self.label == 'required'
+
+
+class Schema( object ):
+	def __init__( self ):
+		self.messages = []		# ( name, [Field] ) in dependency order
+		self.enums = []			# ( name, [( value name, number )] )
+
+
+# ******************************** PARSER ********************************
+TOKEN = re.compile( r'\s*(?:(//[^\n]*|/\*.*?\*/)|("(?:[^"\\]|\\.)*")|([A-Za-z_][\w.]*)|(-?\d+)|(.))', re.S )
+
+def tokenize( text ):
+	pos = 0
+	while pos < len( text ):
+		m = TOKEN.match( text, pos )
+		if not m or m.end( ) == pos:
+			break
+		pos = m.end( )
+		if m.group( 1 ):
+			continue
+		tok = m.group( 2 ) or m.group( 3 ) or m.group( 4 ) or m.group( 5 )
+		if tok and not tok.isspace( ):
+			yield tok
+
+class Parser( object ):
+	def __init__( self, text ):
+		self.toks = list( tokenize( text ))
+		self.i = 0
+
+	def peek( self ):
+		return self.toks[self.i] if self.i < len( self.toks ) else None
+
+	def next( self ):
+		tok = self.peek( )
+		if tok is None:
+			raise SchemaError( 'unexpected end of schema' )
+		self.i += 1
+		return tok
+
+	def expect( self, tok ):
+		got = self.next( )
+		if got != tok:
+			raise SchemaError( 'expected "%s" but found "%s"' % ( tok, got ))
+
+	def skip_statement( self ):
+		while self.next( ) != ';':
+			pass
+
+	def parse( self ):
+		schema = Schema( )
+		messages = {}
+		while self.peek( ) is not None:
+			tok = self.next( )
+			if tok in ( 'syntax', 'package', 'option', 'import' ):
+				self.skip_statement( )
+			elif tok == 'message':
+				name = self.next( )
+				messages[name] = self.parse_message( )
+				schema.messages.append(( name, messages[name] ))
+			elif tok == 'enum':
+				schema.enums.append( self.parse_enum( ))
+			elif tok != ';':
+				raise SchemaError( 'unexpected "%s"' % tok )
+		resolve( schema )
+		return schema
+
+	def parse_enum( self ):
+		name = self.next( )
+		self.expect( '{' )
+		values = []
+		while self.peek( ) != '}':
+			if self.peek( ) == 'option':
+				self.skip_statement( )
+				continue
+			value = self.next( )
+			self.expect( '=' )
+			values.append(( value, int( self.next( ))))
+			self.skip_options( )
+			self.expect( ';' )
+		self.next( )
+		return ( name, values )
+
+	def parse_message( self ):
+		self.expect( '{' )
+		fields = []
+		while self.peek( ) != '}':
+			tok = self.next( )
+			if tok in ( 'option', 'reserved', 'extensions' ):
+				self.skip_statement( )
+				continue
+			if tok in ( 'message', 'enum', 'oneof', 'map' ):
+				raise SchemaError( 'nested "%s" definitions are not supported' % tok )
+			label = 'optional'
+			if tok in ( 'required', 'optional', 'repeated' ):
+				label, tok = tok, self.next( )
+			name = self.next( )
+			self.expect( '=' )
+			fields.append( Field( label, tok, name, int( self.next( ))))
+			if self.skip_options( ) and label == 'repeated':
+				pass	# [packed=true] has no meaning here: numeric arrays are always packed in bulk
+			self.expect( ';' )
+		self.next( )
+		return sorted( fields, key = lambda f: f.number )
+
+	def skip_options( self ):
+		if self.peek( ) != '[':
+			return False
+		while self.next( ) != ']':
+			pass
+		return True
+
+
+def resolve( schema ):
+	""" classify every field, and order messages so each follows those it contains """
+	enums = set( name for name, values in schema.enums )
+	messages = dict( schema.messages )
+	for name, fields in schema.messages:
+		if len( fields ) > 64:
+			raise SchemaError( 'message %s has more than 64 fields' % name )
+		seen = set( )
+		for f in fields:
+			if f.name in seen or f.number in seen:
+				raise SchemaError( 'duplicate field %s in message %s' % ( f.name, name ))
+			seen.update(( f.name, f.number ))
+			if f.type in SCALARS:
+				f.kind = 'scalar'
+			elif f.type in ( 'string', 'bytes' ):
+				f.kind = f.type
+			elif f.type in enums:
+				f.kind = 'enum'
+			elif f.type in messages:
+				f.kind = 'message'
+			else:
+				raise SchemaError( 'unknown type %s of %s.%s' % ( f.type, name, f.name ))
+	order, state = [], {}
+	def visit( name, path ):
+		if state.get( name ) == 'done':
+			return
+		if state.get( name ) == 'open':
+			raise SchemaError( 'message %s contains itself via %s' % ( name, ' -> '.join( path )))
+		state[name] = 'open'
+		for f in messages[name]:
+			if f.kind == 'message' and not f.repeated:
+				visit( f.type, path + [f.name] )
+		state[name] = 'done'
+		order.append(( name, messages[name] ))
+	for name, fields in schema.messages:
+		visit( name, [name] )
+	# a repeated message is held by pointer, so it only needs a forward declaration
+	schema.messages = order
+
+
+# ******************************** PERFECT HASH ********************************
+def fnv( key, seed ):
+	h = seed
+	for c in key.encode( ):
+		h = (( h ^ c ) * FNV_PRIME ) & 0xffffffff
+	return ( h ^ ( h >> 16 )) & 0xffffffff
+
+def perfect_hash( keys ):
+	""" find the smallest power-of-two table and a seed giving every key its own slot """
+	size = 1
+	while size < len( keys ):
+		size <<= 1
+	while True:
+		for seed in range( 2166136261, 2166136261 + 4096 ):
+			slots = set( fnv( k, seed ) & ( size - 1 ) for k in keys )
+			if len( slots ) == len( keys ):
+				return seed, size
+		size <<= 1
+
+
+# ******************************** CODE GENERATION ********************************
+def c_type( f ):
+	if f.kind == 'scalar':
+		return SCALARS[f.type][0]
+	if f.kind in ( 'string', 'bytes' ):
+		return 'msgpack_slice'
+	return f.type
+
+def bound( f ):
+	""" worst-case packed size of a singular field if it can be reserved for, as a C expression """
+	if f.repeated:
+		return None
+	if f.kind == 'scalar':
+		return str( SCALARS[f.type][2] )
+	if f.kind == 'enum':
+		return '5'
+	if f.kind == 'string':
+		return '5 + x->%s.n' % f.name
+	return None
+
+def key_size( name ):
+	n = len( name.encode( ))
+	return ( 1 if n < 32 else 3 if n < 65536 else 5 ) + n
+
+def head_size( n ):
+	return 1 if n < 16 else 3 if n < 65536 else 5
+
+def c_string( s ):
+	return '"%s"' % s.replace( '\\', '\\\\' ).replace( '"', '\\"' )
+
+def put( f ):
+	""" unchecked write of a bounded field """
+	if f.kind == 'scalar':
+		return 'msgpack_unchecked_pack_%s( m, x->%s );' % ( SCALARS[f.type][1], f.name )
+	if f.kind == 'enum':
+		return 'msgpack_unchecked_pack_int32( m, ( int32_t )x->%s );' % f.name
+	return 'msgpack_unchecked_pack_raw( m, x->%s.data, x->%s.n );' % ( f.name, f.name )
+
+def pack( f, out, ind ):
+	""" checked write of any field """
+	name = 'x->' + f.name
+	if not f.repeated:
+		if f.kind == 'scalar':
+			out.append( ind + 'if (( ret = msgpack_pack_%s( m, %s ))) return ret;' % ( SCALARS[f.type][1], name ))
+		elif f.kind == 'enum':
+			out.append( ind + 'if (( ret = msgpack_pack_int32( m, ( int32_t )%s ))) return ret;' % name )
+		elif f.kind == 'string':
+			out.append( ind + 'if (( ret = msgpack_pack_raw( m, %s.data, %s.n ))) return ret;' % ( name, name ))
+		elif f.kind == 'bytes':
+			out.append( ind + 'if (( ret = msgpack_pack_bin( m, %s.data, %s.n ))) return ret;' % ( name, name ))
+		else:
+			out.append( ind + 'if (( ret = %s_pack( m, &%s ))) return ret;' % ( f.type, name ))
+		return
+	if f.kind == 'scalar' and f.type != 'bool':
+		out.append( ind + 'if (( ret = msgpack_pack_%s_array( m, %s, %s_n ))) return ret;' % ( SCALARS[f.type][1], name, name ))
+		return
+	item = '%s[i]' % name
+	out.append( ind + 'if (( ret = msgpack_pack_array( m, %s_n ))) return ret;' % name )
+	out.append( ind + 'for ( i = 0; i < %s_n; ++i )' % name )
+	if f.kind == 'scalar':
+		call = 'msgpack_pack_bool( m, %s )' % item
+	elif f.kind == 'enum':
+		call = 'msgpack_pack_int32( m, ( int32_t )%s )' % item
+	elif f.kind == 'string':
+		call = 'msgpack_pack_raw( m, %s.data, %s.n )' % ( item, item )
+	elif f.kind == 'bytes':
+		call = 'msgpack_pack_bin( m, %s.data, %s.n )' % ( item, item )
+	else:
+		call = '%s_pack( m, &%s )' % ( f.type, item )
+	out.append( ind + '\tif (( ret = %s )) return ret;' % call )
+
+def gen_pack( name, fields, keyed ):
+	""" body of Foo_pack or Foo_pack_map: reserve once per run of bounded fields, then write unchecked """
+	out, run, first = [], [], True
+	loops = any( f.repeated and not ( f.kind == 'scalar' and f.type != 'bool' ) for f in fields )
+	def flush( ):
+		if not run and not first:
+			return
+		terms = []
+		if first:
+			terms.append( str( head_size( len( fields ))))
+		for f in run:
+			if keyed:
+				terms.append( str( key_size( f.name )))
+			terms.append( bound( f ))
+		out.append( '\tif (( ret = msgpack_pack_reserve( m, %s ))) return ret;' % ' + '.join( terms ))
+		if first:
+			out.append( '\tmsgpack_unchecked_pack_%s( m, %d );' % ( 'map' if keyed else 'array', len( fields )))
+		for f in run:
+			if keyed:
+				out.append( '\tmsgpack_unchecked_pack_raw( m, %s, %d );' % ( c_string( f.name ), len( f.name.encode( ))))
+			out.append( '\t' + put( f ))
+		del run[:]
+	for f in fields:
+		if bound( f ):
+			run.append( f )
+			continue
+		flush( )
+		first = False
+		if keyed:
+			out.append( '\tif (( ret = msgpack_pack_raw( m, %s, %d ))) return ret;' % ( c_string( f.name ), len( f.name.encode( ))))
+		pack( f, out, '\t' )
+	flush( )
+	decl = [ '\tMSGPACK_ERR ret;' ]
+	if loops:
+		decl.append( '\tuint32_t i;' )
+	return decl + out + [ '\treturn MSGPACK_SUCCESS;' ]
+
+def get( f, ind, out, checked = True ):
+	""" read one field from u into x, jumping to fail on error """
+	name = 'x->' + f.name
+	pre = 'msgpack_unpack_' if checked else 'msgpack_unchecked_'
+	if not f.repeated:
+		if f.kind == 'scalar' and f.type == 'bool':
+			out.append( ind + 'if (( k = %sbool( u )) < 0 ) { ret = ( MSGPACK_ERR )k; goto fail; }' % pre )
+			out.append( ind + '%s = k;' % name )
+		elif f.kind == 'scalar':
+			out.append( ind + 'if (( ret = %s%s( u, &%s ))) goto fail;' % ( pre, SCALARS[f.type][1], name ))
+		elif f.kind == 'enum':
+			out.append( ind + 'if (( ret = %sint32( u, &e ))) goto fail;' % pre )
+			out.append( ind + '%s = ( %s )e;' % ( name, f.type ))
+		elif f.kind in ( 'string', 'bytes' ):
+			out.append( ind + 'if (( ret = msgpack_unpack_raw( u, &%s.data, &%s.n ))) goto fail;' % ( name, name ))
+		else:
+			out.append( ind + 'if (( ret = %s_unpack( u, &%s, a ))) goto fail;' % ( f.type, name ))
+		return
+	if f.kind == 'scalar' and f.type != 'bool':
+		fn = 'msgpack_unpack_%s_array' % SCALARS[f.type][1]
+		out.append( ind + 'ret = %s( u, NULL, 0, &n );' % fn )
+		out.append( ind + 'if (( ret == MSGPACK_MEMERR ) && n ) {' )
+		out.append( ind + '\tif ( n > msgpack_unpack_len( u )) { ret = MSGPACK_NEEDMORE; goto fail; }' )
+		out.append( ind + '\tret = MSGPACK_MEMERR;' )
+		out.append( ind + '\tif ( !( %s = ( %s* )msgpack_malloc( a, n*sizeof( *%s )))) goto fail;' % ( name, c_type( f ), name ))
+		out.append( ind + '\t%s_n = n;' % name )
+		out.append( ind + '\tret = %s( u, %s, n, &n );' % ( fn, name ))
+		out.append( ind + '}' )
+		out.append( ind + 'if ( ret ) goto fail;' )
+		return
+	item = '%s[i]' % name
+	out.append( ind + 'if (( ret = msgpack_unpack_array( u, &n ))) goto fail;' )
+	out.append( ind + 'if ( n ) {' )
+	out.append( ind + '\tif ( n > msgpack_unpack_len( u )) { ret = MSGPACK_NEEDMORE; goto fail; }' )
+	out.append( ind + '\tret = MSGPACK_MEMERR;' )
+	out.append( ind + '\tif ( !( %s = ( %s* )msgpackgen_calloc( a, n, sizeof( *%s )))) goto fail;' % ( name, c_type( f ), name ))
+	out.append( ind + '\t%s_n = n;' % name )
+	out.append( ind + '}' )
+	out.append( ind + 'for ( i = 0; i < n; ++i ) {' )
+	if f.kind == 'scalar':
+		out.append( ind + '\tif (( k = msgpack_unpack_bool( u )) < 0 ) { ret = ( MSGPACK_ERR )k; goto fail; }' )
+		out.append( ind + '\t%s = k;' % item )
+	elif f.kind == 'enum':
+		out.append( ind + '\tif (( ret = msgpack_unpack_int32( u, &e ))) goto fail;' )
+		out.append( ind + '\t%s = ( %s )e;' % ( item, f.type ))
+	elif f.kind in ( 'string', 'bytes' ):
+		out.append( ind + '\tif (( ret = msgpack_unpack_raw( u, &%s.data, &%s.n ))) goto fail;' % ( item, item ))
+	else:
+		out.append( ind + '\tif (( ret = %s_unpack( u, &%s, a ))) goto fail;' % ( f.type, item ))
+	out.append( ind + '}' )
+
+def fixed( f ):
+	return not f.repeated and f.kind in ( 'scalar', 'enum' )
+
+def gen_unpack( name, fields ):
+	out = []
+	nf = len( fields )
+	required = 0
+	for i, f in enumerate( fields ):
+		if f.required:
+			required |= 1 << i
+	uses = lambda pred: any( pred( f ) for f in fields )
+	decl = [ '\tMSGPACK_ERR ret;', '\tconst byte *p0;', '\tuint32_t j, nfield;', '\tuint64_t seen = 0;', '\tint f, k2;' ]
+	if uses( lambda f: f.repeated ):
+		decl.append( '\tuint32_t n;' )
+	if uses( lambda f: f.kind == 'scalar' and f.type == 'bool' ):
+		decl.append( '\tint k;' )
+	if uses( lambda f: f.kind == 'enum' ):
+		decl.append( '\tint32_t e;' )
+	if uses( lambda f: f.repeated and not ( f.kind == 'scalar' and f.type != 'bool' )):
+		decl.append( '\tuint32_t i;' )
+	decl += [ '\tconst byte *key;', '\tuint32_t nkey;' ]
+	out.append( '\tif ( !u || !u->p || !x ) return MSGPACK_ARGERR;' )
+	out.append( '\tp0 = u->p;' )
+	out.append( '\tmemset( x, 0, sizeof( *x ));' )
+	# map form: resolve each key with the perfect hash
+	out.append( '\tif ( msgpack_unpack_peek( u ) == MSGPACK_MAP ) {' )
+	out.append( '\t\tif (( ret = msgpack_unpack_map( u, &nfield ))) goto fail;' )
+	out.append( '\t\tfor ( j = 0; j < nfield; ++j ) {' )
+	out.append( '\t\t\tif (( ret = msgpack_unpack_raw( u, &key, &nkey ))) goto fail;' )
+	out.append( '\t\t\tif (( f = %s_field( key, nkey )) < 0 ) {' % name )
+	out.append( '\t\t\t\tif (( k2 = msgpack_unpack_skip( u )) < 0 ) { ret = ( MSGPACK_ERR )k2; goto fail; }' )
+	out.append( '\t\t\t\tcontinue;' )
+	out.append( '\t\t\t}' )
+	out.append( '\t\t\tif ( seen & (( uint64_t )1 << f )) { ret = MSGPACK_TYPEERR; goto fail; }\t/* repeated key */' )
+	out.append( '\t\t\tseen |= ( uint64_t )1 << f;' )
+	out.append( '\t\t\tswitch ( f ) {' )
+	for i, f in enumerate( fields ):
+		out.append( '\t\t\t\tcase %d:' % i )
+		get( f, '\t\t\t\t\t', out )
+		out.append( '\t\t\t\t\tbreak;' )
+	out.append( '\t\t\t}' )
+	out.append( '\t\t}' )
+	out.append( '\t} else {' )
+	# array form: fixed field order, each run of numbers read unchecked once its room is known
+	out.append( '\t\tif (( ret = msgpack_unpack_array( u, &nfield ))) goto fail;' )
+	i = 0
+	while i < nf:
+		j = i
+		while j < nf and fixed( fields[j] ):
+			j += 1
+		if j - i > 1:
+			room = sum( 5 if f.kind == 'enum' else SCALARS[f.type][2] for f in fields[i:j] )
+			out.append( '\t\tif (( nfield >= %d ) && ( msgpack_unpack_len( u ) >= %d )) {' % ( j, room ))
+			for f in fields[i:j]:
+				get( f, '\t\t\t', out, False )
+			out.append( '\t\t} else {' )
+			for k, f in enumerate( fields[i:j] ):
+				out.append( '\t\t\tif ( nfield > %d ) {' % ( i + k ))
+				get( f, '\t\t\t\t', out )
+				out.append( '\t\t\t}' )
+			out.append( '\t\t}' )
+			i = j
+			continue
+		f = fields[i]
+		out.append( '\t\tif ( nfield > %d ) {' % i )
+		get( f, '\t\t\t', out )
+		out.append( '\t\t}' )
+		i += 1
+	out.append( '\t\tseen = nfield >= %d ? ~( uint64_t )0 : (( uint64_t )1 << nfield ) - 1;' % nf )
+	out.append( '\t\tfor ( j = %d; j < nfield; ++j )' % nf )
+	out.append( '\t\t\tif (( k2 = msgpack_unpack_skip( u )) < 0 ) { ret = ( MSGPACK_ERR )k2; goto fail; }' )
+	out.append( '\t}' )
+	if required:
+		out.append( '\tif (( seen & 0x%xull ) != 0x%xull ) { ret = MSGPACK_TYPEERR; goto fail; }' % ( required, required ))
+	else:
+		out.append( '\t( void )seen;' )
+	out.append( '\treturn MSGPACK_SUCCESS;' )
+	out.append( 'fail:' )
+	out.append( '\t%s_free( x, a );' % name )
+	out.append( '\tu->p = p0;' )
+	out.append( '\treturn ret;' )
+	return decl + out
+
+def gen_free( name, fields ):
+	out = []
+	loops = any( f.repeated and f.kind == 'message' for f in fields )
+	if loops:
+		out.append( '\tuint32_t i;' )
+	out.append( '\tif ( !x ) return;' )
+	if not any( f.repeated or f.kind == 'message' for f in fields ):
+		out.append( '\t( void )a;' )
+	for f in fields:
+		if f.kind == 'message' and not f.repeated:
+			out.append( '\t%s_free( &x->%s, a );' % ( f.type, f.name ))
+		elif f.repeated:
+			out.append( '\tif ( x->%s ) {' % f.name )
+			if f.kind == 'message':
+				out.append( '\t\tfor ( i = 0; i < x->%s_n; ++i ) %s_free( &x->%s[i], a );' % ( f.name, f.type, f.name ))
+			out.append( '\t\tmsgpack_free( a, x->%s, x->%s_n*sizeof( *x->%s ));' % ( f.name, f.name, f.name ))
+			out.append( '\t}' )
+	out.append( '\tmemset( x, 0, sizeof( *x ));' )
+	return out
+
+def gen_hash( name, fields ):
+	keys = [ f.name for f in fields ]
+	seed, size = perfect_hash( keys ) if keys else ( 2166136261, 1 )
+	slot = [ -1 ] * size
+	for i, k in enumerate( keys ):
+		slot[fnv( k, seed ) & ( size - 1 )] = i
+	names = ', '.join( c_string( keys[s] ) if s >= 0 else 'NULL' for s in slot )
+	lens = ', '.join( str( len( keys[s].encode( ))) if s >= 0 else '0' for s in slot )
+	index = ', '.join( str( s ) for s in slot )
+	return [
+		'/* field index of a map key, or -1: a perfect hash over the field names */',
+		'static int %s_field( const byte *k, uint32_t n )' % name,
+		'{',
+		'\tstatic const char *const name[%d] = { %s };' % ( size, names ),
+		'\tstatic const uint32_t len[%d] = { %s };' % ( size, lens ),
+		'\tstatic const signed char index[%d] = { %s };' % ( size, index ),
+		'\tuint32_t i, h = %du;' % seed,
+		'\tfor ( i = 0; i < n; ++i ) h = ( h ^ k[i] )*%du;' % FNV_PRIME,
+		'\th = ( h ^ ( h >> 16 )) & %d;' % ( size - 1 ),
+		'\treturn (( index[h] >= 0 ) && ( len[h] == n ) && !memcmp( name[h], k, n )) ? index[h] : -1;',
+		'}',
+	]
+
+def generate( schema, base, source ):
+	guard = re.sub( r'\W', '_', base ).upper( ) + '_MPK_H'
+	banner = [
+		'/* generated by msgpackgen.py from %s -- do not edit */' % os.path.basename( source ),
+	]
+	h = banner + [ '#ifndef %s' % guard, '#define %s' % guard, '', '#include "msgpackalt.h"', '',
+		'#ifdef __cplusplus', 'extern "C" {', '#endif', '',
+		'#ifndef MSGPACKGEN_SLICE', '#define MSGPACKGEN_SLICE',
+		'/// A string or bytes field, decoded in place: it points into the unpacker\'s buffer',
+		'typedef struct {', '\tconst byte *data;\t///< First byte', '\tuint32_t n;\t\t\t///< Number of bytes', '} msgpack_slice;',
+		'#endif', '' ]
+	for name, values in schema.enums:
+		h.append( 'typedef enum {' )
+		for v, n in values:
+			h.append( '\t%s = %d,' % ( v, n ))
+		h.append( '} %s;' % name )
+		h.append( '' )
+	for name, fields in schema.messages:
+		h.append( 'typedef struct %s %s;' % ( name, name ))
+	h.append( '' )
+	for name, fields in schema.messages:
+		h.append( 'struct %s {' % name )
+		for f in fields:
+			if f.repeated:
+				h.append( '\t%s *%s;\t///< field %d' % ( c_type( f ), f.name, f.number ))
+				h.append( '\tuint32_t %s_n;' % f.name )
+			else:
+				h.append( '\t%s %s;\t///< field %d%s' % ( c_type( f ), f.name, f.number, ', required' if f.required else '' ))
+		if not fields:
+			h.append( '\tbyte unused;' )
+		h.append( '};' )
+		h.append( '' )
+	for name, fields in schema.messages:
+		h += [
+			'/* %s */' % name,
+			'MSGPACK_ERR %s_pack( msgpack_p *m, const %s *x );' % ( name, name ),
+			'MSGPACK_ERR %s_pack_map( msgpack_p *m, const %s *x );' % ( name, name ),
+			'MSGPACK_ERR %s_unpack( msgpack_u *u, %s *x, const msgpack_alloc *a );' % ( name, name ),
+			'void %s_free( %s *x, const msgpack_alloc *a );' % ( name, name ),
+			'' ]
+	h += [ '#ifdef __cplusplus', '}', '#endif', '', '#endif', '' ]
+
+	c = banner + [ '#include "%s_mpk.h"' % base, '#include <string.h>', '' ]
+	if any( f.repeated and not ( f.kind == 'scalar' and f.type != 'bool' ) for name, fields in schema.messages for f in fields ):
+		c += [
+			'static void* msgpackgen_calloc( const msgpack_alloc *a, uint32_t n, uint32_t size )',
+			'{',
+			'\tvoid *p = msgpack_malloc( a, n*size );',
+			'\tif ( p ) memset( p, 0, n*size );',
+			'\treturn p;',
+			'}', '' ]
+	for name, fields in schema.messages:
+		c.append( '/* **************************************** %s **************************************** */' % name.upper( ))
+		c += gen_hash( name, fields )
+		c.append( '' )
+		c += [ 'MSGPACK_ERR %s_pack( msgpack_p *m, const %s *x )' % ( name, name ), '{' ] + gen_pack( name, fields, False ) + [ '}', '' ]
+		c += [ 'MSGPACK_ERR %s_pack_map( msgpack_p *m, const %s *x )' % ( name, name ), '{' ] + gen_pack( name, fields, True ) + [ '}', '' ]
+		c += [ 'void %s_free( %s *x, const msgpack_alloc *a )' % ( name, name ), '{' ] + gen_free( name, fields ) + [ '}', '' ]
+		c += [ 'MSGPACK_ERR %s_unpack( msgpack_u *u, %s *x, const msgpack_alloc *a )' % ( name, name ), '{' ] + gen_unpack( name, fields ) + [ '}', '' ]
+	return '\n'.join( h ), '\n'.join( c )
+
+
+def main( ):
+	ap = argparse.ArgumentParser( description = 'Generate msgpackalt C encoders/decoders from a protobuf-style schema' )
+	ap.add_argument( 'schema', help = 'the .proto schema' )
+	ap.add_argument( '-o', '--outdir', default = None, help = 'output directory (default: next to the schema)' )
+	args = ap.parse_args( )
+	try:
+		with open( args.schema ) as fp:
+			schema = Parser( fp.read( )).parse( )
+	except ( IOError, SchemaError ) as e:
+		sys.stderr.write( '%s: %s\n' % ( args.schema, e ))
+		return 1
+	base = os.path.splitext( os.path.basename( args.schema ))[0]
+	outdir = args.outdir or os.path.dirname( args.schema ) or '.'
+	h, c = generate( schema, base, args.schema )
+	for ext, text in (( 'h', h ), ( 'c', c )):
+		with open( os.path.join( outdir, '%s_mpk.%s' % ( base, ext )), 'w', newline = '\r\n' ) as fp:
+			fp.write( text )
+	return 0
+
+if __name__ == '__main__':
+	sys.exit( main( ))
@@ -0,0 +1,155 @@
+/*
+----------------------------------------------------------------------
+MSGPACKALT :: a simple binary serialisation library
+http://code.google.com/p/msgpackalt
+----------------------------------------------------------------------
+Unit testing code -- C++ interface
+
+Checks the parts of msgpackalt.hpp that do more than forward to the C
+library: lookups, duplicate and non-string keys and iteration of a
+map_view, the error paths of package_view, the reset and shrink policy
+of packer_pool, and bulk arrays of every fundamental integer type.
+*/
+#define MSGPACK_INLINE
+#include "msgpackalt.hpp"
+#include <cstdio>
+using namespace msgpackalt;
+
+static int nfail = 0;
+#define CHECK( x )		do { if ( !( x )) { printf( "  line %d: %s\n", __LINE__, #x ); ++nfail; } } while ( 0 )
+
+/// A sink that only counts what it is given
+static int count_sink( void *ctx, const byte*, uint32_t n )	{ *( uint32_t* )ctx += n; return 0; }
+
+#define CHECK_THROWS( E, stmt )	do { bool threw = false; try { stmt; } catch ( E& ) { threw = true; } CHECK( threw ); } while ( 0 )
+
+int main( )
+{
+	puts( "1. map_view lookups" );
+	{
+		packer p;
+		char k[16];
+		p.start_map( 51 );
+		for ( int i = 0; i < 50; ++i ) { snprintf( k, sizeof( k ), "key%d", i ); p << std::string( k ) << i*3; }
+		p << std::string( "msg" ) << std::string( "hello" );
+		p << 99;
+		std::string s = p.string( );
+		unpacker u( s );
+		map_view m( u );
+		package_view v;
+		CHECK( m.size( ) == 51 && u.len( ) == 1 );
+		CHECK( m.find( "key17", v ) && v.as<int>( ) == 51 );
+		CHECK( m["key49"].as<int>( ) == 147 );
+		CHECK( m[std::string( "msg" )].as<std::string>( ) == "hello" );
+		CHECK( !m.find( "key50", v ) && m["key50"].empty( ));
+		CHECK( !m.find( "key1", 3, v ));		// prefix of a key
+		int x = 0; u >> x; CHECK( x == 99 );
+	}
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "2. map_view duplicate and non-string keys" );
+	{
+		packer p;
+		p.start_map( 5 );
+		p << std::string( "a" ) << 1 << std::string( "a" ) << 2 << std::string( "" ) << 3;
+		p << 7 << std::string( "int key" );
+		p.start_array( 1 ); p << 0; p << 4;
+		std::string s = p.string( );
+		map_view m( s.data( ), ( uint32_t )s.size( ));
+		CHECK( m["a"].as<int>( ) == 1 && m[""].as<int>( ) == 3 );
+		CHECK( m["\x07"].empty( ));			// the integer key is only reachable by iterating
+	}
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "3. map_view iteration" );
+	{
+		packer p;
+		p.start_map( 3 );
+		p << std::string( "x" ) << 1;
+		p << 7 << std::string( "int key" );
+		p << std::string( "nested" ); p.start_map( 1 ); p << std::string( "y" ) << 2.5;
+		std::string s = p.string( );
+		map_view m( s.data( ), ( uint32_t )s.size( ));
+		int n = 0;
+		for ( map_view::const_iterator i = m.begin( ); i != m.end( ); ++i ) ++n;
+		CHECK( n == 3 );
+		map_view::const_iterator i = m.begin( );
+		CHECK( i->key.as<std::string>( ) == "x" && i->value.as<int>( ) == 1 );
+		++i; CHECK( i->key.as<int>( ) == 7 && i->value.as<std::string>( ) == "int key" );
+		packer q; q << i->value; CHECK( q.string( ) == std::string( "\xa7int key" ));
+		++i; map_view nested( i->value ); CHECK( nested["y"].as<double>( ) == 2.5 );
+		++i; CHECK( i == m.end( ));
+		
+		packer e; e.start_map( 0 ); e << 5;
+		std::string es = e.string( );
+		unpacker eu( es );
+		map_view em( eu );
+		CHECK( em.size( ) == 0 && em.begin( ) == em.end( ) && em["a"].empty( ));
+		CHECK_THROWS( std::out_of_range, map_view bad( eu ));	// not a map, and nothing is consumed
+		CHECK( eu.len( ) == 1 );
+		CHECK_THROWS( std::underflow_error, map_view t( s.data( ), 8 ));	// truncated
+	}
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "4. package_view errors" );
+	{
+		package_view bad( NULL, 4 );
+		int x = 0;
+		CHECK( bad.try_as( x ) == MSGPACK_ARGERR );
+		CHECK_THROWS( std::invalid_argument, bad.as<int>( ));
+	}
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "5. packer_pool" );
+	{
+		packer_pool pool( 2, 64, 16 );
+		uint32_t streamed = 0;
+		packer *p = pool.acquire( );
+		CHECK( p->capacity( ) >= 16 && pool.stats( ).misses == 1 );
+		p->set_sink( count_sink, &streamed, 8 );
+		p->set_zerocopy( 4 );
+		p->set_compat( true );
+		*p << std::string( "streamed out" );
+		pool.release( p );
+		CHECK( pool.acquire( ) == p && pool.stats( ).hits == 1 );
+		msgpack_p *m = p->ptr( );			// no sink, zero-copy or compat mode is passed on
+		CHECK( !m->sink && !m->sink_ctx && !m->watermark && m->sg && !m->sg->threshold );
+		std::string s( 100, 'x' );
+		*p << s;
+		CHECK( p->len( ) == 102 && msgpack_get_iovcnt( m ) == 1 && streamed == 13 );
+		p->pack_bin( "", 0 );
+		CHECK( p->len( ) == 104 );
+		const uint64_t shrinks = pool.stats( ).shrinks;
+		pool.release( p );				// grew past the high-water mark
+		CHECK( pool.stats( ).shrinks == shrinks + 1 && pool.stats( ).idle == 1 && pool.stats( ).retained <= 64 );
+		{
+			pooled_packer a( pool ), b( pool ), c( pool );
+			CHECK( &*a == p && pool.stats( ).idle == 0 && pool.stats( ).misses == 3 );
+		}
+		CHECK( pool.stats( ).idle == 2 && pool.stats( ).discards == 1 );
+	}
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "6. Bulk arrays of any integer type" );
+	{
+		const long long ll[4] = { -1, 300, -70000, 1LL<<40 };
+		const int64_t i64[4] = { -1, 300, -70000, 1LL<<40 };
+		const char c[3] = { 'a', 'b', 'c' };
+		const unsigned long ul[2] = { 7, 4000000000ul };
+		packer p, q;
+		p.pack_array( ll, 4 ); p.pack_array( c, 3 ); p.pack_array( ul, 2 );
+		q.pack_array( i64, 4 );
+		q.start_array( 3 ); q << ( int8_t )'a' << ( int8_t )'b' << ( int8_t )'c';
+		q.start_array( 2 ); q << ( uint32_t )7 << ( uint32_t )4000000000ul;
+		CHECK( p.string( ) == q.string( ));
+		std::vector<long long> vll; std::vector<char> vc; std::vector<unsigned long> vul;
+		unpacker u( p.string( ));
+		u >> vll >> vc >> vul;
+		CHECK( vll.size( ) == 4 && vll[3] == ( 1LL<<40 ) && vll[2] == -70000 );
+		CHECK( vc.size( ) == 3 && vc[2] == 'c' && vul.size( ) == 2 && vul[1] == 4000000000ul );
+	}
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	printf( "Failed %d C++ interface tests\n", nfail );
+	return nfail != 0;
+}
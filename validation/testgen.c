@@ -0,0 +1,95 @@
+/*
+----------------------------------------------------------------------
+MSGPACKALT :: a simple binary serialisation library
+http://code.google.com/p/msgpackalt
+----------------------------------------------------------------------
+Unit testing code -- generated encoders and decoders
+
+Round-trips a struct with nested, repeated and optional fields through
+the code tools/msgpackgen.py writes for testgen.proto, in both the array
+and the map form, and checks that the decoder fills in missing optional
+fields, refuses missing required ones and skips unknown keys.
+
+The makefile generates testgen_mpk.h and testgen_mpk.c before building.
+*/
+#define MSGPACK_INLINE
+#include "msgpackalt.h"
+#include "testgen_mpk.c"
+#include <stdio.h>
+
+#define SLICE( s )	{ ( const byte* )( s ), sizeof( s ) - 1 }
+
+static int slice_eq( msgpack_slice a, msgpack_slice b )	{ return a.n == b.n && ( !a.n || memcmp( a.data, b.data, a.n ) == 0 ); }
+
+static int point_eq( const Point *a, const Point *b )	{ return a->x == b->x && a->y == b->y && slice_eq( a->label, b->label ); }
+
+static int shape_eq( const Shape *a, const Shape *b )
+{
+	uint32_t i;
+	if ( a->id != b->id || a->kind != b->kind || !point_eq( &a->origin, &b->origin ) || a->scale != b->scale || !slice_eq( a->blob, b->blob )) return 0;
+	if ( a->path_n != b->path_n || a->weights_n != b->weights_n || a->tags_n != b->tags_n || a->flags_n != b->flags_n ) return 0;
+	for ( i = 0; i < a->path_n; ++i ) if ( !point_eq( a->path + i, b->path + i )) return 0;
+	for ( i = 0; i < a->weights_n; ++i ) if ( a->weights[i] != b->weights[i] ) return 0;
+	for ( i = 0; i < a->tags_n; ++i ) if ( !slice_eq( a->tags[i], b->tags[i] )) return 0;
+	for ( i = 0; i < a->flags_n; ++i ) if ( a->flags[i] != b->flags[i] ) return 0;
+	return 1;
+}
+
+int main( )
+{
+	Point path[3] = { { -1, 2, SLICE( "a" ) }, { 100000, -100000, SLICE( "" ) }, { 0, 0, SLICE( "third point" ) } };
+	double weights[4] = { 0.5, -2, 1e300, 0 };
+	msgpack_slice tags[2] = { SLICE( "red" ), SLICE( "a rather longer tag of more than thirty-one bytes" ) };
+	bool flags[3] = { 1, 0, 1 };
+	Shape x, y;
+	msgpack_p *p;
+	msgpack_u u;
+	int nfail = 0;
+	
+	memset( &x, 0, sizeof( x ));
+	x.id = 0x123456789ull; x.kind = KIND_PATH; x.scale = 1.5f;
+	x.origin.x = -40; x.origin.y = 3; x.origin.label.data = ( const byte* )"origin"; x.origin.label.n = 6;
+	x.path = path; x.path_n = 3;
+	x.weights = weights; x.weights_n = 4;
+	x.tags = tags; x.tags_n = 2;
+	x.flags = flags; x.flags_n = 3;
+	x.blob.data = ( const byte* )"\0\1\2"; x.blob.n = 3;
+	p = msgpack_pack_init( );
+	
+	puts( "1. Array form" );
+	nfail += Shape_pack( p, &x ) != MSGPACK_SUCCESS;
+	msgpack_unpack_init_fixed( &u, p->buffer, msgpack_get_len( p ));
+	nfail += Shape_unpack( &u, &y, NULL ) || !shape_eq( &x, &y ) || msgpack_unpack_len( &u ) != 0;
+	Shape_free( &y, NULL );
+	msgpack_unpack_init_fixed( &u, p->buffer, msgpack_get_len( p ) - 1 );		// truncated: nothing left allocated
+	nfail += Shape_unpack( &u, &y, NULL ) == MSGPACK_SUCCESS || u.p != p->buffer;
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "2. Map form" );
+	msgpack_pack_reset( p );
+	nfail += Shape_pack_map( p, &x ) != MSGPACK_SUCCESS;
+	msgpack_unpack_init_fixed( &u, p->buffer, msgpack_get_len( p ));
+	nfail += Shape_unpack( &u, &y, NULL ) || !shape_eq( &x, &y ) || msgpack_unpack_len( &u ) != 0;
+	Shape_free( &y, NULL );
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	puts( "3. Missing and unknown fields" );
+	msgpack_pack_reset( p );		// only the required fields, plus a key the schema does not know
+	msgpack_pack_map( p, 3 );
+	msgpack_pack_str( p, "origin" ); msgpack_pack_array( p, 2 ); msgpack_pack_int32( p, 5 ); msgpack_pack_int32( p, 6 );
+	msgpack_pack_str( p, "unknown" ); msgpack_pack_map( p, 1 ); msgpack_pack_str( p, "k" ); msgpack_pack_null( p );
+	msgpack_pack_str( p, "id" ); msgpack_pack_uint8( p, 9 );
+	msgpack_unpack_init_fixed( &u, p->buffer, msgpack_get_len( p ));
+	nfail += Shape_unpack( &u, &y, NULL ) || y.id != 9 || y.origin.x != 5 || y.origin.y != 6 || y.origin.label.n != 0;
+	nfail += y.kind != KIND_NONE || y.path_n != 0 || y.tags_n != 0 || y.blob.n != 0 || y.scale != 0;
+	Shape_free( &y, NULL );
+	msgpack_pack_reset( p );		// "origin" is required
+	msgpack_pack_map( p, 1 ); msgpack_pack_str( p, "id" ); msgpack_pack_uint8( p, 9 );
+	msgpack_unpack_init_fixed( &u, p->buffer, msgpack_get_len( p ));
+	nfail += Shape_unpack( &u, &y, NULL ) != MSGPACK_TYPEERR || u.p != p->buffer;
+	printf( ">> %s\n", nfail ? "FAILED" : "Passed" );
+	
+	msgpack_pack_free( p );
+	printf( "Failed %d generated code tests\n", nfail );
+	return nfail != 0;
+}
@@ -27,6 +27,7 @@ const char test2[] = { 0xca, 0x00, 0x80, 0x00, 0x00, 0xca, 0x7f, 0x7f, 0xff, 0xf
 						0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 const char test3[] = { 0xa3, 0x61, 0x20, 0x62, 0xa1, 0x61, 0xa3, 0x61, 0x00, 0x62 };
 const char test4[] = { 0x83, 0xa3, 0x61, 0x62, 0x63, 0x92, 0xc2, 0xa1, 0x64, 0xa3, 0x78, 0x79, 0x7a, 0xc0, 0xa3, 0x6d, 0x61, 0x70, 0x81, 0xa1, 0x3f, 0xc3 };
+const char test5[] = { 0xcd, 0x01, 0x2c, 0xa3, 0x61, 0x62, 0x63 };
 
 
 #define PRINT_C_ARR 0	/* set this flag to print a c-array to screen to generate above constants */
@@ -50,6 +51,17 @@ void pyprint( FILE *fp, const char* name, byte* buffer, size_t l ) {
 	fprintf( fp, "print '%s contains ', tuple(%s)\n", name, name );
 }
 
+/* a sink collecting the stream in memory, refusing the "fail"th write from now if that is set */
+typedef struct { byte data[256]; uint32_t n, fail; } memsink;
+int memsink_write( void *ctx, const byte *data, uint32_t n ) {
+	memsink *s = ( memsink* )ctx;
+	if ( s->fail && --s->fail == 0 ) return MSGPACK_IOERR;
+	if ( s->n + n > sizeof( s->data )) return MSGPACK_IOERR;
+	memcpy( s->data + s->n, data, n );
+	s->n += n;
+	return MSGPACK_SUCCESS;
+}
+
 #define CHK_PACK(p,l,n) 			printf( ">> %s\n", ( l != sizeof( test##n ) || memcmp( p->buffer, test##n, l ))&&++nfailp ? "FAILED PACK TEST" : "Passed pack test" );
 #define UNPK_CHK(u,T,f,chk)			!(( msgpack_unpack_peek( u ) == MSGPACK_##T ) && ( msgpack_unpack_##f == MSGPACK_SUCCESS ) && ( chk )) && ( puts( "Failed check " #chk " unpacking " #T ) || 1 );
 #define UNPK_CHK_NUM(u,T,t,var,x)	UNPK_CHK(u, T, t( u,&var ), var==x)
@@ -66,6 +78,33 @@ int main( )
 	
 	msgpack_p *p1, *p2, *p3, *p4;
 	msgpack_u *u1, *u2, *u3, *u4;
+	msgpack_p p5s, *p5 = &p5s;	/* caller-owned objects for fixed buffer tests */
+	msgpack_u u5s, *u5 = &u5s;
+	byte b5[8];
+	msgpack_arena arena;
+	msgpack_p *p6; msgpack_u *u6;
+	msgpack_p *p7; msgpack_u *u7;
+	int r7; uint32_t k7, ndone7;
+	msgpack_p *p8; byte b8[MSGPACK_MAX_DEPTH+2];
+	msgpack_p *p9a, *p9b; int32_t a9[40], c9[40]; double d9[9], e9[9];
+	msgpack_p *p10; const char s10[] = "a string of forty bytes, needing a str8";
+	const byte test10[] = { 0xd9,0x28, 0xc4,0x03,1,2,3, 0xd6,0x05,9,8,7,6, 0xc7,0x03,0xfb,1,2,3, 0xda,0x00,0x28 };
+	int8_t t10;
+	msgpack_p *p12; msgpack_tape tape; uint32_t k12;
+	msgpack_p *p13; msgpack_buffer b13; msgpack_u *u13;
+	msgpack_p *p14a, *p14b;
+	msgpack_p *p16; msgpack_value v16;
+	msgpack_p *p17; msgpack_intern t17a, t17b; const char *k17[6]; uint32_t i17; const char *s17[6] = { "alpha", "beta", "alpha", "beta", "id", "alpha" };
+	struct { int16_t id; double x; const char *tag; } r18[5] = { { -1, 0.5, "ab" }, { 300, -2, "cd" }, { 7, 1e10, "ab" }, { 0, 0, "" }, { -300, 3.25, "cd" } };
+	msgpack_p *p18a, *p18b; msgpack_batch_writer w18; msgpack_batch b18; const msgpack_column *c18;
+	msgpack_p *p19a, *p19b; msgpack_u *u19;
+	msgpack_p *p20; msgpack_mark m20a, m20b, m20c; uint32_t k20;
+	const byte test20[] = { 0xdd,0,0,0,3, 0x01, 0xdf,0,0,0,1, 0xa1,'k', 0xc3, 0x03 };
+	msgpack_p *p21; msgpack_mark m21; msgpack_frame_writer w21; msgpack_frame f21; msgpack_u u21; int32_t x21;
+	msgpack_p *p22; msgpack_mark m22; msgpack_iovec iov22[3]; byte b22[64];
+	msgpack_p *p23; memsink s23;
+	const byte test11[] = { 0xd6,0xff,0x65,0x53,0xf1,0x00, 0xd7,0xff,0x00,0x00,0x00,0x04,0x65,0x53,0xf1,0x00,
+		0xc7,0x0c,0xff,0x00,0x00,0x00,0x01,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff };
 	size_t l, nfailp = 0, nfailu = 0, n = 0;
 	
 	FILE *fpy = fopen( "testing.c.py","w" );
@@ -135,7 +174,7 @@ int main( )
 	msgpack_pack_double( p2, DBL_MAX );
 	l = msgpack_get_len( p2 );
 	CHK_PACK( p2,l,2 );
-	pyprint( fpy, "test2", p1->buffer, l );
+	pyprint( fpy, "test2", p2->buffer, l );
 	
 	u2 = msgpack_unpack_init( p2->buffer, l, 0 );			// consider epsilon checks here
 	n = UNPK_CHK_NUM( u2,FLOAT,float,f32,FLT_MIN );
@@ -162,7 +201,7 @@ int main( )
 	msgpack_pack_raw( p3, "a\0b", 3 );	// does not truncate
 	l = msgpack_get_len( p3 );
 	CHK_PACK( p3,l,3 );
-	pyprint( fpy, "test3", p1->buffer, l );
+	pyprint( fpy, "test3", p3->buffer, l );
 	
 	u3 = msgpack_unpack_init( p3->buffer, l, 0 );
 	// straight string
@@ -200,7 +239,7 @@ int main( )
 					msgpack_pack_bool( p4, 1 );
 	l = msgpack_get_len( p4 );
 	CHK_PACK( p4,l,4 );
-	pyprint( fpy, "test4", p1->buffer, l );
+	pyprint( fpy, "test4", p4->buffer, l );
 	
 	u4 = msgpack_unpack_init( p4->buffer, l, 0 );
 	n = UNPK_CHK( u4, MAP, map( u4,&u32 ), u32==3 );
@@ -224,6 +263,545 @@ int main( )
 	msgpack_unpack_free( u4 );
 	
 	
+	// *************** FIXED BUFFERS ***************
+	puts( "5. Fixed buffers" );
+	msgpack_pack_init_fixed( p5, b5, sizeof( b5 ));
+	msgpack_pack_uint16( p5, 300u );
+	msgpack_pack_str( p5, "abc" );
+	n = msgpack_pack_int32( p5, -70000l ) != MSGPACK_OVERFLOW;	// does not fit, buffer left intact
+	n += msgpack_pack_str( p5, "abc" ) != MSGPACK_OVERFLOW || msgpack_get_len( p5 ) != 7;	// nor a header without its payload
+	n += msgpack_pack_bin( p5, "ab", 2 ) != MSGPACK_OVERFLOW || msgpack_pack_ext( p5, 1, "a", 1 ) != MSGPACK_OVERFLOW || msgpack_get_len( p5 ) != 7;
+	l = msgpack_get_len( p5 );
+	CHK_PACK( p5,l,5 );
+	pyprint( fpy, "test5", p5->buffer, l );
+	
+	msgpack_unpack_init_fixed( u5, p5->buffer, l );
+	n += UNPK_CHK_NUM( u5,UINT16,uint16,u16,300u );
+	n += UNPK_CHK_STR( u5,s16,"abc" );
+	n += msgpack_unpack_len( u5 ) != 0;
+	msgpack_pack_reset( p5 );			// reuse the same buffer
+	n += msgpack_get_len( p5 ) != 0 || msgpack_pack_int32( p5, -70000l ) != MSGPACK_SUCCESS;
+	msgpack_unpack_init_fixed( u5, p5->buffer, msgpack_get_len( p5 ));
+	n += UNPK_CHK_NUM( u5,INT32,int32,i32,-70000l );
+	msgpack_pack_init_buffer( p5, b5, sizeof( b5 ), NULL );	// starts in b5, moves to the heap when it outgrows it
+	n += msgpack_pack_int32( p5, -70000l ) || p5->buffer != b5;
+	n += msgpack_pack_str( p5, "spills" ) || p5->buffer == b5 || !( p5->flags & MSGPACK_FLAG_OWNED );
+	msgpack_unpack_init_fixed( u5, p5->buffer, msgpack_get_len( p5 ));
+	n += UNPK_CHK_NUM( u5,INT32,int32,i32,-70000l );
+	n += UNPK_CHK_STR( u5,s16,"spills" );
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	
+	puts( "" );
+	printhex( p5->buffer, msgpack_get_len( p5 ));
+	puts( "" );
+	msgpack_pack_free( p5 );
+	msgpack_unpack_free( u5 );
+	
+	
+	// *************** ARENA ALLOCATOR ***************
+	puts( "6. Arena allocator" );
+	msgpack_arena_init( &arena, 64 );				// tiny blocks to force growth
+	p6 = msgpack_pack_init_alloc( &arena.hooks );
+	for ( i32 = 0; i32 < 100; ++i32 ) msgpack_pack_int32( p6, -70000l - i32 );
+	l = msgpack_get_len( p6 );
+	u6 = msgpack_unpack_init_alloc( p6->buffer, l, 1, &arena.hooks );
+	n = l != 500;
+	for ( i16 = 0; i16 < 100; ++i16 ) n += UNPK_CHK_NUM( u6,INT32,int32,i32,-70000l - i16 );
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	msgpack_arena_free( &arena );					// releases p6 and u6 in one go
+	puts( "" );
+	
+	
+	// *************** STREAMING UNPACK ***************
+	puts( "7. Streaming unpack" );
+	p7 = msgpack_pack_init( );
+	for ( i32 = 0; i32 < 50; ++i32 ) {
+		msgpack_pack_array( p7, 2 );
+			msgpack_pack_uint32( p7, 65536ul + i32 );
+			msgpack_pack_str( p7, "streamed" );
+	}
+	l = msgpack_get_len( p7 );
+	u7 = msgpack_unpack_init( NULL, 0, 1 );
+	n = msgpack_unpack_complete( u7 ) != MSGPACK_NEEDMORE;
+	ndone7 = 0;
+	for ( k7 = 0; k7 < l; ++k7 ) {					// feed one byte at a time
+		msgpack_unpack_append( u7, p7->buffer + k7, 1 );
+		while (( r7 = msgpack_unpack_complete( u7 )) > 0 ) {
+			n += UNPK_CHK( u7,ARRAY,array( u7,&u32 ), u32==2 );
+			n += UNPK_CHK_NUM( u7,UINT32,uint32,u32,65536ul + ndone7 );
+			n += UNPK_CHK_STR( u7,s16,"streamed" );
+			++ndone7;
+		}
+		n += r7 != MSGPACK_NEEDMORE;
+	}
+	n += ndone7 != 50;
+	msgpack_unpack_init_fixed( u5, p7->buffer + 1, 3 );			// truncated uint32
+	n += msgpack_unpack_uint32( u5, &u32 ) != MSGPACK_NEEDMORE || msgpack_unpack_getpos( u5 ) != 0;
+	msgpack_unpack_init_fixed( u5, p7->buffer + 6, 5 );			// truncated raw payload
+	n += msgpack_unpack_raw( u5, &pd, &u32 ) != MSGPACK_NEEDMORE || msgpack_unpack_getpos( u5 ) != 0;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p7 );
+	msgpack_unpack_free( u7 );
+	
+	puts( "8. Validation" );
+	p8 = msgpack_pack_init( );
+	msgpack_pack_map( p8, 2 );
+		msgpack_pack_str( p8, "a" ); msgpack_pack_int16( p8, -300 );
+		msgpack_pack_str( p8, "b" ); msgpack_pack_array( p8, 2 );
+			msgpack_pack_double( p8, 2.5 ); msgpack_pack_bool( p8, 1 );
+	msgpack_pack_uint8( p8, 200 );
+	l = msgpack_get_len( p8 );
+	n = msgpack_validate( p8->buffer, l, 0 ) != 2;
+	for ( k7 = 0; k7 < l; ++k7 )								// every truncation is incomplete
+		n += msgpack_validate( p8->buffer, k7, 0 ) != ( k7 == l - 2 ? 1 : k7 ? MSGPACK_NEEDMORE : 0 );
+	n += msgpack_validate( p8->buffer, l, 1 ) != MSGPACK_DEPTHERR;
+	memset( b8, 0x91, sizeof( b8 )); b8[sizeof( b8 )-1] = 0xc0;	// [[[...[nil]...]]]
+	n += msgpack_validate( b8, sizeof( b8 ), 0 ) != MSGPACK_DEPTHERR;
+	n += msgpack_validate( b8 + 2, sizeof( b8 ) - 2, 0 ) != 1;
+	msgpack_unpack_init_fixed( u5, b8, sizeof( b8 ));		// skipping is bounded by the same limit
+	n += msgpack_unpack_skip( u5 ) != MSGPACK_DEPTHERR || msgpack_unpack_getpos( u5 ) != 0;
+	n += msgpack_unpack_skip_depth( u5, 4 ) != MSGPACK_DEPTHERR;
+	msgpack_unpack_setpos( u5, 2 );
+	n += msgpack_unpack_skip( u5 ) != sizeof( b8 ) - 2 || msgpack_unpack_len( u5 ) != 0;
+	b8[0] = 0xdd; b8[1] = b8[2] = 0xff;						// array32 claiming far more than is present
+	n += msgpack_validate( b8, 5, 0 ) != MSGPACK_NEEDMORE;
+	b8[0] = 0xc1;											// reserved code
+	n += msgpack_validate( b8, 1, 0 ) != MSGPACK_TYPEERR;
+	msgpack_unpack_init_fixed( u5, p8->buffer, l );			// unchecked reads of the validated buffer
+	n += msgpack_unchecked_map( u5, &u32 ) || u32 != 2;
+	n += msgpack_unchecked_raw( u5, &pd, &u32 ) || u32 != 1 || *pd != 'a';
+	n += msgpack_unchecked_int32( u5, &i32 ) || i32 != -300;
+	n += msgpack_unchecked_raw( u5, &pd, &u32 ) || u32 != 1 || *pd != 'b';
+	n += msgpack_unchecked_array( u5, &u32 ) || u32 != 2;
+	n += msgpack_unchecked_uint8( u5, &u8 ) != MSGPACK_TYPEERR;
+	n += msgpack_unchecked_double( u5, &f64 ) || f64 != 2.5;
+	n += msgpack_unchecked_bool( u5 ) != 1;
+	n += msgpack_unchecked_uint8( u5, &u8 ) || u8 != 200;
+	n += msgpack_unpack_len( u5 ) != 0;
+	msgpack_unpack_init_fixed( u5, p8->buffer, l );
+	n += msgpack_unpack_skip( u5 ) != l - 2 || msgpack_unpack_skip( u5 ) != 2;
+	msgpack_unpack_init_fixed( u5, p8->buffer, l - 3 );		// truncated, so nothing is skipped
+	n += msgpack_unpack_skip( u5 ) != MSGPACK_NEEDMORE || msgpack_unpack_getpos( u5 ) != 0;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p8 );
+	
+	puts( "9. Bulk arrays" );
+	p9a = msgpack_pack_init( ); p9b = msgpack_pack_init( );
+	for ( i32 = 0; i32 < 40; ++i32 ) a9[i32] = ( i32 & 1 ? -1 : 1 ) * ( int32_t )( 1ul << ( i32 * 3 / 4 ));	// every encoding
+	for ( i32 = 0; i32 < 9; ++i32 ) d9[i32] = 1.0 / ( i32 + 1 );
+	msgpack_pack_int32_array( p9a, a9, 40 ); msgpack_pack_double_array( p9a, d9, 9 );
+	msgpack_pack_array( p9b, 40 ); for ( i32 = 0; i32 < 40; ++i32 ) msgpack_pack_int32( p9b, a9[i32] );
+	msgpack_pack_array( p9b, 9 ); for ( i32 = 0; i32 < 9; ++i32 ) msgpack_pack_double( p9b, d9[i32] );
+	l = msgpack_get_len( p9a );
+	n = l != msgpack_get_len( p9b ) || memcmp( p9a->buffer, p9b->buffer, l ) != 0;	// same bytes as element by element
+	msgpack_pack_init_fixed( p5, b5, sizeof( b5 ));							// arrays that do not fit leave nothing behind
+	n += msgpack_pack_uint8( p5, 1 ) || msgpack_pack_int32_array( p5, a9 + 8, 4 ) != MSGPACK_OVERFLOW || msgpack_get_len( p5 ) != 1;
+	n += msgpack_pack_double_array( p5, d9, 1 ) != MSGPACK_OVERFLOW || msgpack_get_len( p5 ) != 1;
+	n += msgpack_pack_int32_array( p5, a9, 4 ) || msgpack_get_len( p5 ) != 6;
+	msgpack_unpack_init_fixed( u5, p9a->buffer, l );
+	n += msgpack_unpack_int32_array( u5, c9, 39, &u32 ) != MSGPACK_MEMERR || u32 != 40 || msgpack_unpack_getpos( u5 ) != 0;
+	n += msgpack_unpack_int32_array( u5, c9, 40, &u32 ) || memcmp( a9, c9, sizeof( a9 )) != 0;
+	n += msgpack_unpack_double_array( u5, e9, 9, &u32 ) || memcmp( d9, e9, sizeof( d9 )) != 0;
+	msgpack_unpack_init_fixed( u5, p9a->buffer + 1, l - 1 );		// not an array: no length either
+	u32 = 7; n += msgpack_unpack_int32_array( u5, c9, 40, &u32 ) != MSGPACK_TYPEERR || u32 != 0;
+	u32 = 7; n += msgpack_unpack_float_array( u5, NULL, 0, &u32 ) != MSGPACK_TYPEERR || u32 != 0;
+	msgpack_unpack_init_fixed( u5, p9a->buffer, l - 1 );
+	msgpack_unpack_skip( u5 );
+	n += msgpack_unpack_double_array( u5, e9, 9, &u32 ) != MSGPACK_NEEDMORE;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p9a ); msgpack_pack_free( p9b );
+	
+	puts( "10. Str8, bin and ext" );
+	p10 = msgpack_pack_init( );
+	msgpack_pack_raw( p10, s10, 40 );
+	msgpack_pack_bin( p10, test10 + 4, 3 );
+	msgpack_pack_ext( p10, 5, "\x09\x08\x07\x06", 4 );
+	msgpack_pack_ext( p10, -5, test10 + 4, 3 );
+	msgpack_pack_set_compat( p10, 1 );
+	msgpack_pack_raw( p10, s10, 40 );
+	n = msgpack_pack_ext( p10, 5, s10, 4 ) != MSGPACK_TYPEERR;
+	l = msgpack_get_len( p10 );
+	n += l != 42 + 17 + 43 || memcmp( p10->buffer, test10, 2 ) || memcmp( p10->buffer + 42, test10 + 2, 17 ) || memcmp( p10->buffer + 59, test10 + 19, 3 );
+	n += msgpack_validate( p10->buffer, l, 0 ) != 5;
+	msgpack_unpack_init_fixed( u5, p10->buffer, l );
+	n += msgpack_unpack_bin( u5, &pd, &u32 ) != MSGPACK_TYPEERR;
+	n += msgpack_unpack_raw( u5, &pd, &u32 ) || u32 != 40 || memcmp( pd, s10, 40 );
+	n += msgpack_unpack_peek( u5 ) != MSGPACK_BIN || msgpack_unpack_bin( u5, &pd, &u32 ) || u32 != 3 || pd[2] != 3;
+	n += msgpack_unpack_peek( u5 ) != MSGPACK_EXT || msgpack_unpack_ext( u5, &t10, &pd, &u32 ) || t10 != 5 || u32 != 4 || pd[0] != 9;
+	n += msgpack_unpack_skip( u5 ) != 6 || msgpack_unpack_skip( u5 ) != 43 || msgpack_unpack_len( u5 ) != 0;
+	msgpack_unpack_init_fixed( u5, p10->buffer + 53, 5 );	// the ext8 with a byte missing
+	n += msgpack_unpack_ext( u5, &t10, &pd, &u32 ) != MSGPACK_NEEDMORE || msgpack_unpack_getpos( u5 ) != 0;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p10 );
+	
+	puts( "11. Timestamps" );
+	msgpack_pack_init_fixed( p5, b8, sizeof( b8 ));
+	n = msgpack_pack_timestamp( p5, 1700000000, 0 ) || msgpack_pack_timestamp( p5, 1700000000, 1 ) || msgpack_pack_timestamp( p5, -1, 1 );
+	n += msgpack_pack_timestamp( p5, 0, 1000000000ul ) != MSGPACK_ARGERR;
+	n += msgpack_get_len( p5 ) != sizeof( test11 ) || memcmp( b8, test11, sizeof( test11 )) != 0;
+	msgpack_unpack_init_fixed( u5, test11, sizeof( test11 ));
+	n += msgpack_unpack_timestamp( u5, &i64, &u32 ) || i64 != 1700000000 || u32 != 0;
+	n += msgpack_unpack_timestamp( u5, &i64, &u32 ) || i64 != 1700000000 || u32 != 1;
+	n += msgpack_unpack_timestamp( u5, &i64, &u32 ) || i64 != -1 || u32 != 1;
+	msgpack_unpack_init_fixed( u5, test10 + 7, 6 );			// fixext 4 of another type
+	n += msgpack_unpack_timestamp( u5, &i64, &u32 ) != MSGPACK_TYPEERR;
+	msgpack_pack_init_fixed( p5, b5, sizeof( b5 ));			// only the chosen form need fit
+	n += msgpack_pack_timestamp( p5, 5, 0 ) || msgpack_get_len( p5 ) != 6;
+	n += msgpack_pack_timestamp( p5, 5, 0 ) != MSGPACK_OVERFLOW || msgpack_get_len( p5 ) != 6;
+	msgpack_pack_init_fixed( p5, b5, sizeof( b5 ));
+	n += msgpack_pack_timestamp( p5, 5, 1 ) != MSGPACK_OVERFLOW || msgpack_get_len( p5 ) != 0;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	
+	puts( "12. Tape" );
+	p12 = msgpack_pack_init( );
+	msgpack_pack_map( p12, 3 );
+		msgpack_pack_str( p12, "skip" ); msgpack_pack_array( p12, 3 );
+			msgpack_pack_int8( p12, 1 ); msgpack_pack_map( p12, 1 ); msgpack_pack_str( p12, "x" ); msgpack_pack_null( p12 ); msgpack_pack_array( p12, 0 );
+		msgpack_pack_str( p12, "id" ); msgpack_pack_uint32( p12, 123456 );
+		msgpack_pack_str( p12, "name" ); msgpack_pack_str( p12, "tape" );
+	msgpack_pack_null( p12 );
+	msgpack_arena_init( &arena, 256 );
+	u6 = msgpack_unpack_init( p12->buffer, msgpack_get_len( p12 ), 0 );
+	n = msgpack_tape_parse( &tape, u6, 0, &arena.hooks ) || tape.n != 12 || msgpack_unpack_len( u6 ) != 1;
+	n += tape.e[0].next != 12 || tape.e[2].type != MSGPACK_ARRAY || tape.e[2].next != 8 || tape.e[4].next != 7;
+	k12 = msgpack_tape_find( &tape, 0, "id", 2 );
+	n += k12 != 9 || msgpack_tape_unpacker( &tape, k12, u5 ) || msgpack_unpack_uint32( u5, &u32 ) || u32 != 123456;
+	k12 = msgpack_tape_find( &tape, 0, "name", 4 );
+	n += msgpack_tape_raw( &tape, k12, &pd, &u32 ) || u32 != 4 || memcmp( pd, "tape", 4 ) != 0;
+	n += msgpack_tape_find( &tape, 0, "nope", 4 ) != 0 || msgpack_tape_find( &tape, 2, "id", 2 ) != 0;
+	msgpack_tape_free( &tape );
+	n += msgpack_tape_parse( &tape, u6, 0, NULL ) || tape.n != 1 || tape.e[0].type != MSGPACK_NULL;
+	msgpack_tape_free( &tape );
+	n += msgpack_tape_parse( &tape, u6, 0, NULL ) != MSGPACK_MEMERR;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_unpack_free( u6 );
+	msgpack_pack_free( p12 );
+	msgpack_arena_free( &arena );
+	
+	
+	// *************** BUFFER HAND-OVER ***************
+	puts( "13. Buffer hand-over" );
+	p13 = msgpack_pack_init( );
+	for ( i32 = 0; i32 < 100; ++i32 ) msgpack_pack_int32( p13, -70000l - i32 );	// 500 bytes, so the buffer has grown
+	pd = p13->buffer;
+	n = msgpack_pack_release( p13, &b13 ) || b13.data != pd || b13.n != 500 || b13.size < 500 || msgpack_get_len( p13 ) != 0;
+	n += msgpack_pack_str( p13, "again" ) || p13->buffer == pd;		// packing carries on in a new buffer
+	u13 = msgpack_unpack_adopt( &b13 );
+	n += !u13 || b13.data != NULL || msgpack_unpack_len( u13 ) != 500;
+	for ( i16 = 0; i16 < 100; ++i16 ) n += UNPK_CHK_NUM( u13,INT32,int32,i32,-70000l - i16 );
+	msgpack_unpack_free( u13 );							// frees the adopted buffer
+	msgpack_pack_init_fixed( p5, b5, sizeof( b5 ));		// a caller's buffer can only be copied out
+	msgpack_pack_uint16( p5, 300u );
+	n += msgpack_pack_release( p5, &b13 ) || b13.data == b5 || b13.n != 3 || memcmp( b13.data, b5, 3 ) != 0 || msgpack_get_len( p5 ) != 0;
+	msgpack_buffer_free( &b13 );
+	n += b13.data != NULL;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p13 );
+	
+	
+	// *************** UNCHECKED PACKING ***************
+	puts( "14. Unchecked packing" );
+	p14a = msgpack_pack_init( );
+	p14b = msgpack_pack_init( );
+	msgpack_pack_array( p14a, 20 );
+	for ( i32 = 0; i32 < 20; ++i32 ) msgpack_pack_int64( p14a, -( 1ll << ( 3*i32 )) + i32 );
+	msgpack_pack_map( p14a, 2 ); msgpack_pack_str( p14a, s10 ); msgpack_pack_double( p14a, 0.5 );
+	msgpack_pack_uint16( p14a, 300u ); msgpack_pack_bool( p14a, 1 );
+	msgpack_pack_float( p14a, 1.5f ); msgpack_pack_null( p14a );
+	n = msgpack_pack_reserve( p14b, 3 + 20*9 + 1 + 42 + 9 + 3 + 5 + 1 + 1 ) != MSGPACK_SUCCESS;
+	pd = p14b->buffer;
+	msgpack_unchecked_pack_array( p14b, 20 );
+	for ( i32 = 0; i32 < 20; ++i32 ) msgpack_unchecked_pack_int64( p14b, -( 1ll << ( 3*i32 )) + i32 );
+	msgpack_unchecked_pack_map( p14b, 2 ); msgpack_unchecked_pack_raw( p14b, s10, strlen( s10 )); msgpack_unchecked_pack_double( p14b, 0.5 );
+	msgpack_unchecked_pack_uint16( p14b, 300u ); msgpack_unchecked_pack_bool( p14b, 1 );
+	msgpack_unchecked_pack_float( p14b, 1.5f ); msgpack_unchecked_pack_null( p14b );
+	l = msgpack_get_len( p14a );
+	n += p14b->buffer != pd || msgpack_get_len( p14b ) != l || memcmp( p14a->buffer, p14b->buffer, l ) != 0;
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	puts( "" );
+	msgpack_pack_free( p14a );
+	msgpack_pack_free( p14b );
+	
+	
+	// *************** PROBING ***************
+	puts( "15. Probing and error strings" );
+	msgpack_pack_init_fixed( p5, b5, sizeof( b5 ));
+	msgpack_pack_str( p5, "abc" ); msgpack_pack_int16( p5, -300 );
+	msgpack_unpack_init_fixed( u5, b5, msgpack_get_len( p5 ));
+	pd = u5->p;		// a wrong guess must leave the unpacker in place, so the next type can be tried
+	n = msgpack_unpack_int32( u5, &i32 ) != MSGPACK_TYPEERR || msgpack_unpack_double( u5, &f64 ) != MSGPACK_TYPEERR || msgpack_unpack_bool( u5 ) != MSGPACK_TYPEERR || u5->p != pd;
+	n += msgpack_unpack_raw( u5, &pd, &u32 ) || u32 != 3 || memcmp( pd, "abc", 3 ) != 0;
+	pd = u5->p;
+	n += msgpack_unpack_int8( u5, &i8 ) != MSGPACK_TYPEERR || u5->p != pd || msgpack_unpack_int16( u5, &i16 ) || i16 != -300;
+	n += strcmp( msgpack_strerror( MSGPACK_TYPEERR ), "unexpected type code" ) != 0 || strcmp( msgpack_strerror( -100 ), "unknown error code" ) != 0;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	
+	
+	// *************** UNPACK ANY ***************
+	puts( "16. Unpacking any type" );
+	p16 = msgpack_pack_init( );
+	msgpack_pack_int8( p16, -3 ); msgpack_pack_int32( p16, 70000l ); msgpack_pack_int64( p16, -( 1ll << 40 )); msgpack_pack_uint64( p16, ~0ull );
+	msgpack_pack_float( p16, 1.5f ); msgpack_pack_double( p16, -0.25 ); msgpack_pack_bool( p16, 1 ); msgpack_pack_null( p16 );
+	msgpack_pack_str( p16, s10 ); msgpack_pack_bin( p16, b8, 3 ); msgpack_pack_ext( p16, 5, b8, 4 ); msgpack_pack_map( p16, 70000ul );
+	msgpack_unpack_init_fixed( u5, p16->buffer, msgpack_get_len( p16 ));
+	n = msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_INT64 || v16.v.i != -3;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_UINT64 || v16.v.u != 70000;	// typed by sign, not by encoding
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_INT64 || v16.v.i != -( 1ll << 40 );
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_UINT64 || v16.v.u != ~0ull;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_FLOAT || v16.v.d != 1.5;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_DOUBLE || v16.v.d != -0.25;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_BOOL || v16.v.b != 1;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_NULL;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_RAW || v16.n != strlen( s10 ) || memcmp( v16.v.p, s10, v16.n ) != 0;
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_BIN || v16.n != 3 || v16.v.p[2] != b8[2];
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_EXT || v16.ext != 5 || v16.n != 4 || v16.v.p[3] != b8[3];
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_MAP || v16.n != 70000ul || msgpack_unpack_len( u5 ) != 0;
+	msgpack_unpack_init_fixed( u5, s10, 3 );			// 'a' is a fixint; ' s' follows
+	n += msgpack_unpack_any( u5, &v16 ) || v16.type != MSGPACK_UINT64 || v16.v.u != 'a';
+	msgpack_unpack_init_fixed( u5, p16->buffer + msgpack_get_len( p16 ) - 5 - 6 - 5, 4 );	// bin header and 2 of its 3 bytes
+	n += msgpack_unpack_any( u5, &v16 ) != MSGPACK_NEEDMORE || msgpack_unpack_len( u5 ) != 4;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p16 );
+	
+	
+	// *************** KEY DICTIONARY ***************
+	puts( "17. Interned keys and the key dictionary" );
+	p17 = msgpack_pack_init( );
+	msgpack_intern_init( &t17a, 0, NULL );
+	msgpack_intern_init( &t17b, 0, NULL );
+	for ( n = i17 = 0; i17 < 6; ++i17 ) n += msgpack_pack_key( p17, &t17a, s17[i17], strlen( s17[i17] )) != MSGPACK_SUCCESS;
+	l = msgpack_get_len( p17 );		// ext8 "alpha", fixext4 "beta", 2 fixext1 ids, fixstr "id" (too short to define), 1 more id
+	n += l != 8 + 6 + 3 + 3 + 3 + 3 || t17a.n != 2 || t17a.ndict != 2;
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	msgpack_unpack_init_fixed( u5, p17->buffer, l );
+	for ( n = i17 = 0; i17 < 6; ++i17 ) n += msgpack_unpack_key( u5, &t17b, k17 + i17, &u32 ) || u32 != strlen( s17[i17] ) || strcmp( k17[i17], s17[i17] ) != 0;
+	n += k17[0] != k17[2] || k17[0] != k17[5] || k17[1] != k17[3] || k17[0] != msgpack_intern_str( &t17b, "alpha", 5 );
+	msgpack_unpack_init_fixed( u5, p17->buffer, l );		// replaying the session defines its keys twice
+	n += msgpack_unpack_key( u5, &t17b, k17, &u32 ) != MSGPACK_TYPEERR || u5->p != p17->buffer;
+	msgpack_intern_reset( &t17b );						// and a fresh session does not know its ids
+	n += msgpack_unpack_init_fixed( u5, p17->buffer + 8 + 6, 3 ) || msgpack_unpack_key( u5, &t17b, k17, &u32 ) != MSGPACK_TYPEERR || msgpack_unpack_len( u5 ) != 3;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_intern_free( &t17a );
+	msgpack_intern_free( &t17b );
+	msgpack_pack_free( p17 );
+	
+	
+	// *************** RECORD BATCHES ***************
+	puts( "18. Record batches" );
+	p18a = msgpack_pack_init( );
+	p18b = msgpack_pack_init( );
+	n = msgpack_batch_begin( &w18, p18a, 5 ) || msgpack_batch_column( &w18, "id", MSGPACK_INT16, &r18[0].id, sizeof( r18[0] ));
+	n += msgpack_batch_column( &w18, "x", MSGPACK_DOUBLE, &r18[0].x, sizeof( r18[0] )) || msgpack_batch_column( &w18, "tag", MSGPACK_RAW, &r18[0].tag, sizeof( r18[0] ));
+	n += msgpack_batch_column( &w18, "bad", MSGPACK_MAP, &r18[0].x, sizeof( r18[0] )) != MSGPACK_ARGERR;
+	n += msgpack_batch_end( &w18 ) || w18.p != NULL;
+	// ext32 and 5 rows; name, type code and int array; name, code and bin of 5 doubles; name, code, 3 distinct strings and 5 indices
+	n += msgpack_get_len( p18a ) != 6 + 1 + ( 3 + 2 + 1 + 1 + 3 + 1 + 1 + 3 ) + ( 2 + 2 + 2 + 40 ) + ( 4 + 2 + 1 + 3 + 3 + 1 + 1 + 5 );
+	msgpack_pack_set_zerocopy( p18b, 1 );		// names and strings are copied, not referenced, as they may not outlive the writer
+	n += msgpack_batch_begin( &w18, p18b, 5 ) || msgpack_batch_column( &w18, "tag", MSGPACK_RAW, &r18[0].tag, sizeof( r18[0] )) || msgpack_batch_cancel( &w18 ) || w18.p != NULL;
+	n += msgpack_get_len( p18b ) != 0;			// cancel rolls the packer back
+	n += msgpack_batch_begin( &w18, p18b, 5 ) || msgpack_batch_column( &w18, "x", MSGPACK_DOUBLE, &r18[0].x, sizeof( r18[0] )) || msgpack_batch_end( &w18 );
+	n += p18b->sg->n != 0 || msgpack_get_len( p18b ) != 6 + 1 + 2 + 2 + 2 + 40 || memcmp( p18b->buffer + 13, p18a->buffer + 6 + 1 + 15 + 6, 40 ) != 0;
+	msgpack_pack_set_zerocopy( p18b, 0 );
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	msgpack_unpack_init_fixed( u5, p18a->buffer, msgpack_get_len( p18a ));
+	n = msgpack_unpack_batch( u5, &b18, NULL ) || b18.nrows != 5 || b18.ncols != 3 || msgpack_unpack_len( u5 ) != 0;
+	n += !( c18 = msgpack_batch_find( &b18, "x" )) || c18->type != MSGPACK_DOUBLE || (( double* )c18->data )[2] != 1e10 || msgpack_batch_find( &b18, "y" );
+	n += !( c18 = msgpack_batch_find( &b18, "tag" )) || c18->ndict != 3 || c18->dict[(( uint32_t* )c18->data )[4]].n != 2;
+	for ( i32 = 0; i32 < 5; ++i32 ) {		// each row reads back as the map it replaces
+		msgpack_pack_reset( p18b );
+		msgpack_pack_map( p18b, 3 );
+		msgpack_pack_str( p18b, "id" ); msgpack_pack_int16( p18b, r18[i32].id );
+		msgpack_pack_str( p18b, "x" ); msgpack_pack_double( p18b, r18[i32].x );
+		msgpack_pack_str( p18b, "tag" ); msgpack_pack_str( p18b, r18[i32].tag );
+		l = msgpack_get_len( p18b );
+		n += msgpack_batch_pack_row( &b18, i32, p18b ) || msgpack_get_len( p18b ) != 2*l || memcmp( p18b->buffer, p18b->buffer + l, l ) != 0;
+	}
+	n += msgpack_batch_pack_row( &b18, 5, p18b ) != MSGPACK_ARGERR;
+	msgpack_batch_free( &b18 );
+	p18a->buffer[msgpack_get_len( p18a ) - 1] = 3;		// an index past the dictionary
+	msgpack_unpack_init_fixed( u5, p18a->buffer, msgpack_get_len( p18a ));
+	n += msgpack_unpack_batch( u5, &b18, NULL ) != MSGPACK_TYPEERR || u5->p != p18a->buffer || b18.col != NULL;
+	memcpy( b8, "\xc9\xf0\0\0\0", 5 ); b8[5] = MSGPACK_EXT_BATCH;	// ext32 claiming far more than is present...
+	msgpack_pack_init_fixed( p5, b8 + 6, sizeof( b8 ) - 6 );		// ...for 2^29 int64 rows, whose size wraps 32 bits
+	n += msgpack_pack_uint32( p5, 1u<<29 ) || msgpack_pack_str( p5, "x" ) || msgpack_pack_uint8( p5, MSGPACK_INT64 );
+	n += msgpack_pack_array( p5, 1u<<29 ) || msgpack_pack_int8( p5, 1 ) || msgpack_pack_int8( p5, 2 );
+	msgpack_unpack_init_fixed( u5, b8, 0xf0000006u );
+	n += msgpack_unpack_batch( u5, &b18, NULL ) != MSGPACK_TYPEERR || u5->p != b8 || b18.col != NULL;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p18a );
+	msgpack_pack_free( p18b );
+	
+	
+	// *************** COMPRESSION ***************
+	puts( "19. Compressed blocks" );
+	p19a = msgpack_pack_init( );
+	p19b = msgpack_pack_init( );
+	for ( i32 = 0; i32 < 200; ++i32 ) msgpack_pack_int32_array( p19a, a9, 40 );		// repetitive packed data
+	l = msgpack_get_len( p19a );
+	n = msgpack_pack_lz( p19b, p19a->buffer, l ) || msgpack_get_len( p19b ) > l/4;
+	n += msgpack_pack_lz( p19b, s10, 6 ) || memcmp( p19b->buffer + msgpack_get_len( p19b ) - 6, s10, 6 ) != 0;	// stored as is
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	u19 = msgpack_unpack_init( NULL, 0, 0 );
+	msgpack_unpack_init_fixed( u5, p19b->buffer, 10 );		// the decoder can start on a partial stream
+	n = msgpack_unpack_lz( u5, u19 ) != MSGPACK_NEEDMORE || u5->p != p19b->buffer || msgpack_unpack_len( u19 ) != 0;
+	msgpack_unpack_init_fixed( u5, p19b->buffer, msgpack_get_len( p19b ));
+	n += msgpack_unpack_lz( u5, u19 ) || msgpack_unpack_len( u5 ) != 0 || msgpack_unpack_len( u19 ) != l + 6;
+	n += memcmp( u19->p, p19a->buffer, l ) != 0 || memcmp( u19->p + l, s10, 6 ) != 0;
+	p19b->buffer[6] ^= 1;									// a block not matching its length is refused
+	msgpack_unpack_init_fixed( u5, p19b->buffer, msgpack_get_len( p19b ));
+	n += msgpack_unpack_lz( u5, u19 ) != MSGPACK_TYPEERR || u5->p != p19b->buffer;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_unpack_free( u19 );
+	msgpack_pack_free( p19a );
+	msgpack_pack_free( p19b );
+	
+	
+	// *************** DEFERRED HEADERS ***************
+	puts( "20. Deferred container headers and rollback" );
+	p20 = msgpack_pack_init( );
+	n = msgpack_pack_begin_array( p20, &m20a );
+	msgpack_pack_fix( p20, 1 );
+	n += msgpack_pack_begin_map( p20, &m20b );
+	msgpack_pack_str( p20, "k" ); msgpack_pack_bool( p20, 1 );
+	n += msgpack_pack_checkpoint( p20, &m20c );
+	msgpack_pack_str( p20, "half" ); msgpack_pack_array( p20, 4 );		// a pair abandoned part way
+	n += msgpack_pack_rollback( p20, &m20c );
+	n += msgpack_pack_end_map( p20, &m20b, 1 );
+	msgpack_pack_fix( p20, 3 );
+	n += msgpack_pack_end_array( p20, &m20b, 3 ) != MSGPACK_ARGERR;	// not the array's mark
+	n += msgpack_pack_end_array( p20, &m20a, 3 );
+	n += msgpack_get_len( p20 ) != sizeof( test20 ) || memcmp( p20->buffer, test20, sizeof( test20 )) != 0;
+	m20c.offset = 100;
+	n += msgpack_pack_rollback( p20, &m20c ) != MSGPACK_ARGERR || msgpack_get_len( p20 ) != sizeof( test20 );
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	msgpack_unpack_init_fixed( u5, p20->buffer, msgpack_get_len( p20 ));
+	n = msgpack_unpack_array( u5, &k20 ) || k20 != 3;
+	n += msgpack_unpack_skip( u5 ) != 1 || msgpack_unpack_map( u5, &k20 ) || k20 != 1;
+	n += msgpack_unpack_skip( u5 ) != 2 || msgpack_unpack_skip( u5 ) != 1 || msgpack_unpack_skip( u5 ) != 1 || msgpack_unpack_len( u5 ) != 0;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p20 );
+	
+	
+	// *************** FRAMES ***************
+	puts( "21. Frames" );
+	p21 = msgpack_pack_init( );
+	n = msgpack_crc32c( 0, "123456789", 9 ) != 0xe3069283 || msgpack_crc32c( msgpack_crc32c( 0, "1234", 4 ), "56789", 5 ) != 0xe3069283;
+	n += msgpack_pack_frame_begin( p21, &m21 );
+	msgpack_pack_str( p21, "single" );
+	n += msgpack_pack_frame_end( p21, &m21, MSGPACK_FRAME_CRC );
+	n += msgpack_get_len( p21 ) != MSGPACK_FRAME_HEAD + 7 || p21->buffer[4] != 5 + 7 || p21->buffer[6] != MSGPACK_FRAME_CRC;
+	n += msgpack_frame_batch_begin( &w21, p21, MSGPACK_FRAME_CRC );
+	for ( i32 = 0; i32 < 3; ++i32 ) {
+		n += msgpack_frame_batch_next( &w21 );
+		msgpack_pack_int32( p21, 1000*i32 ); msgpack_pack_str( p21, "x" );		// a message of two objects
+	}
+	n += msgpack_frame_batch_next( &w21 );									// an empty one
+	n += msgpack_frame_batch_end( &w21 ) || w21.p != NULL || w21.offsets != NULL;
+	l = msgpack_get_len( p21 );
+	n += msgpack_frame_batch_begin( &w21, p21, 0 ) || msgpack_frame_batch_next( &w21 ) || msgpack_pack_str( p21, "dropped" );
+	n += msgpack_frame_batch_cancel( &w21 ) || msgpack_get_len( p21 ) != l;
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	msgpack_unpack_init_fixed( u5, p21->buffer, MSGPACK_FRAME_HEAD + 6 );
+	n = msgpack_unpack_frame( u5, &f21 ) != MSGPACK_NEEDMORE || u5->p != p21->buffer;
+	msgpack_unpack_init_fixed( u5, p21->buffer, l );
+	n += msgpack_unpack_frame( u5, &f21 ) || f21.count != 1 || f21.data != p21->buffer + MSGPACK_FRAME_HEAD;
+	n += msgpack_frame_message( &f21, 0, &u21 ) || msgpack_unpack_skip( &u21 ) != 7 || msgpack_unpack_len( &u21 ) != 0;
+	n += msgpack_unpack_frame( u5, &f21 ) || f21.count != 4 || !( f21.flags & MSGPACK_FRAME_BATCH ) || msgpack_unpack_len( u5 ) != 0;
+	for ( i32 = 0; i32 < 3; ++i32 ) {
+		n += msgpack_frame_message( &f21, i32, &u21 ) || msgpack_unpack_int32( &u21, &x21 ) || x21 != 1000*i32;
+		n += msgpack_unpack_skip( &u21 ) != 2 || msgpack_unpack_len( &u21 ) != 0;
+	}
+	n += msgpack_frame_message( &f21, 3, &u21 ) || msgpack_unpack_len( &u21 ) != 0 || msgpack_frame_message( &f21, 4, &u21 ) != MSGPACK_ARGERR;
+	p21->buffer[MSGPACK_FRAME_HEAD + 2] ^= 1;							// corrupt the first body
+	msgpack_unpack_init_fixed( u5, p21->buffer, l );
+	n += msgpack_unpack_frame( u5, &f21 ) != MSGPACK_TYPEERR || u5->p != p21->buffer;
+	printf( ">> %s\n", n ? "FAILED UNPACK TESTS" : "Passed unpack tests" );
+	nfailu += n;
+	puts( "" );
+	msgpack_pack_free( p21 );
+	
+	
+	// *************** ZERO-COPY ***************
+	puts( "22. Zero-copy packing" );
+	p22 = msgpack_pack_init( );
+	n = msgpack_pack_set_zerocopy( p22, 32 );
+	msgpack_pack_str( p22, "a" );
+	msgpack_pack_raw( p22, s10, 40 );					// referenced
+	msgpack_pack_uint8( p22, 7 );
+	n += msgpack_pack_raw_ref( p22, NULL, 0 ) || msgpack_pack_bin( p22, NULL, 0 );	// empty payloads, nothing referenced
+	n += msgpack_get_len( p22 ) != 48 || msgpack_get_iovcnt( p22 ) != 3;
+	n += msgpack_get_iovec( p22, iov22, 2 ) != MSGPACK_OVERFLOW || msgpack_get_iovec( p22, iov22, 3 ) != 3;
+	n += iov22[0].iov_base != p22->buffer || iov22[0].iov_len != 4 || iov22[1].iov_base != s10 || iov22[1].iov_len != 40;
+	n += iov22[2].iov_base != p22->buffer + 4 || iov22[2].iov_len != 4 || memcmp( p22->buffer, "\xa1\x61\xd9\x28\x07\xa0\xc4\x00", 8 );
+	n += msgpack_pack_checkpoint( p22, &m22 );			// roll back over more references
+	n += msgpack_pack_raw_ref( p22, s10, 3 ) || msgpack_pack_raw( p22, s10, 40 ) || msgpack_get_iovcnt( p22 ) != 7;
+	n += msgpack_pack_rollback( p22, &m22 ) || msgpack_get_len( p22 ) != 48 || msgpack_get_iovcnt( p22 ) != 3;
+	n += msgpack_copy_to( p22, b22, 47 ) != 0 || msgpack_copy_to( p22, b22, sizeof( b22 )) != 48;
+	n += memcmp( b22, "\xa1\x61\xd9\x28", 4 ) || memcmp( b22 + 4, s10, 40 ) || memcmp( b22 + 44, "\x07\xa0\xc4\x00", 4 );
+	n += msgpack_pack_flatten( p22 ) || msgpack_get_iovcnt( p22 ) != 1 || msgpack_get_len( p22 ) != 48 || memcmp( p22->buffer, b22, 48 );
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	puts( "" );
+	msgpack_pack_free( p22 );
+	
+	
+	// *************** STREAMING PACK ***************
+	puts( "23. Packing to a sink" );
+	p23 = msgpack_pack_init( );
+	memset( &s23, 0, sizeof( s23 ));
+	n = msgpack_pack_set_sink( p23, memsink_write, &s23, 16 );
+	for ( i32 = 0; i32 < 10; ++i32 ) msgpack_pack_int32( p23, i32 );
+	n += s23.n != 0 || msgpack_get_len( p23 ) != 10 || msgpack_pack_total( p23 ) != 10;
+	n += msgpack_pack_raw( p23, s10, 8 ) || s23.n != 11 || msgpack_get_len( p23 ) != 8;		// payload would pass the watermark
+	n += msgpack_pack_raw( p23, s10, 40 ) || s23.n != 61 || msgpack_get_len( p23 ) != 0;	// payload larger than the watermark
+	n += msgpack_pack_uint8( p23, 7 ) || msgpack_pack_total( p23 ) != 62 || msgpack_pack_flush( p23 ) || s23.n != 62;
+	n += memcmp( s23.data, "\0\1\2\3\4\5\6\7\x08\x09\xa8", 11 ) || memcmp( s23.data + 11, s10, 8 );
+	n += memcmp( s23.data + 19, "\xd9\x28", 2 ) || memcmp( s23.data + 21, s10, 40 ) || s23.data[61] != 7;
+	n += msgpack_pack_raw_ref( p23, s10, 40 ) || msgpack_pack_uint8( p23, 5 );
+	s23.fail = 2;													// refuse the referenced payload
+	n += msgpack_pack_flush( p23 ) != MSGPACK_IOERR || s23.n != 64 || msgpack_get_len( p23 ) != 41 || msgpack_pack_total( p23 ) != 105;
+	n += msgpack_pack_flush( p23 ) || s23.n != 105 || msgpack_get_len( p23 ) != 0;		// resumes after the header
+	n += memcmp( s23.data + 62, "\xd9\x28", 2 ) || memcmp( s23.data + 64, s10, 40 ) || s23.data[104] != 5;
+	printf( ">> %s\n", n ? "FAILED PACK TEST" : "Passed pack test" );
+	nfailp += n;
+	puts( "" );
+	msgpack_pack_free( p23 );
+	
+	
 	printf( "Failed %d packing tests, %d unpacking tests\n", nfailp, nfailu );
 	fclose( fpy );
 	return 0;